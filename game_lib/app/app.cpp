@@ -2,9 +2,13 @@
 
 #include "../model/collision_detector.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <sstream>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 
 
 using namespace collision_detector;
@@ -20,17 +24,45 @@ public:
     , map_loots_(map_->GetLostObjects())
     , players_(players)
     , id_(id) {
+        // Собака, поворачивавшая за тик, собирает предметы на каждом отрезке своего пути.
+        // Время на отрезке пересчитывается в долю всего пути, чтобы события разных собак сравнивались
+        for (size_t i = 0; i < players_.size(); ++i) {
+            const auto* dog = players_[i]->GetDog();
+            const auto& turns = dog->GetTurns();
+            if (turns.empty()) {
+                segments_.push_back({i, dog->GetLastPosition(), dog->GetPosition(), 0.0, 1.0});
+                continue;
+            }
+
+            const size_t first = segments_.size();
+            double length = 0.0;
+            geom::Point2D start = dog->GetLastPosition();
+            auto add = [&](geom::Point2D end) {
+                const double segment_length = std::hypot(end.x - start.x, end.y - start.y);
+                segments_.push_back({i, start, end, length, segment_length});
+                length += segment_length;
+                start = end;
+            };
+            for (const auto& turn : turns) {
+                add(turn);
+            }
+            add(dog->GetPosition());
+            for (size_t j = first; j < segments_.size() && length > 0.0; ++j) {
+                segments_[j].time_start /= length;
+                segments_[j].time_scale /= length;
+            }
+        }
     }
     
     size_t GetId() const override {return id_;}
 
     size_t GatherersCount() const override {
-        return players_.size();
+        return segments_.size();
     }
 
     Gatherer GetGatherer(size_t index) const override {
-        const auto* dog_ptr = players_[index]->GetDog();
-        return Gatherer{dog_ptr->GetLastPosition(), dog_ptr->GetPosition(), dog_width/2};
+        const auto& segment = segments_[index];
+        return Gatherer{segment.start, segment.end, dog_width/2};
     }
 
     size_t ItemsCount() const override {
@@ -49,12 +81,27 @@ public:
     }
 
     const model::Map* GetMap() const {return map_;}
-    const Players& GetPlayers() const {return players_;}
+    // Игрок, которому принадлежит отрезок gatherer
+    Player* GetPlayer(size_t gatherer) const {return players_.at(segments_.at(gatherer).player);}
+    // Доля пути игрока за тик, пройденная к моменту time на отрезке gatherer
+    double GetPathTime(size_t gatherer, double time) const {
+        const auto& segment = segments_.at(gatherer);
+        return segment.time_start + time * segment.time_scale;
+    }
 
 private:
+    struct Segment {
+        size_t player;
+        geom::Point2D start;
+        geom::Point2D end;
+        double time_start;
+        double time_scale;
+    };
+
     const model::Map* map_;
     const model::Loots map_loots_;
     const Players& players_;
+    std::vector<Segment> segments_;
     size_t id_;
 };
 
@@ -67,7 +114,38 @@ std::string GenerateRandomHex(std::mt19937_64& generator) {
 Token PlayerTokens::GenerateToken() {
     auto part1 = GenerateRandomHex(generator1_);
     auto part2 = GenerateRandomHex(generator2_);
-    return Token(part1 + part2);
+    auto token = part1 + part2;
+    if (shard_digit_) {
+        token.front() = *shard_digit_;
+    }
+    return Token(std::move(token));
+}
+
+bool PlayerTokens::IsValid(std::string_view token) {
+    return token.size() == TokenLength && std::all_of(token.begin(), token.end(), [](char c) {
+        return std::isalnum(static_cast<unsigned char>(c));
+    });
+}
+
+void PlayerTokens::SetShard(int shard_id) {
+    if (shard_id < 0 || shard_id >= MaxShards) {
+        throw std::invalid_argument("Shard id should be in range [0, 15]");
+    }
+    shard_digit_ = "0123456789abcdef"[shard_id];
+}
+
+std::optional<int> PlayerTokens::GetShard(const Token& token) {
+    if ((*token).empty()) {
+        return std::nullopt;
+    }
+    const char digit = static_cast<char>(std::tolower(static_cast<unsigned char>((*token).front())));
+    if (digit >= '0' && digit <= '9') {
+        return digit - '0';
+    }
+    if (digit >= 'a' && digit <= 'f') {
+        return digit - 'a' + 10;
+    }
+    return std::nullopt;
 }
 
 void Player::SetMap(const model::Map* map) {
@@ -91,6 +169,7 @@ int App::player_id_ = 0;
 std::tuple<Token, int> App::AddPlayer(const std::string& name, const model::Map* map) {
     const int new_id = player_id_++;
     const Token new_token = generator_.GenerateToken();
+    std::unique_lock lock{players_mutex_};
     players_.emplace(new_token, std::make_unique<Player>(new_id, name));
 
     auto* player_ptr = players_.at(new_token).get();
@@ -100,15 +179,18 @@ std::tuple<Token, int> App::AddPlayer(const std::string& name, const model::Map*
     else {
         player_ptr->SetDogToMap(map);
     }
-    players_on_map_[map->GetId()].push_back(player_ptr);
+    players_on_map_[map].push_back(player_ptr);
+    players_by_id_[new_id] = player_ptr;
     return {new_token, new_id};
 }
 
 void App::AddPlayer(Token&& token, PlayerPtr&& player) {
     player_id_ = std::max(player_id_, player->GetId() + 1);
     Player* player_ptr = player.get();
+    std::unique_lock lock{players_mutex_};
     players_.insert({std::move(token), std::move(player)});
-    players_on_map_[player_ptr->GetMap()->GetId()].push_back(player_ptr);
+    players_on_map_[player_ptr->GetMap()].push_back(player_ptr);
+    players_by_id_[player_ptr->GetId()] = player_ptr;
 }
 
 Player* App::GetPlayer(Token token) const {
@@ -118,14 +200,53 @@ Player* App::GetPlayer(Token token) const {
     return nullptr;
 }
 
+Player* App::GetPlayerById(int id) const {
+    if (auto it = players_by_id_.find(id); it != players_by_id_.end()) {
+        return it->second;
+    }
+    return nullptr;
+}
+
+std::optional<PlayerRef> App::FindPlayer(const Token& token) const {
+    std::shared_lock lock{players_mutex_};
+    auto it = players_.find(token);
+    if (it == players_.end()) {
+        return std::nullopt;
+    }
+    // Пока игрок в players_, его экземпляр карты существует
+    const auto* map = it->second->GetMap();
+    return PlayerRef{it->second->GetId(), map->GetInstanceId(), &map->GetRoadGraph()};
+}
+
 const Players& App::GetPlayersOnMap(const model::Map* map) const {
     static const Players empty_players;
-    if (map && players_on_map_.contains(map->GetId())) {
-        return players_on_map_.at(map->GetId());
+    if (auto it = players_on_map_.find(map); it != players_on_map_.end()) {
+        return it->second;
     }
     return empty_players;
 }
 
+const model::Map* App::PlacePlayer(model::Game& game, const model::Map& map) const {
+    const auto cap = map.GetPlayerCap();
+    if (cap == 0) {
+        return &map;
+    }
+
+    const model::Map* best = nullptr;
+    size_t best_load = 0;
+    for (const auto* instance : game.GetInstances(map.GetId())) {
+        const auto load = GetPlayersOnMap(instance).size();
+        if (!best || load < best_load) {
+            best = instance;
+            best_load = load;
+        }
+    }
+    if (best && best_load < cap) {
+        return best;
+    }
+    return game.AddInstance(map);
+}
+
 void App::Move(int64_t time_ms) {
     for (const auto& [_, player] : players_) {
         player->GetDog()->Move(player->GetMap(), time_ms);
@@ -140,6 +261,9 @@ void App::Move(int64_t time_ms) {
             providers.emplace_back(providers.size(), players.front()->GetMap(), players);
             
             auto events = FindGatherEvents(providers.back());
+            for (auto& event : events) {
+                event.time = providers.back().GetPathTime(event.gatherer_id, event.time);
+            }
             std::move(events.begin(), events.end(), std::back_inserter(all_events));
         }
     }
@@ -153,7 +277,7 @@ void App::Move(int64_t time_ms) {
         const auto& item = provider.GetItem(event.item_id);
 
         auto* map_ptr = const_cast<model::Map*>(provider.GetMap());
-        auto* player_ptr = provider.GetPlayers().at(event.gatherer_id);
+        auto* player_ptr = provider.GetPlayer(event.gatherer_id);
 
         const auto& loot_opt = map_ptr->TakeLootAtPosition(item.position);
         if (loot_opt) {
@@ -173,9 +297,11 @@ std::vector<PlayerPtr> App::RemoveRetiredPlayers() {
         });
     }
     
-    std::erase_if(players_, [&retired_players](auto& pair) {
+    std::unique_lock lock{players_mutex_};
+    std::erase_if(players_, [this, &retired_players](auto& pair) {
         auto& [_, player] = pair;
         if (player->GetDog()->IsRetired()) {
+            players_by_id_.erase(player->GetId());
             retired_players.push_back(std::move(player));
             return true;
         }
@@ -183,4 +309,100 @@ std::vector<PlayerPtr> App::RemoveRetiredPlayers() {
     });
 
     return retired_players;
-}
\ No newline at end of file
+}
+
+bool App::EnqueueMove(int player_id, char direction) {
+    return pending_moves_.TryPush(MoveCommand{player_id, direction});
+}
+
+size_t App::ApplyPendingMoves() {
+    size_t applied = 0;
+    MoveCommand command;
+    while (pending_moves_.TryPop(command)) {
+        // Игрок мог уйти на покой, пока команда ждала в очереди
+        auto it = players_by_id_.find(command.player_id);
+        if (it == players_by_id_.end()) {
+            continue;
+        }
+        auto* player = it->second;
+        player->GetDog()->SetNextMove(player->GetMap()->GetDogSpeed(), command.direction);
+        ++applied;
+    }
+    return applied;
+}
+
+void App::ForgetMap(const model::Map* map) {
+    players_on_map_.erase(map);
+    spatial_index_.erase(map);
+}
+
+void App::UpdateSpatialIndex() {
+    for (auto& [_, index] : spatial_index_) {
+        index.players.Clear();
+        index.loots.Clear();
+    }
+
+    for (const auto& [_, players] : players_on_map_) {
+        if (players.empty()) {
+            continue;
+        }
+        const auto* map = players.front()->GetMap();
+        auto& index = spatial_index_[map];
+
+        for (size_t i = 0; i < players.size(); ++i) {
+            index.players.Insert(i, players[i]->GetDog()->GetPosition());
+        }
+        const auto& loots = map->GetLostObjects();
+        for (size_t i = 0; i < loots.size(); ++i) {
+            index.loots.Insert(i, loots[i].position);
+        }
+    }
+}
+
+namespace {
+
+// Объекты из items не дальше radius от center. Пустой или ещё не построенный индекс
+// (сразу после восстановления состояния или если карта пустовала при прошлом тике)
+// заменяется полным перебором
+template <typename Items, typename GetPosition>
+Items FindNear(const Items& items, const spatial::Grid* grid, geom::Point2D center, double radius,
+               GetPosition get_position) {
+    Items result;
+    if (!grid || grid->Size() == 0) {
+        for (const auto& item : items) {
+            const auto position = get_position(item);
+            const double dx = position.x - center.x;
+            const double dy = position.y - center.y;
+            if (dx * dx + dy * dy <= radius * radius) {
+                result.push_back(item);
+            }
+        }
+        return result;
+    }
+
+    for (size_t i : grid->Query(center, radius)) {
+        // Объекты, добавленные после построения индекса, в выборку не попадают
+        if (i < items.size()) {
+            result.push_back(items[i]);
+        }
+    }
+    return result;
+}
+
+}  // namespace
+
+Players App::GetPlayersNear(const model::Map* map, geom::Point2D center, double radius) const {
+    auto it = spatial_index_.find(map);
+    return FindNear(GetPlayersOnMap(map), it != spatial_index_.end() ? &it->second.players : nullptr,
+                    center, radius, [](const Player* player) {
+                        return player->GetDog()->GetPosition();
+                    });
+}
+
+model::Loots App::GetLootsNear(const model::Map* map, geom::Point2D center, double radius) const {
+    auto it = spatial_index_.find(map);
+    return FindNear(map->GetLostObjects(), it != spatial_index_.end() ? &it->second.loots : nullptr,
+                    center, radius, [](const model::Loot& loot) {
+                        return loot.position;
+                    });
+}
@@ -2,11 +2,16 @@
 
 #include "loot_generator.h"
 #include "loot_data.h"
+#include "command_queue.h"
 
 #include "../model/model.h"
+#include "../model/spatial_grid.h"
 
+#include <optional>
 #include <random>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
 #include <unordered_set>
 #include <memory>
 
@@ -25,7 +30,18 @@ class PlayerTokens {
 public:
     Token GenerateToken();
 
+    // Токен - 32 латинские буквы или цифры. Строки другого вида не ищутся среди игроков
+    static constexpr size_t TokenLength = 32;
+    static bool IsValid(std::string_view token);
+
+    // Первая шестнадцатеричная цифра токена - номер процесса-шарда, выдавшего токен.
+    // По ней маршрутизатор находит шард игрока. Без шардирования токен полностью случайный
+    static constexpr int MaxShards = 16;
+    void SetShard(int shard_id);
+    static std::optional<int> GetShard(const Token& token);
+
 private:
+    std::optional<char> shard_digit_;
     std::random_device random_device_;
     std::mt19937_64 generator1_{[this] {
         std::uniform_int_distribution<std::mt19937_64::result_type> dist;
@@ -69,24 +85,78 @@ using Players = std::vector<Player*>;
 using PlayerPtr = std::unique_ptr<Player>;
 using PlayersMap = std::unordered_map<Token, PlayerPtr, TokenHasher>;
 
+// Игрок, найденный по токену вне strand игры. Хранятся только значения: игрок может уйти на покой,
+// а его экземпляр карты - удалиться сразу после поиска. Граф дорог общий у экземпляров
+// и основной карты, поэтому переживает экземпляр
+struct PlayerRef {
+    int id = 0;
+    model::Map::InstanceId map = 0;
+    const model::RoadGraph* roads = nullptr;
+};
+
+// Команда движения, ожидающая применения в strand игры
+struct MoveCommand {
+    int player_id = 0;
+    char direction = 0;
+};
+
 class App {
 public:
     App(bool randomize_spawn = false) 
     : randomize_spawn_(randomize_spawn)
     {}
 
+    // Номер шарда, который записывается в выдаваемые токены
+    void SetShard(int shard_id) {generator_.SetShard(shard_id);}
+
     std::tuple<Token, int> AddPlayer(const std::string& name, const model::Map* map);
     void AddPlayer(Token&& token, PlayerPtr&& player);
+    // GetPlayer и GetPlayerById вызываются только из strand игры
     Player* GetPlayer(Token token) const;
+    Player* GetPlayerById(int id) const;
+    // Поиск по токену из любого потока
+    std::optional<PlayerRef> FindPlayer(const Token& token) const;
     const PlayersMap& GetPlayers() const {return players_;}
     const Players& GetPlayersOnMap(const model::Map* map) const;
+    // Экземпляр карты для нового игрока с учётом её лимита игроков: наименее загруженный
+    // или новый, если все заполнены. Вызывается только из strand игры
+    const model::Map* PlacePlayer(model::Game& game, const model::Map& map) const;
     void Move(int64_t time_ms);
     std::vector<PlayerPtr> RemoveRetiredPlayers();
+    // Забывает удаляемый экземпляр карты. На нём не должно остаться игроков
+    void ForgetMap(const model::Map* map);
+
+    // Кладёт команду в очередь без блокировок, можно вызывать из любого потока.
+    // Возвращает false, если очередь заполнена
+    bool EnqueueMove(int player_id, char direction);
+    // Применяет накопившиеся команды. Вызывается только из strand игры
+    size_t ApplyPendingMoves();
+
+    // Перестраивает пространственный индекс карт. Вызывается в конце тика,
+    // после того как игроки и предметы на картах перестали меняться
+    void UpdateSpatialIndex();
+    Players GetPlayersNear(const model::Map* map, geom::Point2D center, double radius) const;
+    model::Loots GetLootsNear(const model::Map* map, geom::Point2D center, double radius) const;
 
 private:
+    struct SpatialIndex {
+        spatial::Grid players;
+        spatial::Grid loots;
+    };
+
+    // Сколько нажатий может накопиться между двумя тиками
+    static constexpr size_t MoveQueueCapacity = 1 << 16;
+
     static int player_id_;
     PlayerTokens generator_;
     PlayersMap players_;
-    std::unordered_map<MapId, Players, MapIdHasher> players_on_map_;
+    // strand игры меняет players_ под исключительной блокировкой, а FindPlayer читает под разделяемой.
+    // Чтения в самом strand блокировки не берут
+    mutable std::shared_mutex players_mutex_;
+    std::unordered_map<int, Player*> players_by_id_;
+    app::MpscQueue<MoveCommand> pending_moves_{MoveQueueCapacity};
+    // Экземпляры одной карты различаются только адресом
+    std::unordered_map<const model::Map*, Players> players_on_map_;
+    std::unordered_map<const model::Map*, SpatialIndex> spatial_index_;
     bool randomize_spawn_ = false;
 };
@@ -1,5 +1,6 @@
 #include "model.h"
 
+#include <algorithm>
 #include <stdexcept>
 #include <cmath>
 #include <iostream>
@@ -26,32 +27,40 @@ int GetRandomType(int count) {
 }
 
 void Map::AddOffice(Office office) {
-    if (warehouse_id_to_index_.contains(office.GetId())) {
+    auto& layout = MutableLayout();
+    if (layout.warehouse_id_to_index.contains(office.GetId())) {
         throw std::invalid_argument("Duplicate warehouse");
     }
 
-    const size_t index = offices_.size();
-    Office& o = offices_.emplace_back(std::move(office));
+    const size_t index = layout.offices.size();
+    Office& o = layout.offices.emplace_back(std::move(office));
     try {
-        warehouse_id_to_index_.emplace(o.GetId(), index);
+        layout.warehouse_id_to_index.emplace(o.GetId(), index);
     } catch (const std::exception& ex) {
         // Удаляем офис из вектора, если не удалось вставить в unordered_map
-        offices_.pop_back();
+        layout.offices.pop_back();
         throw;
     }
 }
 
+Map Map::MakeInstance() const {
+    Map instance{*this};
+    instance.loots_.clear();
+    return instance;
+}
+
 Point2D Map::GetRandomPoint() const {
     std::random_device random_device;
     std::mt19937_64 generator(random_device());
 
-    if (roads_.empty()) {
+    const auto& roads = GetRoads();
+    if (roads.empty()) {
         throw std::runtime_error("No roads available on the map.");
     }
 
     // Выбираем случайную дорогу
-    std::uniform_int_distribution<size_t> road_distribution(0, roads_.size() - 1);
-    const model::Road& selected_road = roads_[road_distribution(generator)];
+    std::uniform_int_distribution<size_t> road_distribution(0, roads.size() - 1);
+    const model::Road& selected_road = roads[road_distribution(generator)];
 
     // Генерируем случайную позицию на выбранной дороге
     Point2D position;
@@ -71,11 +80,11 @@ Point2D Map::GetRandomPoint() const {
 }
 
 Point2D Map::GetInitialPoint() const {
-    if (roads_.empty()) {
+    if (GetRoads().empty()) {
         throw std::runtime_error("No roads available on the map.");
     }
 
-    const model::Road& road = roads_.front();
+    const model::Road& road = GetRoads().front();
     return {static_cast<double>(road.GetStart().x), static_cast<double>(road.GetStart().y)};
 }
 
@@ -105,13 +114,14 @@ std::optional<Loot> Map::TakeLootAtPosition(const geom::Point2D& position) {
 
 bool Map::IsOfficeAtPosition(const geom::Point2D& position) const {
     // Ищем офис в заданной позиции
-    auto it = std::find_if(offices_.begin(), offices_.end(), [&position](const Office& office) {
+    const auto& offices = GetOffices();
+    auto it = std::find_if(offices.begin(), offices.end(), [&position](const Office& office) {
         return office.GetPosition().x == static_cast<int>(position.x)
             && office.GetPosition().y == static_cast<int>(position.y);
     });
 
     // Если офис найден, возвращаем true, иначе false
-    return it != offices_.end();
+    return it != offices.end();
 }
 
 
@@ -122,6 +132,7 @@ void Game::AddMap(Map map) {
         throw std::invalid_argument("Map with id "s + *map.GetId() + " already exists"s);
     } else {
         try {
+            map.instance_id_ = ++next_instance_id_;
             maps_.emplace_back(std::move(map));
         } catch (const std::exception& ex) {
             map_id_to_index_.erase(it);
@@ -130,12 +141,51 @@ void Game::AddMap(Map map) {
     }
 }
 
+Map* Game::AddInstance(const Map& map) {
+    auto& instance = instances_.emplace_back(map.MakeInstance());
+    instance.instance_id_ = ++next_instance_id_;
+    return &instance;
+}
+
+void Game::RemoveInstance(const Map* instance) {
+    instances_.remove_if([instance](const Map& map) {
+        return &map == instance;
+    });
+}
+
+std::vector<const Map*> Game::GetInstances(const Map::Id& id) const {
+    std::vector<const Map*> result;
+    if (const auto* primary = FindMap(id)) {
+        result.push_back(primary);
+    }
+    for (const auto& map : instances_) {
+        if (map.GetId() == id) {
+            result.push_back(&map);
+        }
+    }
+    return result;
+}
+
+const Map* Game::FindInstance(Map::InstanceId id) const noexcept {
+    auto has_id = [id](const Map& map) {
+        return map.GetInstanceId() == id;
+    };
+    if (auto it = std::find_if(maps_.begin(), maps_.end(), has_id); it != maps_.end()) {
+        return &*it;
+    }
+    if (auto it = std::find_if(instances_.begin(), instances_.end(), has_id); it != instances_.end()) {
+        return &*it;
+    }
+    return nullptr;
+}
+
 Dog::Dog()
     : position_(0.0, 0.0), speed_(0.0, 0.0), direction_('U') {}
 
 void Dog::SetStartPosition(const Point2D& position) {
     SetPosition(position);
     last_position_ = position;
+    turns_.clear();
 }
 
 void Dog::SetPosition(const Point2D& position) {
@@ -153,12 +203,19 @@ void Dog::SetDirection(char direction) {
 void Dog::SetNextMove(double speed, char direction) {
     SetSpeed(speed);
     SetDirection(direction);
+    target_.reset();
     pause_time_ = 0;
 }
 
 void Dog::SetNextMove(const geom::Vector2D& speed, char direction) {
     speed_ = speed;
     SetDirection(direction);
+    target_.reset();
+    pause_time_ = 0;
+}
+
+void Dog::SetTarget(const geom::Point2D& target) {
+    target_ = target;
     pause_time_ = 0;
 }
 
@@ -175,20 +232,80 @@ void Dog::ReturnLoot() {
     bag_.clear();
 }
 
+void Dog::AddPauseTime(const Map* map, int64_t time_ms) {
+    const auto retirement_time = map->GetDogRetirementTime() * 1000;
+    pause_time_ += time_ms;
+    if (pause_time_ >= retirement_time) {
+        full_time_ -= pause_time_ - retirement_time;
+        retired_ = true;
+    }
+}
+
+void Dog::Navigate(const Map* map, int64_t time_ms) {
+    last_position_ = position_;
+    const double speed = map->GetDogSpeed();
+    double distance_left = speed * time_ms / 1000;
+
+    // Маршрут на перекрёстке меняет направление, поэтому за один тик проходим несколько отрезков.
+    // Путь строится сразу на весь тик: точки привязываются к дорогам один раз
+    const auto path = map->GetRoadGraph().Waypoints(position_, *target_, distance_left);
+    bool arrived = false;
+    if (path) {
+        for (const auto& waypoint : path->waypoints) {
+            if (distance_left <= delta) {
+                break;
+            }
+            const double dx = waypoint.x - position_.x;
+            const double dy = waypoint.y - position_.y;
+            const double distance = std::fabs(dx) + std::fabs(dy);
+            if (distance < delta) {
+                continue;
+            }
+
+            // Каждый поворот - отдельный отрезок для поиска столкновений
+            if (position_ != last_position_) {
+                turns_.push_back(position_);
+            }
+            if (std::fabs(dx) > std::fabs(dy)) {
+                SetDirection(dx < 0 ? 'L' : 'R');
+            } else {
+                SetDirection(dy < 0 ? 'U' : 'D');
+            }
+            const double step = std::min(distance, distance_left);
+            SetPosition(position_ + speed_multiplier() * step);
+            distance_left -= step;
+        }
+        arrived = path->complete && distance_left > delta;
+    }
+
+    // Путь оборвался раньше цели: остаток маршрута достраивается на следующем тике
+    if (path && !arrived) {
+        speed_ = speed_multiplier() * speed;
+        return;
+    }
+
+    // Цель достигнута или недостижима: останавливаемся, остаток тика - простой
+    target_.reset();
+    speed_ = {0.0, 0.0};
+    const auto time_left = speed > 0 ? static_cast<int64_t>(distance_left / speed * 1000) : time_ms;
+    AddPauseTime(map, time_left);
+}
+
 void Dog::Move(const Map* map, int64_t time_ms) {
+    turns_.clear();
     if (retired_) {
         return;
     }
 
-    auto update_pause_time = [this, retirement_time = map->GetDogRetirementTime()*1000](int64_t time_ms) {
-        pause_time_ += time_ms;
-        if (pause_time_ >= retirement_time) {
-            full_time_ -= pause_time_ - retirement_time;
-            retired_ = true;
-        }
+    auto update_pause_time = [this, map](int64_t time_ms) {
+        AddPauseTime(map, time_ms);
     };
 
     full_time_ += time_ms;
+    if (target_) {
+        return Navigate(map, time_ms);
+    }
+
     if (std::fabs(speed_.x) < delta && std::fabs(speed_.y) < delta) {//если скорость сразу нулевая
         update_pause_time(time_ms);
         return;
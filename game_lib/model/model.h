@@ -1,4 +1,7 @@
 #pragma once
+#include <cstdint>
+#include <list>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -6,6 +9,7 @@
 
 #include "geom.h"
 #include "tagged.h"
+#include "road_graph.h"
 #include "collision_detector.h"
 
 namespace model {
@@ -147,6 +151,8 @@ private:
 class Map {
 public:
     using Id = util::Tagged<std::string, Map>;
+    // Номер экземпляра карты. Game выдаёт его при добавлении и не использует повторно
+    using InstanceId = uint64_t;
     using Roads = std::vector<Road>;
     using Buildings = std::vector<Building>;
     using Offices = std::vector<Office>;
@@ -157,17 +163,24 @@ public:
     }
 
     const Id& GetId() const noexcept {return id_;}
+    InstanceId GetInstanceId() const noexcept {return instance_id_;}
     const std::string& GetName() const noexcept {return name_;}
-    const Buildings& GetBuildings() const noexcept {return buildings_;}
-    const Roads& GetRoads() const noexcept {return roads_;}
-    const Offices& GetOffices() const noexcept {return offices_;}
+    const Buildings& GetBuildings() const noexcept {return layout_->buildings;}
+    const Roads& GetRoads() const noexcept {return layout_->roads;}
+    const Offices& GetOffices() const noexcept {return layout_->offices;}
 
     void AddRoad(const Road& road) {
-        roads_.emplace_back(road);
+        MutableLayout().roads.emplace_back(road);
     }
 
+    // Строит граф дорог для навигации. Вызывается после добавления всех дорог
+    void BuildRoadGraph() {
+        MutableLayout().road_graph = RoadGraph{layout_->roads};
+    }
+    const RoadGraph& GetRoadGraph() const noexcept {return layout_->road_graph;}
+
     void AddBuilding(const Building& building) {
-        buildings_.emplace_back(building);
+        MutableLayout().buildings.emplace_back(building);
     }
 
     void AddOffice(Office office);
@@ -181,6 +194,13 @@ public:
     void SetDogRetirementTime(int time_s) {dog_retirement_time_s = time_s;}
     double GetDogRetirementTime() const noexcept {return dog_retirement_time_s;}
 
+    // Сколько игроков помещается в один экземпляр карты. 0 - без ограничений
+    void SetPlayerCap(size_t cap) {player_cap_ = cap;}
+    size_t GetPlayerCap() const noexcept {return player_cap_;}
+
+    // Новый экземпляр карты: те же дороги, здания и офисы (без копирования), но без предметов
+    Map MakeInstance() const;
+
     geom::Point2D GetRandomPoint() const;
     geom::Point2D GetInitialPoint() const;
 
@@ -194,17 +214,34 @@ public:
 private:
     using OfficeIdToIndex = std::unordered_map<Office::Id, size_t, util::TaggedHasher<Office::Id>>;
 
+    // Неизменная после загрузки часть карты, общая для всех её экземпляров
+    struct Layout {
+        Roads roads;
+        RoadGraph road_graph;
+        Buildings buildings;
+        OfficeIdToIndex warehouse_id_to_index;
+        Offices offices;
+    };
+
+    // Копирует общую часть, если её уже разделяет другой экземпляр
+    Layout& MutableLayout() {
+        if (layout_.use_count() > 1) {
+            layout_ = std::make_shared<Layout>(*layout_);
+        }
+        return *layout_;
+    }
+
+    friend class Game;
+
     Id id_;
+    InstanceId instance_id_ = 0;
     std::string name_;
     double dog_speed_ = 1.0;
     int bag_capacity_ = 3;
     double dog_retirement_time_s = 60.0;
+    size_t player_cap_ = 0;
 
-    Roads roads_;
-    Buildings buildings_;
-
-    OfficeIdToIndex warehouse_id_to_index_;
-    Offices offices_;
+    std::shared_ptr<Layout> layout_ = std::make_shared<Layout>();
 
     Loots loots_;
 };
@@ -215,6 +252,7 @@ public:
 
     void AddMap(Map map);
 
+    // Основные экземпляры карт, по одному на каждую карту из конфигурации
     Maps& GetMaps() noexcept {
         return maps_;
     }
@@ -230,12 +268,36 @@ public:
         return nullptr;
     }
 
+    // Дополнительные экземпляры карт создаются и удаляются во время игры.
+    // Адреса экземпляров не меняются, пока те существуют
+    Map* AddInstance(const Map& map);
+    void RemoveInstance(const Map* instance);
+    bool IsPrimary(const Map* map) const noexcept {
+        return FindMap(map->GetId()) == map;
+    }
+    // Все экземпляры карты id, начиная с основного
+    std::vector<const Map*> GetInstances(const Map::Id& id) const;
+    // Экземпляр по номеру или nullptr, если он уже удалён
+    const Map* FindInstance(Map::InstanceId id) const noexcept;
+
+    template <typename Fn>
+    void ForEachInstance(Fn&& fn) {
+        for (auto& map : maps_) {
+            fn(map);
+        }
+        for (auto& map : instances_) {
+            fn(map);
+        }
+    }
+
 private:
     using MapIdHasher = util::TaggedHasher<Map::Id>;
     using MapIdToIndex = std::unordered_map<Map::Id, size_t, MapIdHasher>;
 
     std::vector<Map> maps_;
     MapIdToIndex map_id_to_index_;
+    std::list<Map> instances_;
+    Map::InstanceId next_instance_id_ = 0;
 };
 
 class Dog {
@@ -247,6 +309,8 @@ public:
 
     geom::Point2D GetPosition() const {return position_;}
     geom::Point2D GetLastPosition() const {return last_position_;}
+    // Повороты за последний тик между GetLastPosition и GetPosition, если собака шла по маршруту
+    const std::vector<geom::Point2D>& GetTurns() const {return turns_;}
     geom::Vector2D GetSpeed() const {return speed_;}
     char GetDirection() const {return direction_;}
     Loots GetBag() const {return bag_;}
@@ -265,6 +329,10 @@ public:
 
     void SetNextMove(double speed, char direction);
     void SetNextMove(const geom::Vector2D& speed, char direction);
+    // Собака сама идёт к target по кратчайшему пути и останавливается там.
+    // Любая команда SetNextMove отменяет движение к цели
+    void SetTarget(const geom::Point2D& target);
+    const std::optional<geom::Point2D>& GetTarget() const {return target_;}
     void Move(const Map* map, int64_t time_ms);
 
     void AddScore(int score);
@@ -273,11 +341,15 @@ private:
     geom::Vector2D speed_multiplier() const;
     void SetSpeed(double speed);
     void SetDirection(char direction);
+    void Navigate(const Map* map, int64_t time_ms);
+    void AddPauseTime(const Map* map, int64_t time_ms);
 
     geom::Point2D last_position_;
+    std::vector<geom::Point2D> turns_;
     geom::Point2D position_;
     geom::Vector2D speed_;
     char direction_;
+    std::optional<geom::Point2D> target_;
     Loots bag_;
     int bag_capacity_ = 3;
     int score_ = 0;
@@ -0,0 +1,297 @@
+#include "road_graph.h"
+#include "model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <map>
+#include <queue>
+#include <utility>
+
+namespace model {
+
+namespace {
+
+constexpr double Epsilon = 1e-6;
+// Половина ширины дороги
+constexpr double HalfWidth = 0.4;
+constexpr double Infinity = std::numeric_limits<double>::infinity();
+// Сторона ячейки сетки участков
+constexpr double CellSize = 8.0;
+
+// Все участки графа параллельны осям, поэтому для точек на одной дороге это обычная длина
+double Manhattan(geom::Point2D a, geom::Point2D b) {
+    return std::fabs(a.x - b.x) + std::fabs(a.y - b.y);
+}
+
+bool Contains(const Road& road, Point point) {
+    return road.GetMin().x <= point.x && point.x <= road.GetMax().x
+        && road.GetMin().y <= point.y && point.y <= road.GetMax().y;
+}
+
+std::optional<Point> Intersect(const Road& a, const Road& b) {
+    if (a.IsHorizontal() == b.IsHorizontal()) {
+        return std::nullopt;
+    }
+    const auto& horizontal = a.IsHorizontal() ? a : b;
+    const auto& vertical = a.IsHorizontal() ? b : a;
+    const Point crossing{vertical.GetStart().x, horizontal.GetStart().y};
+    if (Contains(horizontal, crossing) && Contains(vertical, crossing)) {
+        return crossing;
+    }
+    return std::nullopt;
+}
+
+}  // namespace
+
+RoadGraph::RoadGraph(const std::vector<Road>& roads) {
+    std::map<std::pair<Coord, Coord>, int> node_ids;
+    auto node_id = [this, &node_ids](Point point) {
+        auto [it, inserted] = node_ids.emplace(std::pair{point.x, point.y}, static_cast<int>(nodes_.size()));
+        if (inserted) {
+            AddNode({static_cast<double>(point.x), static_cast<double>(point.y)});
+        }
+        return it->second;
+    };
+
+    for (const auto& road : roads) {
+        // Вершины на дороге: её концы, перекрёстки и концы других дорог, лежащие на ней
+        std::vector<Point> points{road.GetStart(), road.GetEnd()};
+        for (const auto& other : roads) {
+            if (auto crossing = Intersect(road, other)) {
+                points.push_back(*crossing);
+            } else if (&other != &road && other.IsHorizontal() == road.IsHorizontal()) {
+                for (auto end : {other.GetStart(), other.GetEnd()}) {
+                    if (Contains(road, end)) {
+                        points.push_back(end);
+                    }
+                }
+            }
+        }
+
+        std::sort(points.begin(), points.end(), [](Point lhs, Point rhs) {
+            return std::pair{lhs.x, lhs.y} < std::pair{rhs.x, rhs.y};
+        });
+        points.erase(std::unique(points.begin(), points.end(), [](Point lhs, Point rhs) {
+            return lhs.x == rhs.x && lhs.y == rhs.y;
+        }), points.end());
+
+        for (size_t i = 1; i < points.size(); ++i) {
+            edges_.push_back({node_id(points[i - 1]), node_id(points[i])});
+        }
+        if (points.size() == 1) {
+            node_id(points.front());
+        }
+    }
+
+    ComputeRoutes();
+    BuildCells();
+}
+
+int RoadGraph::AddNode(geom::Point2D point) {
+    nodes_.push_back(point);
+    return static_cast<int>(nodes_.size() - 1);
+}
+
+void RoadGraph::ComputeRoutes() {
+    const size_t count = nodes_.size();
+    std::vector<std::vector<std::pair<int, double>>> adjacent(count);
+    for (const auto& edge : edges_) {
+        const double length = Manhattan(nodes_[edge.from], nodes_[edge.to]);
+        adjacent[edge.from].emplace_back(edge.to, length);
+        adjacent[edge.to].emplace_back(edge.from, length);
+    }
+
+    distances_.assign(count * count, Infinity);
+    next_hops_.assign(count * count, NoNode);
+
+    // Дейкстра из каждой вершины. Запоминаем первый шаг пути, а не предыдущую вершину
+    using Item = std::pair<double, int>;
+    for (size_t source = 0; source < count; ++source) {
+        double* distances = &distances_[source * count];
+        int* next_hops = &next_hops_[source * count];
+
+        std::priority_queue<Item, std::vector<Item>, std::greater<>> queue;
+        distances[source] = 0.0;
+        next_hops[source] = static_cast<int>(source);
+        queue.emplace(0.0, static_cast<int>(source));
+
+        while (!queue.empty()) {
+            const auto [distance, node] = queue.top();
+            queue.pop();
+            if (distance > distances[node]) {
+                continue;
+            }
+            for (const auto& [neighbour, length] : adjacent[node]) {
+                if (distance + length < distances[neighbour]) {
+                    distances[neighbour] = distance + length;
+                    next_hops[neighbour] = node == static_cast<int>(source) ? neighbour : next_hops[node];
+                    queue.emplace(distances[neighbour], neighbour);
+                }
+            }
+        }
+    }
+}
+
+void RoadGraph::BuildCells() {
+    if (nodes_.empty()) {
+        return;
+    }
+
+    // Сетка накрывает все дороги вместе с их шириной
+    constexpr double Margin = HalfWidth + Epsilon;
+    geom::Point2D min = nodes_.front();
+    geom::Point2D max = nodes_.front();
+    for (const auto& node : nodes_) {
+        min = {std::min(min.x, node.x), std::min(min.y, node.y)};
+        max = {std::max(max.x, node.x), std::max(max.y, node.y)};
+    }
+    origin_ = {min.x - Margin, min.y - Margin};
+    columns_ = static_cast<size_t>((max.x + Margin - origin_.x) / CellSize) + 1;
+    rows_ = static_cast<size_t>((max.y + Margin - origin_.y) / CellSize) + 1;
+    cells_.assign(columns_ * rows_, {});
+
+    for (size_t i = 0; i < edges_.size(); ++i) {
+        const auto& a = nodes_[edges_[i].from];
+        const auto& b = nodes_[edges_[i].to];
+        const auto first_column = static_cast<size_t>((std::min(a.x, b.x) - Margin - origin_.x) / CellSize);
+        const auto last_column = static_cast<size_t>((std::max(a.x, b.x) + Margin - origin_.x) / CellSize);
+        const auto first_row = static_cast<size_t>((std::min(a.y, b.y) - Margin - origin_.y) / CellSize);
+        const auto last_row = static_cast<size_t>((std::max(a.y, b.y) + Margin - origin_.y) / CellSize);
+        for (size_t row = first_row; row <= last_row; ++row) {
+            for (size_t column = first_column; column <= last_column; ++column) {
+                cells_[row * columns_ + column].push_back(i);
+            }
+        }
+    }
+}
+
+std::optional<RoadGraph::Location> RoadGraph::Locate(geom::Point2D point) const {
+    // Вне сетки дорог нет
+    const double column = std::floor((point.x - origin_.x) / CellSize);
+    const double row = std::floor((point.y - origin_.y) / CellSize);
+    if (cells_.empty() || column < 0 || row < 0
+        || column >= static_cast<double>(columns_) || row >= static_cast<double>(rows_)) {
+        return std::nullopt;
+    }
+
+    std::optional<Location> best;
+    double best_distance = Infinity;
+
+    for (const size_t i : cells_[static_cast<size_t>(row) * columns_ + static_cast<size_t>(column)]) {
+        const auto& a = nodes_[edges_[i].from];
+        const auto& b = nodes_[edges_[i].to];
+        // Участок параллелен оси, поэтому проекция - это покоординатное ограничение
+        const geom::Point2D projection{std::clamp(point.x, std::min(a.x, b.x), std::max(a.x, b.x)),
+                                       std::clamp(point.y, std::min(a.y, b.y), std::max(a.y, b.y))};
+        const double distance = std::max(std::fabs(point.x - projection.x), std::fabs(point.y - projection.y));
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = Location{i, projection};
+        }
+    }
+
+    if (best_distance > HalfWidth + Epsilon) {
+        return std::nullopt;
+    }
+    return best;
+}
+
+std::optional<RoadGraph::Route> RoadGraph::FindRoute(const Location& from, const Location& to) const {
+    if (from.edge == to.edge) {
+        return Route{Manhattan(from.point, to.point), NoNode, NoNode};
+    }
+
+    const size_t count = nodes_.size();
+    const auto& from_edge = edges_[from.edge];
+    const auto& to_edge = edges_[to.edge];
+
+    std::optional<Route> best;
+    for (int entry : {from_edge.from, from_edge.to}) {
+        for (int exit : {to_edge.from, to_edge.to}) {
+            const double between = distances_[entry * count + exit];
+            if (between == Infinity) {
+                continue;
+            }
+            const double distance = Manhattan(from.point, nodes_[entry]) + between + Manhattan(nodes_[exit], to.point);
+            if (!best || distance < best->distance) {
+                best = Route{distance, entry, exit};
+            }
+        }
+    }
+    return best;
+}
+
+std::optional<geom::Point2D> RoadGraph::Snap(geom::Point2D point) const {
+    if (auto location = Locate(point)) {
+        return location->point;
+    }
+    return std::nullopt;
+}
+
+std::optional<double> RoadGraph::Distance(geom::Point2D from, geom::Point2D to) const {
+    const auto from_location = Locate(from);
+    const auto to_location = Locate(to);
+    if (!from_location || !to_location) {
+        return std::nullopt;
+    }
+
+    const auto route = FindRoute(*from_location, *to_location);
+    if (!route) {
+        return std::nullopt;
+    }
+    return Manhattan(from, from_location->point) + route->distance;
+}
+
+std::optional<RoadGraph::Path> RoadGraph::Waypoints(geom::Point2D from, geom::Point2D to, double max_distance) const {
+    const auto from_location = Locate(from);
+    const auto to_location = Locate(to);
+    if (!from_location || !to_location) {
+        return std::nullopt;
+    }
+
+    Path path;
+    geom::Point2D current = from;
+    double distance = 0.0;
+    // Добавляет точку пути. false - путь на этом обрывается
+    auto add = [&](geom::Point2D point) {
+        distance += Manhattan(current, point);
+        current = point;
+        path.waypoints.push_back(point);
+        return distance < max_distance && path.waypoints.size() < MaxWaypoints;
+    };
+
+    // Сначала выходим на осевую линию дороги, каждый раз вдоль одной оси
+    if (std::fabs(current.x - from_location->point.x) > Epsilon
+        && !add({from_location->point.x, current.y})) {
+        return path;
+    }
+    if (std::fabs(current.y - from_location->point.y) > Epsilon
+        && !add({current.x, from_location->point.y})) {
+        return path;
+    }
+
+    const auto route = FindRoute(*from_location, *to_location);
+    if (!route) {
+        return std::nullopt;
+    }
+
+    // Дальше через вершины маршрута: первый шаг из каждой вершины уже известен
+    if (route->entry != NoNode) {
+        if (Manhattan(current, nodes_[route->entry]) > Epsilon && !add(nodes_[route->entry])) {
+            return path;
+        }
+        for (int node = route->entry; node != route->exit;) {
+            node = next_hops_[node * nodes_.size() + route->exit];
+            if (!add(nodes_[node])) {
+                return path;
+            }
+        }
+    }
+    add(to_location->point);
+    path.complete = true;
+    return path;
+}
+
+}  // namespace model
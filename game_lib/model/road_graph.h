@@ -0,0 +1,84 @@
+#pragma once
+
+#include "geom.h"
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+namespace model {
+
+class Road;
+
+/*
+ *  Граф дорог карты: вершины - концы дорог и перекрёстки, рёбра - участки дорог между ними.
+ *  Кратчайшие расстояния и следующий шаг маршрута между всеми парами вершин
+ *  считаются один раз при построении, поэтому запрос маршрута не требует поиска пути.
+ *  Точки вне вершин (собаки, предметы) привязываются к ближайшему участку дороги
+ *  с учётом её ширины. Участки разложены по ячейкам сетки, поэтому привязка
+ *  проверяет только участки рядом с точкой.
+ */
+class RoadGraph {
+public:
+    RoadGraph() = default;
+    explicit RoadGraph(const std::vector<Road>& roads);
+
+    // Ближайшая точка на осевой линии дорог, если point находится на дороге
+    std::optional<geom::Point2D> Snap(geom::Point2D point) const;
+    // Длина кратчайшего пути по дорогам
+    std::optional<double> Distance(geom::Point2D from, geom::Point2D to) const;
+
+    // Начало кратчайшего пути из from в to: точки, к которым нужно двигаться по прямой одна за другой.
+    // Путь обрывается, как только его длина достигнет max_distance или в нём станет MaxWaypoints точек.
+    // complete - путь доведён до to
+    static constexpr size_t MaxWaypoints = 64;
+    struct Path {
+        std::vector<geom::Point2D> waypoints;
+        bool complete = false;
+    };
+    std::optional<Path> Waypoints(geom::Point2D from, geom::Point2D to, double max_distance) const;
+
+    size_t GetNodeCount() const noexcept {return nodes_.size();}
+
+private:
+    static constexpr int NoNode = -1;
+
+    struct Edge {
+        int from;
+        int to;
+    };
+
+    // Положение точки на графе: участок дороги и проекция точки на него
+    struct Location {
+        size_t edge;
+        geom::Point2D point;
+    };
+
+    // Маршрут проходит через вершины entry ... exit, либо напрямую, если entry == NoNode
+    struct Route {
+        double distance;
+        int entry;
+        int exit;
+    };
+
+    std::optional<Location> Locate(geom::Point2D point) const;
+    std::optional<Route> FindRoute(const Location& from, const Location& to) const;
+
+    int AddNode(geom::Point2D point);
+    void ComputeRoutes();
+    void BuildCells();
+
+    std::vector<geom::Point2D> nodes_;
+    std::vector<Edge> edges_;
+    // Матрицы nodes_.size() x nodes_.size()
+    std::vector<double> distances_;
+    std::vector<int> next_hops_;
+
+    // Участки, до которых из ячейки не дальше половины ширины дороги, по возрастанию номера
+    geom::Point2D origin_;
+    size_t columns_ = 0;
+    size_t rows_ = 0;
+    std::vector<std::vector<size_t>> cells_;
+};
+
+}  // namespace model
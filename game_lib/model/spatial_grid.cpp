@@ -0,0 +1,75 @@
+#include "spatial_grid.h"
+
+#include <cmath>
+
+namespace spatial {
+
+void Grid::Clear() {
+    // Занятые ячейки оставляем, чтобы не выделять память заново при следующем заполнении.
+    // Ячейки, пустовавшие с прошлой очистки, удаляем: иначе сетка хранила бы все ячейки,
+    // где кто-то когда-либо был, а Query просматривал бы их при большом радиусе
+    for (auto it = cells_.begin(); it != cells_.end();) {
+        if (it->second.empty()) {
+            it = cells_.erase(it);
+        } else {
+            it->second.clear();
+            ++it;
+        }
+    }
+    size_ = 0;
+}
+
+void Grid::Insert(size_t index, geom::Point2D position) {
+    cells_[MakeKey(ToCell(position.x), ToCell(position.y))].push_back({index, position});
+    ++size_;
+}
+
+std::vector<size_t> Grid::Query(geom::Point2D center, double radius) const {
+    std::vector<size_t> result;
+    const double sq_radius = radius * radius;
+
+    auto collect = [&](const Cell& cell) {
+        for (const auto& entry : cell) {
+            const double dx = entry.position.x - center.x;
+            const double dy = entry.position.y - center.y;
+            if (dx * dx + dy * dy <= sq_radius) {
+                result.push_back(entry.index);
+            }
+        }
+    };
+
+    // Размер области считается в double: при огромном радиусе номер ячейки не поместился бы в int64_t
+    const double min_x = std::floor((center.x - radius) / cell_size_);
+    const double max_x = std::floor((center.x + radius) / cell_size_);
+    const double min_y = std::floor((center.y - radius) / cell_size_);
+    const double max_y = std::floor((center.y + radius) / cell_size_);
+
+    // Если область поиска больше занятой части сетки, дешевле просмотреть все ячейки
+    const double window_cells = (max_x - min_x + 1) * (max_y - min_y + 1);
+    if (!(window_cells < static_cast<double>(cells_.size()))) {
+        for (const auto& [_, cell] : cells_) {
+            collect(cell);
+        }
+        return result;
+    }
+
+    // Область меньше числа занятых ячеек, поэтому её границы помещаются в int64_t
+    for (auto x = static_cast<int64_t>(min_x); x <= static_cast<int64_t>(max_x); ++x) {
+        for (auto y = static_cast<int64_t>(min_y); y <= static_cast<int64_t>(max_y); ++y) {
+            if (auto it = cells_.find(MakeKey(x, y)); it != cells_.end()) {
+                collect(it->second);
+            }
+        }
+    }
+    return result;
+}
+
+int64_t Grid::ToCell(double coord) const {
+    return static_cast<int64_t>(std::floor(coord / cell_size_));
+}
+
+uint64_t Grid::MakeKey(int64_t x, int64_t y) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+}
+
+}  // namespace spatial
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "geom.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace spatial {
+
+/*
+ *  Равномерная сетка для поиска объектов вблизи точки.
+ *  Хранит индексы объектов во внешнем контейнере вместе с их координатами,
+ *  поэтому её нужно перестраивать при каждом изменении этого контейнера.
+ *  Поиск просматривает только ячейки, пересекающие квадрат вокруг точки,
+ *  то есть его стоимость зависит от числа объектов рядом, а не на всей карте.
+ */
+class Grid {
+public:
+    static constexpr double DefaultCellSize = 10.0;
+
+    explicit Grid(double cell_size = DefaultCellSize)
+        : cell_size_{cell_size} {
+    }
+
+    void Clear();
+    void Insert(size_t index, geom::Point2D position);
+
+    // Индексы объектов, находящихся не дальше radius от center
+    std::vector<size_t> Query(geom::Point2D center, double radius) const;
+
+    size_t Size() const {
+        return size_;
+    }
+
+    // Число хранимых ячеек, включая опустевшие при последней очистке
+    size_t CellCount() const {
+        return cells_.size();
+    }
+
+private:
+    struct Entry {
+        size_t index;
+        geom::Point2D position;
+    };
+    using Cell = std::vector<Entry>;
+
+    int64_t ToCell(double coord) const;
+    static uint64_t MakeKey(int64_t x, int64_t y);
+
+    double cell_size_;
+    size_t size_ = 0;
+    std::unordered_map<uint64_t, Cell> cells_;
+};
+
+}  // namespace spatial
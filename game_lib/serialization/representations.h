@@ -1,6 +1,7 @@
 #pragma once
 
 #include <boost/serialization/vector.hpp>
+#include <boost/serialization/version.hpp>
 
 #include "../model/model.h"
 #include "../app/app.h"
@@ -39,8 +40,10 @@ class LootRepresentation {
 public:
     LootRepresentation() = default;
 
-    explicit LootRepresentation(const model::Map& map)
+    // instance - порядковый номер экземпляра среди экземпляров карты, 0 - основной
+    explicit LootRepresentation(const model::Map& map, size_t instance = 0)
         : map_id_(map.GetId())
+        , instance_(instance)
         , lost_objects_(map.GetLostObjects()) {
     }
 
@@ -49,15 +52,21 @@ public:
     }
 
     model::Map::Id GetMapId() const {return map_id_;}
+    size_t GetInstance() const {return instance_;}
 
     template <typename Archive>
-    void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
+    void serialize(Archive& ar, const unsigned version) {
         ar& *map_id_;
+        // В файлах версии 0 сохранялись только основные экземпляры
+        if (version > 0) {
+            ar& instance_;
+        }
         ar& lost_objects_;
     }
 
 private:
     model::Map::Id map_id_ = model::Map::Id{""};
+    size_t instance_ = 0;
     model::Loots lost_objects_;
 };
 
@@ -66,11 +75,12 @@ class PlayerRepresentation {
 public:
     PlayerRepresentation() = default;
 
-    explicit PlayerRepresentation(Token token, const Player& player)
+    explicit PlayerRepresentation(Token token, const Player& player, size_t instance = 0)
         : token_{*token}
         , id_(player.GetId())
         , name_(player.GetName())
         , map_id_(player.GetMap()->GetId())
+        , instance_(instance)
         //dog properties
         , last_position_(player.GetDog()->GetLastPosition())
         , position_(player.GetDog()->GetPosition())
@@ -96,13 +106,17 @@ public:
     }
 
     model::Map::Id GetMapId() const {return map_id_;}
+    size_t GetInstance() const {return instance_;}
 
     template <typename Archive>
-    void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
+    void serialize(Archive& ar, const unsigned version) {
         ar& token_;
         ar& id_;
         ar& name_;
         ar& *map_id_;
+        if (version > 0) {
+            ar& instance_;
+        }
         ar& last_position_;
         ar& position_;
         ar& speed_;
@@ -117,6 +131,7 @@ private:
     int id_;
     std::string name_;
     model::Map::Id map_id_ = model::Map::Id{""};
+    size_t instance_ = 0;
     geom::Point2D last_position_;
     geom::Point2D position_;
     geom::Vector2D speed_;
@@ -128,3 +143,6 @@ private:
 
 
 } // namespace serialization
+
+BOOST_CLASS_VERSION(::serialization::LootRepresentation, 1)
+BOOST_CLASS_VERSION(::serialization::PlayerRepresentation, 1)
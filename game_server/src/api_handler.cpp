@@ -1,13 +1,151 @@
 #include "api_handler.h"
+#include "binary_encoding.h"
 #include "constants.h"
 #include "db/database.h"
 
 #include <boost/json.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+
 namespace json = boost::json;
 
+namespace {
+
+constexpr auto LongPollTimeout = std::chrono::seconds(10);
+constexpr size_t MaxBatchSize = 1000;
+// Прогон занимает strand целиком, поэтому число шагов ограничено
+constexpr int64_t MaxFastForwardSteps = 10'000;
+
+// Раскладывает время тика по этапам. Без timings ничего не измеряет
+class PhaseTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit PhaseTimer(TickTimings* timings)
+        : timings_(timings) {
+        if (timings_) {
+            last_ = Clock::now();
+        }
+    }
+
+    // Относит время с предыдущей отметки к этапу phase
+    void Lap(TickTimings::Duration TickTimings::*phase) {
+        if (!timings_) {
+            return;
+        }
+        const auto now = Clock::now();
+        timings_->*phase += now - last_;
+        last_ = now;
+    }
+
+private:
+    TickTimings* timings_;
+    Clock::time_point last_;
+};
+
+double ToMilliseconds(TickTimings::Duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// Память для разбора и сборки JSON одного запроса. Берётся из буфера потока и освобождается
+// целиком, когда заканчивается самая внешняя из вложенных областей JsonArena.
+// Значения из арены не должны её переживать: наружу отдаётся только сериализованная строка
+class JsonArena {
+public:
+    JsonArena() {
+        ++Depth();
+    }
+
+    JsonArena(const JsonArena&) = delete;
+    JsonArena& operator=(const JsonArena&) = delete;
+
+    ~JsonArena() {
+        if (--Depth() == 0) {
+            Resource().release();
+        }
+    }
+
+    json::storage_ptr Storage() const {
+        return &Resource();
+    }
+
+private:
+    // Размер буфера потока. Что в него не поместилось, берётся из кучи до освобождения арены
+    static constexpr size_t BufferSize = 64 * 1024;
+
+    static json::monotonic_resource& Resource() {
+        thread_local std::array<unsigned char, BufferSize> buffer;
+        thread_local json::monotonic_resource resource{buffer.data(), buffer.size()};
+        return resource;
+    }
+
+    static int& Depth() {
+        thread_local int depth = 0;
+        return depth;
+    }
+};
+
+}  // namespace
+
+json::object GameStateToObject(const Players& players, const model::Loots& loots, json::storage_ptr sp = {});
+std::string GameStateToJson(const Players& players, const model::Loots& loots);
+
+template <typename Handler>
+void ApiHandler::Post(Handler&& handler) const {
+    const auto depth = queue_depth_.fetch_add(1, std::memory_order_relaxed) + 1;
+    auto peak = peak_queue_depth_.load(std::memory_order_relaxed);
+    while (peak < depth && !peak_queue_depth_.compare_exchange_weak(peak, depth, std::memory_order_relaxed)) {
+    }
+    net::post(api_strand_, [this, handler = std::forward<Handler>(handler)]() mutable {
+        queue_depth_.fetch_sub(1, std::memory_order_relaxed);
+        handler();
+    });
+}
+
+template <typename Handler>
+void ApiHandler::PostRequest(Callback callback, Handler&& handler) const {
+    if (callback.IsAbandoned()) {
+        return;
+    }
+    Post([callback = std::move(callback), handler = std::forward<Handler>(handler)]() mutable {
+        // Клиент мог отключиться, пока запрос стоял в очереди
+        if (!callback.IsAbandoned()) {
+            handler(callback);
+        }
+    });
+}
+
+PlayerRef ApiHandler::FindPlayer(const std::string& token_str) const {
+    const auto player = app_.FindPlayer(Token{token_str});
+    if (!player) {
+        throw ApiException("Player token has not been found", "unknownToken", http::status::unauthorized);
+    }
+    return *player;
+}
+
+bool ApiHandler::IsOverloaded() const {
+    if (load_limits_.max_queue_depth > 0 && GetQueueDepth() >= load_limits_.max_queue_depth) {
+        return true;
+    }
+    return ticker_ && load_limits_.max_tick_lag.count() > 0 && ticker_->GetLag() >= load_limits_.max_tick_lag;
+}
+
+LoadStats ApiHandler::TakeLoadStats() const {
+    LoadStats stats;
+    stats.queue_depth = GetQueueDepth();
+    // Пик не меньше текущей очереди, даже если с прошлого раза в неё ничего не добавлялось
+    stats.peak_queue_depth = std::max(peak_queue_depth_.exchange(0, std::memory_order_relaxed), stats.queue_depth);
+    stats.shed = shed_requests_.exchange(0, std::memory_order_relaxed);
+    if (ticker_) {
+        stats.tick_lag = ticker_->GetLag();
+    }
+    return stats;
+}
+
 void ApiHandler::GetMaps(const Callback& callback) const {
-    auto maps = game_.GetMaps();
+    const auto& maps = game_.GetMaps();
     json::array json_maps;
 
     for (const auto& map : maps) {
@@ -92,7 +230,8 @@ void ApiHandler::GetMapById(const std::string& id, const Callback& callback) con
 }
 
 void ApiHandler::JoinGame(const std::string& body, const Callback& callback) {
-    auto obj = json::parse(body).as_object();
+    JsonArena arena;
+    auto obj = json::parse(body, arena.Storage()).as_object();
 
     if (!obj.contains("userName") || !obj["userName"].is_string()) {
         throw ApiException("Invalid name", "invalidArgument", http::status::bad_request);
@@ -114,111 +253,405 @@ void ApiHandler::JoinGame(const std::string& body, const Callback& callback) {
         throw ApiException("Map not found", "mapNotFound", http::status::not_found);
     }
 
-    net::post(api_strand_, [this, userName, map_opt, callback]() {
+    PostRequest(callback, [this, userName, map_opt](const Callback& callback) {
         // Генерируем playerId и authToken
-        const auto& [token, id] = app_.AddPlayer(userName, map_opt);
+        const auto* instance = PlacePlayer(*map_opt);
+        const auto& [token, id] = app_.AddPlayer(userName, instance);
+        publisher_.UpdateMembers(instance->GetInstanceId());
 
-        json::object result;
+        JsonArena arena;
+        json::object result{arena.Storage()};
         result["authToken"] = *token;
         result["playerId"] = id;
         callback(json::serialize(result));
     });
 }
 
-void ApiHandler::GetPlayers(const std::string& token_str, const Callback& callback) const {
-    Token token(token_str);
-    const auto* player = app_.GetPlayer(token);
-    if (!player) {
-        throw ApiException("Player token has not been found", "unknownToken", http::status::unauthorized);
-    }
+void ApiHandler::GetPlayers(const std::string& token_str, Encoding encoding, Callback callback) const {
+    const auto ref = FindPlayer(token_str);
 
-    net::post(api_strand_, [this, player, callback]() {
-        json::object result;
-        for(const auto* player_on_map : app_.GetPlayersOnMap(player->GetMap())) {
+    PostRequest(std::move(callback), [this, ref, encoding](const Callback& callback) {
+        // Игрок мог уйти на покой, пока запрос ждал strand, тогда список пуст
+        const auto* player = app_.GetPlayerById(ref.id);
+        const auto& players = app_.GetPlayersOnMap(player ? player->GetMap() : nullptr);
+        if (encoding == Encoding::Binary) {
+            return callback(binary::EncodePlayers(players));
+        }
+
+        JsonArena arena;
+        json::object result{arena.Storage()};
+        for(const auto* player_on_map : players) {
             result[std::to_string(player_on_map->GetId())] = { {"name", player_on_map->GetName()} };
         }
         callback(json::serialize(result));
     });
 }
 
-void ApiHandler::GetGameState(const std::string& token_str, const Callback& callback) const {
-    Token token(token_str);
-    const auto* player = app_.GetPlayer(token);
-    if (!player) {
-        throw ApiException("Player token has not been found", "unknownToken", http::status::unauthorized);
-    }
+void ApiHandler::GetGameState(const std::string& token_str, Encoding encoding, std::optional<double> radius,
+                              Callback callback) const {
+    const auto ref = FindPlayer(token_str);
 
-    net::post(api_strand_, [this, player, callback]() {
-        json::object result;
-        for(auto* player_on_map : app_.GetPlayersOnMap(player->GetMap())) {
-            auto* dog = player_on_map->GetDog();
-            
-            json::array pos = {json::value_from(dog->GetPosition().x), json::value_from(dog->GetPosition().y)};
-            json::array speed = {json::value_from(dog->GetSpeed().x), json::value_from(dog->GetSpeed().y)};
-            char dir = dog->GetDirection();
-
-            json::array bag;
-            for (const auto& loot : dog->GetBag()) {
-                json::object loot_obj;
-                loot_obj["id"] = loot.id;
-                loot_obj["type"] = loot.type;
-                bag.push_back(loot_obj);
+    PostRequest(std::move(callback), [this, ref, encoding, radius](const Callback& callback) {
+        auto* player = app_.GetPlayerById(ref.id);
+        if (!player) {
+            if (encoding == Encoding::Binary) {
+                return callback(binary::EncodeGameState({}, {}));
             }
-            
-            json::object player_data;
-            player_data["pos"] = pos;
-            player_data["speed"] = speed;
-            player_data["dir"] = std::string{dir};
-            player_data["bag"] = bag;
-            player_data["score"] = dog->GetScore();
-            
-            result[std::to_string(player_on_map->GetId())] = player_data;
-        }
-
-        json::object result_lost_objects;
-        for(const auto& lost_object : player->GetMap()->GetLostObjects()) {
-            json::array pos = {json::value_from(lost_object.position.x), json::value_from(lost_object.position.y)};
-
-            json::object lost_object_data;
-            lost_object_data["type"] = lost_object.type;
-            lost_object_data["pos"] = pos;
-            
-            result_lost_objects[std::to_string(lost_object.id)] = lost_object_data;
-        }
-
-        json::object response;
-        response["players"] = result;
-        response["lostObjects"] = result_lost_objects;
-        callback(json::serialize(response));
+            return callback(GameStateToJson({}, {}));
+        }
+        // Состояние должно учитывать уже принятые команды игроков
+        app_.ApplyPendingMoves();
+
+        const auto* map = player->GetMap();
+        if (!radius) {
+            if (encoding == Encoding::Binary) {
+                return callback(binary::EncodeGameState(app_.GetPlayersOnMap(map), map->GetLostObjects()));
+            }
+            return callback(SerializeGameState(map));
+        }
+
+        // Только то, что находится рядом с собакой игрока
+        const auto center = player->GetDog()->GetPosition();
+        auto players = app_.GetPlayersNear(map, center, *radius);
+        if (std::find(players.begin(), players.end(), player) == players.end()) {
+            players.push_back(player);
+        }
+        const auto loots = app_.GetLootsNear(map, center, *radius);
+
+        if (encoding == Encoding::Binary) {
+            return callback(binary::EncodeGameState(players, loots));
+        }
+        callback(GameStateToJson(players, loots));
     });
 }
 
-void ApiHandler::PlayerAction(const std::string& token_str, const std::string& body, const Callback& callback) const {
-    Token token(token_str);
-    auto* player = app_.GetPlayer(token);
-    if (!player) {
-        throw ApiException("Player token has not been found", "unknownToken", http::status::unauthorized);
+void ApiHandler::WaitGameState(const std::string& token_str, const Callback& callback) {
+    WaitMapState(FindPlayer(token_str).map, callback);
+}
+
+void ApiHandler::WaitMapState(model::Map::InstanceId instance, const Callback& callback) {
+    // Запрос не занимает strand, пока ждёт: ответ отправит либо ближайший тик, либо таймер
+    auto done = std::make_shared<std::atomic_bool>(false);
+    auto timer = std::make_shared<net::steady_timer>(api_strand_.get_inner_executor(), LongPollTimeout);
+    // Номер известен только после Wait, а таймер должен уже ждать: без тиков иначе некому ответить
+    auto wait_id = std::make_shared<std::atomic<StatePublisher::WaitId>>(0);
+
+    // Экземпляр может быть удалён, пока запрос ждёт, поэтому держим только его номер
+    timer->async_wait([this, instance, done, wait_id, callback](sys::error_code ec) {
+        if (ec || done->exchange(true)) {
+            return;
+        }
+        // Без тиков публикаций не будет, и ожидающий со всем, что он держит, остался бы в списке навсегда
+        publisher_.CancelWait(instance, wait_id->load());
+        // Тиков так и не было - отдаём текущее состояние
+        PostRequest(callback, [this, instance](const Callback& callback) {
+            const auto* map = game_.FindInstance(instance);
+            if (!map) {
+                return callback(GameStateToJson({}, {}));
+            }
+            app_.ApplyPendingMoves();
+            callback(SerializeGameState(map));
+        });
+    });
+
+    const auto id = publisher_.Wait(instance, [done, timer, callback](StateFrame frame) {
+        if (!done->exchange(true)) {
+            timer->cancel();
+            callback(*frame);
+        }
+    });
+    if (id) {
+        wait_id->store(*id);
+    } else if (!done->exchange(true)) {
+        // Экземпляр уже удалён, ждать нечего
+        timer->cancel();
+        callback(GameStateToJson({}, {}));
+    }
+}
+
+std::string ApiHandler::SerializeGameState(const model::Map* map) const {
+    return GameStateToJson(app_.GetPlayersOnMap(map), map->GetLostObjects());
+}
+
+json::object GameStateToObject(const Players& players, const model::Loots& loots, json::storage_ptr sp) {
+    json::object result{sp};
+    for(auto* player_on_map : players) {
+        auto* dog = player_on_map->GetDog();
+        
+        json::array pos({dog->GetPosition().x, dog->GetPosition().y}, sp);
+        json::array speed({dog->GetSpeed().x, dog->GetSpeed().y}, sp);
+        char dir = dog->GetDirection();
+
+        json::array bag{sp};
+        for (const auto& loot : dog->GetBag()) {
+            json::object loot_obj{sp};
+            loot_obj["id"] = loot.id;
+            loot_obj["type"] = loot.type;
+            bag.push_back(std::move(loot_obj));
+        }
+        
+        json::object player_data{sp};
+        player_data["pos"] = std::move(pos);
+        player_data["speed"] = std::move(speed);
+        player_data["dir"] = std::string_view{&dir, 1};
+        player_data["bag"] = std::move(bag);
+        player_data["score"] = dog->GetScore();
+        
+        result[std::to_string(player_on_map->GetId())] = std::move(player_data);
     }
 
-    auto obj = json::parse(body).as_object();
+    json::object result_lost_objects{sp};
+    for(const auto& lost_object : loots) {
+        json::array pos({lost_object.position.x, lost_object.position.y}, sp);
 
-    // Проверяем наличие и тип поля userName
-    if (!obj.contains("move") || !obj["move"].is_string()) {
+        json::object lost_object_data{sp};
+        lost_object_data["type"] = lost_object.type;
+        lost_object_data["pos"] = std::move(pos);
+        
+        result_lost_objects[std::to_string(lost_object.id)] = std::move(lost_object_data);
+    }
+
+    json::object response{sp};
+    response["players"] = std::move(result);
+    response["lostObjects"] = std::move(result_lost_objects);
+    return response;
+}
+
+std::string GameStateToJson(const Players& players, const model::Loots& loots) {
+    JsonArena arena;
+    return json::serialize(GameStateToObject(players, loots, arena.Storage()));
+}
+
+char ParseMove(const json::object& obj) {
+    // Проверяем наличие и тип поля move
+    if (!obj.contains("move") || !obj.at("move").is_string()) {
         throw ApiException("Failed to parse action", "invalidArgument", http::status::bad_request);
     }
 
-    std::string move = obj["move"].as_string().c_str();
+    std::string move = obj.at("move").as_string().c_str();
     char direction = move.empty() ? 0 : move.at(0);
     
     if (direction != 'L' && direction != 'R' && direction != 'D' && direction != 'U' && direction != 0 ) {
         throw ApiException("Failed to parse action", "invalidArgument", http::status::bad_request);
     }
+    return direction;
+}
 
-    net::post(api_strand_, [this, player, direction, callback]() {
-        const auto speed = player->GetMap()->GetDogSpeed();
-        player->GetDog()->SetNextMove(speed, direction);
+char ParseJsonAction(const std::string& body) {
+    JsonArena arena;
+    return ParseMove(json::parse(body, arena.Storage()).as_object());
+}
 
-        json::object result;
+void ApiHandler::PlayerAction(const std::string& token_str, const std::string& body, Encoding encoding, Callback callback) {
+    const auto ref = FindPlayer(token_str);
+
+    char direction = 0;
+    if (encoding == Encoding::Binary) {
+        const auto binary_direction = binary::DecodeAction(body);
+        if (!binary_direction) {
+            throw ApiException("Failed to parse action", "invalidArgument", http::status::bad_request);
+        }
+        direction = *binary_direction;
+    } else {
+        direction = ParseJsonAction(body);
+    }
+
+    auto reply = [encoding](const Callback& callback) {
+        if (encoding == Encoding::Binary) {
+            return callback({});
+        }
+        callback(json::serialize(json::object{}));
+    };
+
+    // Команда применится в начале следующего тика или перед ближайшим чтением состояния,
+    // поэтому отвечаем сразу, не занимая strand
+    if (app_.EnqueueMove(ref.id, direction)) {
+        publisher_.UpdateState(ref.map);
+        return reply(callback);
+    }
+
+    // Очередь переполнена - применяем команду через strand, как обычно
+    PostRequest(std::move(callback), [this, ref, direction, reply](const Callback& callback) {
+        // Команда ушедшего на покой игрока теряется, как и в очереди
+        if (auto* player = app_.GetPlayerById(ref.id)) {
+            player->GetDog()->SetNextMove(player->GetMap()->GetDogSpeed(), direction);
+            publisher_.UpdateState(ref.map);
+        }
+        reply(callback);
+    });
+}
+
+void ApiHandler::NavigatePlayer(const std::string& token_str, const std::string& body, const Callback& callback) {
+    const auto ref = FindPlayer(token_str);
+
+    JsonArena arena;
+    auto obj = json::parse(body, arena.Storage()).as_object();
+    if (!obj.contains("target") || !obj["target"].is_string()) {
+        throw ApiException("Failed to parse navigation target", "invalidArgument", http::status::bad_request);
+    }
+    const std::string kind = obj["target"].as_string().c_str();
+
+    std::optional<geom::Point2D> point;
+    std::optional<int> loot_id;
+    if (kind == "point") {
+        if (!obj.contains("x") || !obj["x"].is_number() || !obj.contains("y") || !obj["y"].is_number()) {
+            throw ApiException("Failed to parse navigation target", "invalidArgument", http::status::bad_request);
+        }
+        // Дороги карты не меняются, поэтому проверяем точку сразу
+        point = ref.roads->Snap({obj["x"].to_number<double>(), obj["y"].to_number<double>()});
+        if (!point) {
+            throw ApiException("Target is off the road", "invalidArgument", http::status::bad_request);
+        }
+    } else if (kind == "loot") {
+        if (!obj.contains("id") || !obj["id"].is_int64()) {
+            throw ApiException("Failed to parse navigation target", "invalidArgument", http::status::bad_request);
+        }
+        loot_id = static_cast<int>(obj["id"].as_int64());
+    } else if (kind != "office") {
+        throw ApiException("Failed to parse navigation target", "invalidArgument", http::status::bad_request);
+    }
+
+    PostRequest(callback, [this, ref, point, loot_id](const Callback& callback) mutable {
+        auto* player = app_.GetPlayerById(ref.id);
+        if (!player) {
+            return callback(json::serialize(json::object{{"target", nullptr}}));
+        }
+        // Ручные команды, пришедшие раньше, не должны отменить навигацию
+        app_.ApplyPendingMoves();
+
+        const auto* map = player->GetMap();
+        const auto& graph = map->GetRoadGraph();
+        auto* dog = player->GetDog();
+
+        if (loot_id) {
+            const auto& loots = map->GetLostObjects();
+            auto it = std::find_if(loots.begin(), loots.end(), [id = *loot_id](const model::Loot& loot) {
+                return loot.id == id;
+            });
+            if (it != loots.end()) {
+                point = it->position;
+            }
+        } else if (!point) {
+            // Ближайший по дорогам офис
+            std::optional<double> best_distance;
+            for (const auto& office : map->GetOffices()) {
+                const geom::Point2D position{static_cast<double>(office.GetPosition().x),
+                                             static_cast<double>(office.GetPosition().y)};
+                const auto distance = graph.Distance(dog->GetPosition(), position);
+                if (distance && (!best_distance || *distance < *best_distance)) {
+                    best_distance = distance;
+                    point = position;
+                }
+            }
+        }
+
+        if (point) {
+            point = graph.Snap(*point);
+        }
+        JsonArena arena;
+        json::object result{arena.Storage()};
+        if (point && graph.Distance(dog->GetPosition(), *point)) {
+            dog->SetTarget(*point);
+            publisher_.UpdateState(map->GetInstanceId());
+            result["target"] = json::array{point->x, point->y};
+        } else {
+            result["target"] = nullptr;
+        }
+        callback(json::serialize(result));
+    });
+}
+
+void ApiHandler::PlayerBatch(const std::string& body, const Callback& callback) {
+    JsonArena arena;
+    auto obj = json::parse(body, arena.Storage()).as_object();
+
+    if (!obj.contains("actions") || !obj["actions"].is_array()) {
+        throw ApiException("Failed to parse batch request JSON", "invalidArgument", http::status::bad_request);
+    }
+    const auto& actions = obj["actions"].as_array();
+    if (actions.size() > MaxBatchSize) {
+        throw ApiException("Too many actions in batch", "invalidArgument", http::status::bad_request);
+    }
+
+    bool with_state = false;
+    if (obj.contains("state")) {
+        if (!obj["state"].is_bool()) {
+            throw ApiException("Failed to parse batch request JSON", "invalidArgument", http::status::bad_request);
+        }
+        with_state = obj["state"].as_bool();
+    }
+
+    // Разбираем команды до входа в strand. Ошибка в одной команде не отменяет остальные
+    struct BatchCommand {
+        Token token{std::string{}};
+        char direction = 0;
+        std::optional<ApiException> error;
+    };
+    std::vector<BatchCommand> commands(actions.size());
+    for (size_t i = 0; i < actions.size(); ++i) {
+        auto& command = commands[i];
+        try {
+            if (!actions.at(i).is_object()) {
+                throw ApiException("Failed to parse action", "invalidArgument", http::status::bad_request);
+            }
+            const auto& action = actions.at(i).as_object();
+            // Токен проверяется так же, как в заголовке Authorization одиночного запроса
+            const auto* token = action.if_contains("token");
+            if (!token || !token->is_string() || !PlayerTokens::IsValid(token->as_string())) {
+                throw ApiException("Invalid token", "invalidToken", http::status::unauthorized);
+            }
+            command.token = Token{std::string{token->as_string()}};
+            command.direction = ParseMove(action);
+        } catch (const ApiException& ex) {
+            command.error = ex;
+        }
+    }
+
+    PostRequest(callback, [this, commands = std::move(commands), with_state](const Callback& callback) {
+        // Сначала то, что пришло раньше по одиночке
+        app_.ApplyPendingMoves();
+
+        JsonArena arena;
+        const auto sp = arena.Storage();
+        json::array results{sp};
+        std::vector<const model::Map*> maps;
+        for (const auto& command : commands) {
+            auto* player = command.error ? nullptr : app_.GetPlayer(command.token);
+            if (!player) {
+                const auto& error = command.error
+                    ? *command.error
+                    : ApiException("Player token has not been found", "unknownToken", http::status::unauthorized);
+                results.emplace_back(json::object({{constants::CODE, error.code}, {constants::MESSAGE, error.what()}}, sp));
+                continue;
+            }
+
+            const auto* map = player->GetMap();
+            player->GetDog()->SetNextMove(map->GetDogSpeed(), command.direction);
+            if (std::find(maps.begin(), maps.end(), map) == maps.end()) {
+                maps.push_back(map);
+            }
+            json::object done{sp};
+            if (with_state) {
+                // Ключ состояния этого игрока в states
+                done["instance"] = std::to_string(map->GetInstanceId());
+            }
+            results.emplace_back(std::move(done));
+        }
+
+        json::object result{sp};
+        result["results"] = std::move(results);
+        if (with_state) {
+            // Состояние каждого экземпляра карты отдаётся один раз, сколько бы ботов в нём ни было.
+            // Экземпляры одной карты различаются номером, а не идентификатором карты
+            json::object states{sp};
+            for (const auto* map : maps) {
+                states[std::to_string(map->GetInstanceId())] = GameStateToObject(app_.GetPlayersOnMap(map), map->GetLostObjects(), sp);
+            }
+            result["states"] = std::move(states);
+        }
+        for (const auto* map : maps) {
+            publisher_.UpdateState(map->GetInstanceId());
+        }
         callback(json::serialize(result));
     });
 }
@@ -228,7 +661,8 @@ void ApiHandler::GameTick(const std::string& body, const Callback& callback) {
         throw ApiException("Invalid endpoint", "badRequest", http::status::bad_request);
     }
 
-    auto obj = json::parse(body).as_object();
+    JsonArena arena;
+    auto obj = json::parse(body, arena.Storage()).as_object();
 
     // Проверяем наличие и тип поля timeDelta
     if (!obj.contains("timeDelta") || !obj["timeDelta"].is_int64()) {
@@ -237,17 +671,116 @@ void ApiHandler::GameTick(const std::string& body, const Callback& callback) {
 
     const auto time_ms = obj["timeDelta"].as_int64();
 
-    net::post(api_strand_, [this, time_ms, callback]() {
-        TickAction(time_ms);
+    if (!obj.contains("steps")) {
+        PostRequest(callback, [this, time_ms](const Callback& callback) {
+            TickAction(time_ms);
+
+            json::object result;
+            callback(json::serialize(result));
+        });
+        return;
+    }
+
+    if (!obj["steps"].is_int64() || obj["steps"].as_int64() <= 0 || obj["steps"].as_int64() > MaxFastForwardSteps) {
+        throw ApiException("Failed to parse tick request JSON", "invalidArgument", http::status::bad_request);
+    }
+    const auto steps = obj["steps"].as_int64();
+
+    PostRequest(callback, [this, time_ms, steps](const Callback& callback) {
+        TickTimings timings;
+        const auto start = PhaseTimer::Clock::now();
+        FastForward(time_ms, steps, timings);
+        const auto total = PhaseTimer::Clock::now() - start;
+
+        json::object phases;
+        phases["commands"] = ToMilliseconds(timings.commands);
+        phases["simulation"] = ToMilliseconds(timings.simulation);
+        phases["persistence"] = ToMilliseconds(timings.persistence);
+        phases["retirement"] = ToMilliseconds(timings.retirement);
+        phases["spatialIndex"] = ToMilliseconds(timings.spatial_index);
+        phases["publication"] = ToMilliseconds(timings.publication);
 
         json::object result;
+        result["steps"] = steps;
+        result["gameTime"] = time_ms * steps;
+        result["wallTime"] = ToMilliseconds(total);
+        result["phases"] = phases;
         callback(json::serialize(result));
     });
 }
 
-void ApiHandler::TickAction(int64_t time_ms) {
+void ApiHandler::TickAction(int64_t time_ms, TickTimings* timings) {
+    PhaseTimer timer{timings};
+
+    // Применяем команды, накопившиеся с прошлого тика, одной пачкой
+    app_.ApplyPendingMoves();
+    timer.Lap(&TickTimings::commands);
+
+    Simulate(time_ms);
+    timer.Lap(&TickTimings::simulation);
+
+    // Сохраняем игровое состояние, если прошло достаточно времени
+    storage_.Write(time_ms);
+    timer.Lap(&TickTimings::persistence);
+
+    if (retire_stage_.Advance(time_ms)) {
+        std::vector<Record> records;
+        RetirePlayers(records);
+        if (!records.empty()) {
+            db_.AddRecords(records);
+        }
+    }
+    timer.Lap(&TickTimings::retirement);
+
+    // Состав игроков и предметов до следующего тика не изменится
+    app_.UpdateSpatialIndex();
+    timer.Lap(&TickTimings::spatial_index);
+
+    if (publish_stage_.Advance(time_ms)) {
+        PublishState();
+    }
+    timer.Lap(&TickTimings::publication);
+}
+
+void ApiHandler::FastForward(int64_t time_ms, int64_t steps, TickTimings& timings) {
+    PhaseTimer timer{&timings};
+
+    // Между шагами в strand никто не обращается, поэтому каждый шаг только двигает игру
+    std::vector<Record> records;
+    for (int64_t i = 0; i < steps; ++i) {
+        app_.ApplyPendingMoves();
+        timer.Lap(&TickTimings::commands);
+
+        Simulate(time_ms);
+        timer.Lap(&TickTimings::simulation);
+
+        if (retire_stage_.Advance(time_ms)) {
+            RetirePlayers(records);
+        }
+        timer.Lap(&TickTimings::retirement);
+    }
+
+    // Остальные этапы выполняются один раз за весь прогон
+    storage_.Write(time_ms * steps);
+    timer.Lap(&TickTimings::persistence);
+
+    if (!records.empty()) {
+        db_.AddRecords(records);
+    }
+    timer.Lap(&TickTimings::retirement);
+
+    app_.UpdateSpatialIndex();
+    timer.Lap(&TickTimings::spatial_index);
+
+    if (publish_stage_.Advance(time_ms * steps)) {
+        PublishState();
+    }
+    timer.Lap(&TickTimings::publication);
+}
+
+void ApiHandler::Simulate(int64_t time_ms) {
     // Генерим новые объкты на карте
-    for (auto& map : game_.GetMaps()) {
+    game_.ForEachInstance([this, time_ms](model::Map& map) {
         const auto loot_count = map.GetLostObjects().size();
         const auto players_count  = app_.GetPlayersOnMap(&map).size();
         const auto num_objects = loot_generator_.Generate(loot::Generator::MakeTimeInterval(time_ms), loot_count, players_count);
@@ -256,17 +789,25 @@ void ApiHandler::TickAction(int64_t time_ms) {
         for (unsigned int i = 0; i < num_objects; ++i) {
             map.AddLostObject(loot_values);
         }
-    }
+    });
 
     // Двигаем игроков
     app_.Move(time_ms);
+    game_.ForEachInstance([this](const model::Map& map) {
+        publisher_.UpdateState(map.GetInstanceId());
+    });
+}
 
-    // Сохраняем игровое состояние, если прошло достаточно времени
-    storage_.Write(time_ms);
-
-    // Удаляем неактивных игроков и записываем их в таблицу рекордов
+void ApiHandler::RetirePlayers(std::vector<Record>& records) {
+    // Удаляем неактивных игроков, их рекорды добавляются в records.
+    // Ушедшие на покой собаки не двигаются, поэтому до удаления ничего не подбирают
     auto players = app_.RemoveRetiredPlayers();
-    std::vector<Record> records;
+    if (players.empty()) {
+        return;
+    }
+    for (const auto& player : players) {
+        publisher_.UpdateMembers(player->GetMap()->GetInstanceId());
+    }
 
     std::transform(players.begin(), players.end(), std::back_inserter(records), [](const std::unique_ptr<Player>& player) {
         return Record{
@@ -275,11 +816,102 @@ void ApiHandler::TickAction(int64_t time_ms) {
             player->GetDog()->GetPlayTime()
         };
     });
-    db_.AddRecords(records);
+
+    // Опустевшие дополнительные экземпляры карт больше не нужны
+    std::vector<const model::Map*> empty_instances;
+    for (const auto& player : players) {
+        const auto* map = player->GetMap();
+        if (!game_.IsPrimary(map) && app_.GetPlayersOnMap(map).empty()
+            && std::find(empty_instances.begin(), empty_instances.end(), map) == empty_instances.end()) {
+            empty_instances.push_back(map);
+        }
+    }
+    for (const auto* map : empty_instances) {
+        publisher_.RemoveChannel(map->GetInstanceId());
+        app_.ForgetMap(map);
+        game_.RemoveInstance(map);
+    }
+}
+
+const model::Map* ApiHandler::PlacePlayer(const model::Map& map) {
+    const auto* instance = app_.PlacePlayer(game_, map);
+    publisher_.OpenChannel(instance->GetInstanceId());
+    return instance;
+}
+
+void ApiHandler::PublishState() {
+    game_.ForEachInstance([this](const model::Map& map) {
+        // Состояние сериализуется один раз на карту, сколько бы ни было подписчиков
+        if (publisher_.IsWatched(map.GetInstanceId())) {
+            publisher_.Publish(map.GetInstanceId(), std::make_shared<const std::string>(SerializeGameState(&map)));
+        }
+    });
+}
+
+StatePublisher::Versions ApiHandler::GetMapVersions(const std::string& token_str) const {
+    return publisher_.GetVersions(FindPlayer(token_str).map);
+}
+
+void ApiHandler::Subscribe(const std::string& token_str, std::weak_ptr<StateSubscriber> subscriber,
+                           const std::function<void(bool)>& callback) {
+    const auto ref = FindPlayer(token_str);
+
+    Post([this, ref, subscriber = std::move(subscriber), callback]() mutable {
+        const auto* player = app_.GetPlayerById(ref.id);
+        callback(player && publisher_.Subscribe(player->GetMap()->GetInstanceId(), std::move(subscriber)));
+    });
+}
+
+void ApiHandler::FindSpectatedMap(const std::string& map_id, size_t instance,
+                                  const std::function<void(std::optional<model::Map::InstanceId>)>& callback) const {
+    const model::Map::Id id{map_id};
+    const auto* map = game_.FindMap(id);
+    if (!map) {
+        throw ApiException("Map not found", "mapNotFound", http::status::not_found);
+    }
+    if (instance == 0) {
+        return callback(map->GetInstanceId());
+    }
+
+    Post([this, id, instance, callback]() {
+        const auto instances = game_.GetInstances(id);
+        if (instance >= instances.size()) {
+            return callback(std::nullopt);
+        }
+        callback(instances[instance]->GetInstanceId());
+    });
+}
+
+void ApiHandler::SpectateGameState(model::Map::InstanceId instance, bool wait, const Callback& callback) {
+    if (!wait) {
+        if (auto frame = publisher_.GetLatest(instance)) {
+            return callback(*frame);
+        }
+    }
+    WaitMapState(instance, callback);
+}
+
+bool ApiHandler::SubscribeSpectator(model::Map::InstanceId instance, std::weak_ptr<StateSubscriber> subscriber) {
+    return publisher_.Subscribe(instance, std::move(subscriber));
+}
+
+void ApiHandler::AddBots(size_t per_map, const std::function<void(std::vector<int>)>& callback) {
+    Post([this, per_map, callback]() {
+        std::vector<int> bot_ids;
+        for (const auto& map : game_.GetMaps()) {
+            for (size_t i = 0; i < per_map; ++i) {
+                const auto* instance = PlacePlayer(map);
+                const auto& [_, id] = app_.AddPlayer("bot-" + std::to_string(i), instance);
+                publisher_.UpdateMembers(instance->GetInstanceId());
+                bot_ids.push_back(id);
+            }
+        }
+        callback(std::move(bot_ids));
+    });
 }
 
 void ApiHandler::GetRecords(const std::optional<int>& start, const std::optional<int>& max_items, const Callback& callback) const {
-    net::post(api_strand_, [this, start, max_items, callback]() {
+    PostRequest(callback, [this, start, max_items](const Callback& callback) {
         // Запрашиваем записи из базы данных асинхронно
         db_.GetRecords(start, max_items, [callback](const std::vector<Record>& records) {
             json::array result;
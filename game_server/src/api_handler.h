@@ -6,15 +6,50 @@
 
 #include "ticker.h"
 #include "state_storage.h"
+#include "state_publisher.h"
 #include "db/database.h"
 
 #include <boost/beast/http.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
 #include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 namespace http = boost::beast::http;
 namespace net = boost::asio;
-using Callback = std::function<void(const std::string&)>;
+
+// Получает готовое тело ответа во владение. Если задан abandoned и клиент успел отключиться,
+// работа по запросу отбрасывается, не дойдя до strand
+class Callback {
+public:
+    Callback() = default;
+
+    template <typename Handler>
+        requires (!std::is_same_v<std::decay_t<Handler>, Callback>)
+    Callback(Handler&& handler, std::shared_ptr<const std::atomic_bool> abandoned = nullptr)
+        : handler_{std::forward<Handler>(handler)}
+        , abandoned_{std::move(abandoned)} {
+    }
+
+    void operator()(std::string body) const {
+        handler_(std::move(body));
+    }
+
+    bool IsAbandoned() const {
+        return abandoned_ && abandoned_->load(std::memory_order_relaxed);
+    }
+
+private:
+    std::function<void(std::string)> handler_;
+    std::shared_ptr<const std::atomic_bool> abandoned_;
+};
+
+// Формат тел запросов и ответов: JSON или компактный двоичный (см. binary_encoding.h)
+enum class Encoding { Json, Binary };
 
 struct ApiException : public std::runtime_error {
     explicit ApiException(const std::string& message, const std::string& code, http::status status)
@@ -24,10 +59,44 @@ struct ApiException : public std::runtime_error {
     http::status status;
 };
 
+// Периоды второстепенных этапов тика в игровом времени. 0 - выполнять на каждом тике.
+// Период сохранения состояния задаётся в StateStorage
+struct StagePeriods {
+    int publish_ms = 0;
+    int retire_ms = 0;
+};
+
+// Пороги перегрузки, после которых второстепенные запросы получают 503. 0 - порог не проверяется
+struct LoadLimits {
+    size_t max_queue_depth = 0;
+    std::chrono::milliseconds max_tick_lag{0};
+};
+
+// Показатели нагрузки. peak_queue_depth и shed накоплены с прошлого TakeLoadStats
+struct LoadStats {
+    size_t queue_depth = 0;
+    size_t peak_queue_depth = 0;
+    uint64_t shed = 0;
+    std::chrono::milliseconds tick_lag{0};
+};
+
+// Время работы этапов тика, накопленное за один или несколько тиков
+struct TickTimings {
+    using Duration = std::chrono::steady_clock::duration;
+
+    Duration commands{};
+    Duration simulation{};
+    Duration persistence{};
+    Duration retirement{};
+    Duration spatial_index{};
+    Duration publication{};
+};
+
 class ApiHandler {
 public:
     explicit ApiHandler(net::io_context& ioc, model::Game& game, App& app, StateStorage& storage, 
-                        loot::Generator& loot_generator, loot::Data& loot_data, Database& db, int tick_period = 0) 
+                        loot::Generator& loot_generator, loot::Data& loot_data, Database& db, int tick_period = 0,
+                        int tick_catch_up = 0, StagePeriods stage_periods = {})
     : game_(game)
     , app_(app)
     , storage_(storage)
@@ -35,26 +104,113 @@ public:
     , loot_data_(loot_data)
     , db_(db)
     , tick_period_(tick_period)
+    , publish_stage_(stage_periods.publish_ms)
+    , retire_stage_(stage_periods.retire_ms)
     , api_strand_(net::make_strand(ioc)) {
+        // Каналы нужны всем экземплярам, в том числе восстановленным из сохранения
+        game_.ForEachInstance([this](const model::Map& map) {
+            publisher_.OpenChannel(map.GetInstanceId());
+        });
         if (tick_period_) {
-            auto ticker = std::make_shared<Ticker>(api_strand_, std::chrono::milliseconds(tick_period_),
-                [&](std::chrono::milliseconds delta) { TickAction(delta.count()); }
+            ticker_ = std::make_shared<Ticker>(api_strand_, std::chrono::milliseconds(tick_period_),
+                [&](std::chrono::milliseconds delta) { TickAction(delta.count()); },
+                tick_catch_up
             );
-            ticker->Start();
+            // Показатели нагрузки пишутся в лог вместе со статистикой тиков
+            ticker_->SetStatsListener([this] {
+                const auto stats = TakeLoadStats();
+                Logger::LogLoadStats(stats.queue_depth, stats.peak_queue_depth, stats.shed, stats.tick_lag.count());
+            });
+            ticker_->Start();
         }
     }
 
+    // Задаётся до начала обработки запросов
+    void SetLoadLimits(LoadLimits limits) {
+        load_limits_ = limits;
+    }
+    // Сколько обработчиков ждёт своей очереди в strand игры
+    size_t GetQueueDepth() const {
+        return queue_depth_.load(std::memory_order_relaxed);
+    }
+    // Очередь strand или опоздание тика превысили пороги LoadLimits
+    bool IsOverloaded() const;
+    // Учитывает запрос, отклонённый из-за перегрузки
+    void CountShedRequest() const {
+        shed_requests_.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Текущие показатели нагрузки. Пиковая очередь и число отклонённых запросов начинаются заново.
+    // Можно вызывать из любого потока
+    LoadStats TakeLoadStats() const;
+
     void GetMaps(const Callback& callback) const;
     void GetMapById(const std::string& id, const Callback& callback) const;
     void JoinGame(const std::string& body, const Callback& callback);
-    void GetPlayers(const std::string& token_str, const Callback& callback) const;
-    void GetGameState(const std::string& token_str, const Callback& callback) const;
-    void PlayerAction(const std::string& token_str, const std::string& body, const Callback& callback) const;
+    void GetPlayers(const std::string& token_str, Encoding encoding, Callback callback) const;
+    // Если задан radius, возвращаются только игроки и предметы в пределах radius от собаки игрока
+    void GetGameState(const std::string& token_str, Encoding encoding, std::optional<double> radius,
+                      Callback callback) const;
+    // Long-poll: отвечает состоянием после ближайшего тика, но не позже чем через LongPollTimeout
+    void WaitGameState(const std::string& token_str, const Callback& callback);
+    void PlayerAction(const std::string& token_str, const std::string& body, Encoding encoding, Callback callback);
+    // Отправляет собаку к цели: {"target": "office"} - ближайший офис, {"target": "loot", "id": 5} - предмет,
+    // {"target": "point", "x": 1.5, "y": 2} - точка на дороге. В ответе точка, куда идёт собака,
+    // или null, если цель не найдена или недостижима
+    void NavigatePlayer(const std::string& token_str, const std::string& body, const Callback& callback);
+    // Команды сразу нескольких игроков: {"actions": [{"token": ..., "move": ...}], "state": true}.
+    // Применяются за один проход strand. При state=true в ответ добавляются состояния экземпляров их карт
+    // {"states": {"<instance>": ...}}, а результат каждой команды указывает свой экземпляр: {"instance": "<instance>"}
+    void PlayerBatch(const std::string& body, const Callback& callback);
+    // {"timeDelta": d} - один тик, {"timeDelta": d, "steps": n} - n тиков по d мс за один проход strand,
+    // в ответе время работы каждого этапа
     void GameTick(const std::string& body, const Callback& callback);
     void GetRecords(const std::optional<int>& start, const std::optional<int>& max_items, const Callback& callback) const;
 
+    // Версии состояния карты, на которой находится игрок. Не обращается к strand
+    StatePublisher::Versions GetMapVersions(const std::string& token_str) const;
+
+    // Добавляет per_map ботов на каждую карту и передаёт их идентификаторы в callback
+    void AddBots(size_t per_map, const std::function<void(std::vector<int>)>& callback);
+
+    // Подписывает получателя на состояние карты, на которой находится игрок. callback вызывается
+    // в strand игры и получает false, если игрок успел уйти на покой
+    void Subscribe(const std::string& token_str, std::weak_ptr<StateSubscriber> subscriber,
+                   const std::function<void(bool)>& callback);
+
+    // Зрители смотрят экземпляр карты без токена игрока. instance - порядковый номер экземпляра, 0 - основной.
+    // callback получает номер найденного экземпляра или nullopt, если такого нет. Основной экземпляр
+    // находится без обращения к strand, дополнительные - в strand игры. Сам экземпляр наружу
+    // не отдаётся: к моменту ответа он может быть уже удалён
+    void FindSpectatedMap(const std::string& map_id, size_t instance,
+                          const std::function<void(std::optional<model::Map::InstanceId>)>& callback) const;
+    // Отвечает последним разосланным кадром, если состояние с тех пор не менялось, иначе ждёт
+    // ближайшего тика. При wait всегда ждёт. Число зрителей не влияет на стоимость тика
+    void SpectateGameState(model::Map::InstanceId instance, bool wait, const Callback& callback);
+    // false, если экземпляр уже удалён
+    bool SubscribeSpectator(model::Map::InstanceId instance, std::weak_ptr<StateSubscriber> subscriber);
+
 private:
-    void TickAction(int64_t time_ms);
+    // Все обработчики попадают в strand через Post, чтобы их число было видно в GetQueueDepth
+    template <typename Handler>
+    void Post(Handler&& handler) const;
+    // Обработчик запроса получает callback. Если клиент уже отключился, обработчик не вызывается
+    template <typename Handler>
+    void PostRequest(Callback callback, Handler&& handler) const;
+    // Игрок по токену, можно вызывать вне strand. Неизвестный токен - ApiException
+    PlayerRef FindPlayer(const std::string& token_str) const;
+
+    void TickAction(int64_t time_ms, TickTimings* timings = nullptr);
+    // steps тиков по time_ms. Сохранение, запись рекордов, индекс и рассылка - один раз после всех шагов
+    void FastForward(int64_t time_ms, int64_t steps, TickTimings& timings);
+    void Simulate(int64_t time_ms);
+    // Удаляет ушедших на покой игроков и опустевшие экземпляры карт. Рекорды игроков добавляются в records
+    void RetirePlayers(std::vector<Record>& records);
+    // Экземпляр карты для нового игрока (см. App::PlacePlayer). У нового экземпляра открывается канал
+    const model::Map* PlacePlayer(const model::Map& map);
+    void PublishState();
+    // Long-poll на состоянии экземпляра карты
+    void WaitMapState(model::Map::InstanceId instance, const Callback& callback);
+    std::string SerializeGameState(const model::Map* map) const;
 
     model::Game& game_;
     App& app_;
@@ -62,6 +218,14 @@ private:
     loot::Generator& loot_generator_;
     loot::Data& loot_data_;
     Database& db_;
+    StatePublisher publisher_;
     int tick_period_;
+    TickStage publish_stage_;
+    TickStage retire_stage_;
     net::strand<net::io_context::executor_type> api_strand_;
+    std::shared_ptr<Ticker> ticker_;
+    LoadLimits load_limits_;
+    mutable std::atomic<size_t> queue_depth_{0};
+    mutable std::atomic<size_t> peak_queue_depth_{0};
+    mutable std::atomic<uint64_t> shed_requests_{0};
 };
@@ -0,0 +1,108 @@
+#include "binary_encoding.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace binary {
+
+namespace {
+
+// Оценка размера записи игрока без учёта содержимого рюкзака
+constexpr std::size_t PlayerRecordSize = 32;
+constexpr std::size_t LootRecordSize = 16;
+
+}  // namespace
+
+void Writer::PutByte(std::uint8_t value) {
+    out_.push_back(static_cast<char>(value));
+}
+
+void Writer::PutVarint(std::uint64_t value) {
+    while (value >= 0x80) {
+        PutByte(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    PutByte(static_cast<std::uint8_t>(value));
+}
+
+void Writer::PutInt32(std::int32_t value) {
+    const auto bits = static_cast<std::uint32_t>(value);
+    for (int shift = 0; shift < 32; shift += 8) {
+        PutByte(static_cast<std::uint8_t>(bits >> shift));
+    }
+}
+
+void Writer::PutScaled(double value) {
+    // Приведение значения вне диапазона int32 - неопределённое поведение, поэтому сначала ограничиваем
+    constexpr double Min = std::numeric_limits<std::int32_t>::min();
+    constexpr double Max = std::numeric_limits<std::int32_t>::max();
+    const double scaled = std::round(value * PositionScale);
+    PutInt32(std::isnan(scaled) ? 0 : static_cast<std::int32_t>(std::clamp(scaled, Min, Max)));
+}
+
+void Writer::PutString(std::string_view value) {
+    PutVarint(value.size());
+    out_.append(value);
+}
+
+std::string EncodeGameState(const Players& players, const model::Loots& loots) {
+    std::string out;
+    out.reserve(1 + players.size() * PlayerRecordSize + loots.size() * LootRecordSize);
+    Writer writer{out};
+
+    writer.PutByte(FormatVersion);
+    writer.PutVarint(players.size());
+    for (const auto* player : players) {
+        const auto* dog = player->GetDog();
+        writer.PutVarint(player->GetId());
+        writer.PutScaled(dog->GetPosition().x);
+        writer.PutScaled(dog->GetPosition().y);
+        writer.PutScaled(dog->GetSpeed().x);
+        writer.PutScaled(dog->GetSpeed().y);
+        writer.PutByte(static_cast<std::uint8_t>(dog->GetDirection()));
+
+        const auto& bag = dog->GetBag();
+        writer.PutVarint(bag.size());
+        for (const auto& loot : bag) {
+            writer.PutVarint(loot.id);
+            writer.PutVarint(loot.type);
+        }
+        writer.PutVarint(dog->GetScore());
+    }
+
+    writer.PutVarint(loots.size());
+    for (const auto& loot : loots) {
+        writer.PutVarint(loot.id);
+        writer.PutVarint(loot.type);
+        writer.PutScaled(loot.position.x);
+        writer.PutScaled(loot.position.y);
+    }
+    return out;
+}
+
+std::string EncodePlayers(const Players& players) {
+    std::string out;
+    Writer writer{out};
+
+    writer.PutByte(FormatVersion);
+    writer.PutVarint(players.size());
+    for (const auto* player : players) {
+        writer.PutVarint(player->GetId());
+        writer.PutString(player->GetName());
+    }
+    return out;
+}
+
+std::optional<char> DecodeAction(std::string_view body) {
+    if (body.size() != 1) {
+        return std::nullopt;
+    }
+    const char direction = body.front();
+    if (direction != 'L' && direction != 'R' && direction != 'D' && direction != 'U' && direction != 0) {
+        return std::nullopt;
+    }
+    return direction;
+}
+
+}  // namespace binary
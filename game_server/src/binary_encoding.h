@@ -0,0 +1,60 @@
+#pragma once
+
+#include "app/app.h"
+#include "model/model.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/*
+ *  Компактное двоичное представление игровых данных (Accept: application/x-game-state).
+ *  Все числа фиксированной длины записываются в little-endian, идентификаторы и длины -
+ *  в виде varint (LEB128). Координаты и скорости квантуются с шагом 1/PositionScale.
+ *  Значения за пределами int32 после квантования (|x| > ~2.09e6) записываются как ближайшая граница.
+ *
+ *  Состояние игры:
+ *      u8 version
+ *      varint players_count, для каждого игрока:
+ *          varint id, i32 x, i32 y, i32 speed_x, i32 speed_y, u8 dir,
+ *          varint bag_size, для каждого предмета: varint id, varint type
+ *          varint score
+ *      varint lost_objects_count, для каждого предмета:
+ *          varint id, varint type, i32 x, i32 y
+ *
+ *  Список игроков:
+ *      u8 version
+ *      varint players_count, для каждого игрока: varint id, varint name_size, name
+ *
+ *  Действие игрока - один байт направления: 'L', 'R', 'U', 'D' или 0 для остановки.
+ */
+namespace binary {
+
+constexpr std::string_view ContentType = "application/x-game-state";
+constexpr std::uint8_t FormatVersion = 1;
+constexpr double PositionScale = 1024.0;
+
+class Writer {
+public:
+    explicit Writer(std::string& out)
+        : out_(out) {
+    }
+
+    void PutByte(std::uint8_t value);
+    void PutVarint(std::uint64_t value);
+    void PutInt32(std::int32_t value);
+    void PutScaled(double value);
+    void PutString(std::string_view value);
+
+private:
+    std::string& out_;
+};
+
+std::string EncodeGameState(const Players& players, const model::Loots& loots);
+std::string EncodePlayers(const Players& players);
+
+// Возвращает направление либо nullopt, если тело запроса некорректно
+std::optional<char> DecodeAction(std::string_view body);
+
+}  // namespace binary
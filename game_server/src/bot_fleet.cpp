@@ -0,0 +1,65 @@
+#include "bot_fleet.h"
+#include "logger.h"
+
+#include <array>
+#include <stdexcept>
+
+namespace {
+
+constexpr std::array<char, 5> BotDirections{'L', 'R', 'U', 'D', 0};
+
+}  // namespace
+
+BotFleet::BotFleet(net::io_context& ioc, App& app, std::chrono::milliseconds move_period, std::string script)
+    : app_(app)
+    , timer_(ioc)
+    , move_period_(move_period)
+    , script_(std::move(script)) {
+    for (char& c : script_) {
+        if (c == 'S') {
+            c = 0;
+        } else if (c != 'L' && c != 'R' && c != 'U' && c != 'D') {
+            throw std::invalid_argument("Bot script may contain only L, R, U, D and S");
+        }
+    }
+}
+
+void BotFleet::Start(std::vector<int> bot_ids) {
+    bot_ids_ = std::move(bot_ids);
+    ScheduleMoves();
+}
+
+void BotFleet::ScheduleMoves() {
+    timer_.expires_after(move_period_);
+    timer_.async_wait([self = shared_from_this()](sys::error_code ec) {
+        self->OnMoves(ec);
+    });
+}
+
+void BotFleet::OnMoves(sys::error_code ec) {
+    if (ec) {
+        return;
+    }
+
+    size_t dropped = 0;
+    for (size_t i = 0; i < bot_ids_.size(); ++i) {
+        // Ушедшие на покой боты просто пропускаются при применении команд
+        if (!app_.EnqueueMove(bot_ids_[i], NextDirection(i))) {
+            ++dropped;
+        }
+    }
+    if (dropped) {
+        Logger::LogError(0, std::to_string(dropped) + " bot moves dropped: command queue is full", "bot fleet");
+    }
+
+    ++step_;
+    ScheduleMoves();
+}
+
+char BotFleet::NextDirection(size_t bot_index) {
+    if (script_.empty()) {
+        std::uniform_int_distribution<size_t> dist{0, BotDirections.size() - 1};
+        return BotDirections[dist(generator_)];
+    }
+    return script_[(step_ + bot_index) % script_.size()];
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "app/app.h"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace net = boost::asio;
+namespace sys = boost::system;
+
+/*
+ *  Боты для нагрузочного тестирования без участия HTTP.
+ *  Каждые move_period каждый бот отдаёт команду движения через ту же очередь,
+ *  что и настоящие игроки (App::EnqueueMove). Направление выбирается случайно
+ *  или берётся из сценария - строки из символов L, R, U, D и S (остановка),
+ *  которая повторяется по кругу. Чтобы боты не ходили строем, каждый начинает
+ *  сценарий со своей позиции.
+ */
+class BotFleet : public std::enable_shared_from_this<BotFleet> {
+public:
+    BotFleet(net::io_context& ioc, App& app, std::chrono::milliseconds move_period, std::string script = {});
+
+    BotFleet(const BotFleet&) = delete;
+    BotFleet& operator=(const BotFleet&) = delete;
+
+    // bot_ids - идентификаторы игроков, уже добавленных в игру
+    void Start(std::vector<int> bot_ids);
+
+private:
+    void ScheduleMoves();
+    void OnMoves(sys::error_code ec);
+    char NextDirection(size_t bot_index);
+
+    App& app_;
+    net::steady_timer timer_;
+    std::chrono::milliseconds move_period_;
+    std::string script_;
+    std::vector<int> bot_ids_;
+    std::mt19937 generator_{std::random_device{}()};
+    size_t step_ = 0;
+};
@@ -0,0 +1,224 @@
+#include "compression.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <stdexcept>
+#include <string>
+
+using namespace std::literals;
+
+namespace compression {
+
+namespace {
+
+// Размер окна zlib. +16 - формат gzip, без добавки - формат zlib, который в HTTP называется deflate
+constexpr int WindowBits = 15;
+constexpr int GzipWindowBits = WindowBits + 16;
+constexpr int MemoryLevel = 8;
+
+class Deflater {
+public:
+    explicit Deflater(int window_bits) {
+        if (deflateInit2(&stream_, level_, Z_DEFLATED, window_bits, MemoryLevel, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("Failed to initialize zlib stream");
+        }
+    }
+
+    Deflater(const Deflater&) = delete;
+    Deflater& operator=(const Deflater&) = delete;
+
+    ~Deflater() {
+        deflateEnd(&stream_);
+    }
+
+    std::string Compress(std::string_view data, int level) {
+        deflateReset(&stream_);
+        if (level != level_) {
+            deflateParams(&stream_, level, Z_DEFAULT_STRATEGY);
+            level_ = level;
+        }
+
+        std::string result;
+        result.resize(deflateBound(&stream_, static_cast<uLong>(data.size())));
+        stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream_.avail_in = static_cast<uInt>(data.size());
+        stream_.next_out = reinterpret_cast<Bytef*>(result.data());
+        stream_.avail_out = static_cast<uInt>(result.size());
+
+        if (deflate(&stream_, Z_FINISH) != Z_STREAM_END) {
+            throw std::runtime_error("Failed to compress data");
+        }
+        result.resize(stream_.total_out);
+        return result;
+    }
+
+private:
+    z_stream stream_{};
+    int level_ = Z_DEFAULT_COMPRESSION;
+};
+
+std::string_view Trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs) {
+    return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char a, char b) {
+        return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+    });
+}
+
+// q-значение из параметров вида ";q=0.5". Без параметра - 1
+double ParseQuality(std::string_view params) {
+    while (!params.empty()) {
+        const auto semicolon = params.find(';');
+        const auto param = Trim(params.substr(0, semicolon));
+        params = semicolon == std::string_view::npos ? std::string_view{} : params.substr(semicolon + 1);
+        if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+            double quality = 0.0;
+            const auto value = param.substr(2);
+            if (std::from_chars(value.data(), value.data() + value.size(), quality).ec != std::errc{}) {
+                return 0.0;
+            }
+            return quality;
+        }
+    }
+    return 1.0;
+}
+
+}  // namespace
+
+ContentCoding NegotiateCoding(std::string_view accept_encoding) {
+    // -1 - кодировка не упомянута
+    double gzip = -1.0, deflate = -1.0, any = -1.0;
+    while (!accept_encoding.empty()) {
+        const auto comma = accept_encoding.find(',');
+        const auto item = accept_encoding.substr(0, comma);
+        accept_encoding = comma == std::string_view::npos ? std::string_view{} : accept_encoding.substr(comma + 1);
+
+        const auto semicolon = item.find(';');
+        const auto name = Trim(item.substr(0, semicolon));
+        const double quality = semicolon == std::string_view::npos ? 1.0 : ParseQuality(item.substr(semicolon + 1));
+        if (EqualsIgnoreCase(name, "gzip"sv) || EqualsIgnoreCase(name, "x-gzip"sv)) {
+            gzip = quality;
+        } else if (EqualsIgnoreCase(name, "deflate"sv)) {
+            deflate = quality;
+        } else if (name == "*"sv) {
+            any = quality;
+        }
+    }
+
+    // "*" относится ко всем кодировкам, не названным явно
+    if (gzip < 0.0) {
+        gzip = any;
+    }
+    if (deflate < 0.0) {
+        deflate = any;
+    }
+    if (gzip > 0.0 && gzip >= deflate) {
+        return ContentCoding::Gzip;
+    }
+    if (deflate > 0.0) {
+        return ContentCoding::Deflate;
+    }
+    return ContentCoding::Identity;
+}
+
+std::string_view ToString(ContentCoding coding) {
+    switch (coding) {
+    case ContentCoding::Gzip:
+        return "gzip"sv;
+    case ContentCoding::Deflate:
+        return "deflate"sv;
+    case ContentCoding::Identity:
+        break;
+    }
+    return "identity"sv;
+}
+
+bool IsCompressibleType(std::string_view content_type) {
+    content_type = content_type.substr(0, content_type.find(';'));
+    return content_type.starts_with("text/"sv)
+        || content_type == "application/json"sv
+        || content_type == "application/javascript"sv
+        || content_type == "application/xml"sv
+        || content_type == "image/svg+xml"sv;
+}
+
+std::string Compress(std::string_view data, ContentCoding coding, int level) {
+    if (coding == ContentCoding::Identity) {
+        return std::string{data};
+    }
+    // Инициализация потока zlib выделяет около 256 КБ, поэтому потоки создаются один раз на поток выполнения
+    thread_local Deflater gzip{GzipWindowBits};
+    thread_local Deflater deflate{WindowBits};
+    return (coding == ContentCoding::Gzip ? gzip : deflate).Compress(data, level);
+}
+
+std::string AddCodingToETag(std::string_view etag, ContentCoding coding) {
+    std::string result{etag};
+    if (coding == ContentCoding::Identity || !result.ends_with('"')) {
+        return result;
+    }
+    result.insert(result.size() - 1, "-"s + std::string{ToString(coding)});
+    return result;
+}
+
+bool MatchesETag(std::string_view tag, std::string_view etag) {
+    if (tag == etag) {
+        return true;
+    }
+    // Суффикс кодировки стоит перед закрывающей кавычкой
+    if (!etag.ends_with('"') || !tag.starts_with(etag.substr(0, etag.size() - 1))) {
+        return false;
+    }
+    const auto suffix = tag.substr(etag.size() - 1);
+    return suffix == "-gzip\""sv || suffix == "-deflate\""sv;
+}
+
+bool ShouldCompress(const StringResponse& response) {
+    // Диапазон задан в байтах исходного тела, сжатие его бы исказило
+    return response.result() != http::status::partial_content
+        && response.find(http::field::content_range) == response.end()
+        && response.find(http::field::content_encoding) == response.end()
+        && response.body().size() >= MinCompressedSize
+        && IsCompressibleType(response[http::field::content_type]);
+}
+
+void CompressResponse(StringResponse& response, ContentCoding coding) {
+    AddVaryAcceptEncoding(response);
+    if (coding == ContentCoding::Identity) {
+        return;
+    }
+
+    auto compressed = Compress(response.body(), coding, DynamicLevel);
+    if (compressed.size() >= response.body().size()) {
+        return;
+    }
+    response.body() = std::move(compressed);
+    response.set(http::field::content_encoding, ToString(coding));
+    if (auto it = response.find(http::field::etag); it != response.end()) {
+        response.set(http::field::etag, AddCodingToETag(it->value(), coding));
+    }
+    response.prepare_payload();
+}
+
+// Vary может уже перечислять другие заголовки, например Accept у ответов с выбором формата
+void AddVaryAcceptEncoding(StringResponse& response) {
+    const auto vary = response[http::field::vary];
+    if (vary.empty()) {
+        response.set(http::field::vary, "Accept-Encoding"sv);
+    } else if (vary.find("Accept-Encoding"sv) == std::string_view::npos) {
+        response.set(http::field::vary, std::string{vary} + ", Accept-Encoding");
+    }
+}
+
+}  // namespace compression
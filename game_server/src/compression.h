@@ -0,0 +1,44 @@
+#pragma once
+#include "http_server.h"
+
+#include <string>
+#include <string_view>
+
+namespace compression {
+
+enum class ContentCoding {
+    Identity,
+    Gzip,
+    Deflate
+};
+
+// Ответы меньше этого размера не сжимаются: заголовки и время сжатия дороже выигрыша
+constexpr size_t MinCompressedSize = 1024;
+// Для ответов API важнее скорость, для статики - размер: она сжимается один раз
+constexpr int DynamicLevel = 1;
+constexpr int StaticLevel = 9;
+
+// Выбирает сжатие по заголовку Accept-Encoding с учётом q-значений. При равенстве предпочитается gzip
+ContentCoding NegotiateCoding(std::string_view accept_encoding);
+std::string_view ToString(ContentCoding coding);
+
+// Тексты, JSON, скрипты и SVG. Изображения и двоичные форматы уже сжаты или малы
+bool IsCompressibleType(std::string_view content_type);
+
+// Сжимает данные потоком zlib, который каждый поток создаёт один раз и дальше переиспользует
+std::string Compress(std::string_view data, ContentCoding coding, int level);
+
+// ETag представления, сжатого на лету: "abc" -> "abc-gzip". Сильный ETag обещает побайтное
+// совпадение, поэтому у сжатого и исходного тела они должны различаться
+std::string AddCodingToETag(std::string_view etag, ContentCoding coding);
+// Совпадает ли tag из If-None-Match с etag или с ETag его сжатого на лету представления
+bool MatchesETag(std::string_view tag, std::string_view etag);
+
+// Подходит ли ответ для сжатия на лету: ещё не сжат, не часть тела, нужного типа и достаточно велик
+bool ShouldCompress(const StringResponse& response);
+// Vary: Accept-Encoding, не теряя уже перечисленных заголовков. Нужен и ответам 304
+void AddVaryAcceptEncoding(StringResponse& response);
+// Сжимает тело ответа, если это его уменьшает, и меняет его ETag. Всегда добавляет Vary: Accept-Encoding
+void CompressResponse(StringResponse& response, ContentCoding coding);
+
+}  // namespace compression
@@ -3,7 +3,7 @@
 
 using pqxx::operator"" _zv;
 
-Database::Database(const std::string& db_url)
+PostgresDatabase::PostgresDatabase(const std::string& db_url)
     : connection_pool_([db_url]() {return std::make_shared<pqxx::connection>(db_url);}) {
     AsyncExecute(
         R"( CREATE TABLE IF NOT EXISTS retired_players (
@@ -20,7 +20,7 @@ Database::Database(const std::string& db_url)
         );)");
 }
 
-void Database::AddRecords(const std::vector<Record>& records) {
+void PostgresDatabase::AddRecords(const std::vector<Record>& records) {
     for (const auto& record : records) {
         const auto uuid = util::TaggedUUID<struct PlayerTag>::New();
         
@@ -33,7 +33,7 @@ void Database::AddRecords(const std::vector<Record>& records) {
     }
 }
 
-void Database::GetRecords(const std::optional<int>& start, const std::optional<int>& max_items, std::function<void(std::vector<Record>)> callback) {
+void PostgresDatabase::GetRecords(const std::optional<int>& start, const std::optional<int>& max_items, std::function<void(std::vector<Record>)> callback) {
     int offset = start.value_or(0);
     int limit = max_items.value_or(100);
 
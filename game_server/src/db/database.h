@@ -2,6 +2,7 @@
 
 #include <pqxx/pqxx>
 
+#include <functional>
 #include <string>
 #include <vector>
 #include <optional>
@@ -14,15 +15,27 @@ struct Record {
     double time_s;
 };
 
+// Хранилище рекордов. Ответ GetRecords может прийти из другого потока
 class Database {
 public:
-    explicit Database(const std::string& db_url);
+    virtual ~Database() = default;
 
-    void AddRecords(const std::vector<Record>& records);
+    virtual void AddRecords(const std::vector<Record>& records) = 0;
+
+    virtual void GetRecords(const std::optional<int>& start,
+                            const std::optional<int>& max_items,
+                            std::function<void(std::vector<Record>)> callback) = 0;
+};
+
+class PostgresDatabase : public Database {
+public:
+    explicit PostgresDatabase(const std::string& db_url);
+
+    void AddRecords(const std::vector<Record>& records) override;
     
     void GetRecords(const std::optional<int>& start,
                     const std::optional<int>& max_items,
-                    std::function<void(std::vector<Record>)> callback);
+                    std::function<void(std::vector<Record>)> callback) override;
 
 private:
     template <typename Callback = std::function<void(const pqxx::result&)>, typename... Args>
@@ -1,9 +1,18 @@
 #include "http_server.h"
 #include "logger.h"
 
+#include <boost/asio/co_spawn.hpp>
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/websocket/rfc6455.hpp>
 #include <iostream>
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
 using namespace std::literals;
 
 namespace http_server {
@@ -21,23 +30,140 @@ void ReportResponse(const std::string& ip, std::chrono::milliseconds response_ti
 }
 
 
+namespace {
+
+// Сколько отклонённое соединение дочитывается после ответа
+constexpr auto RejectDrainTimeout = 1s;
+
+// Дочитывает и отбрасывает всё, что клиент успел прислать, до его FIN. Если закрыть сокет
+// с непрочитанными данными, ядро пошлёт RST, и клиент может потерять уже отправленный ему ответ
+struct RejectedConnection : std::enable_shared_from_this<RejectedConnection> {
+    explicit RejectedConnection(tcp::socket&& socket)
+        : socket{std::move(socket)} {
+    }
+
+    void Drain() {
+        socket.async_read_some(net::buffer(buffer), [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            if (ec) {
+                // Клиент закрыл соединение, или истёк таймер
+                self->timer.cancel();
+                return;
+            }
+            self->Drain();
+        });
+    }
+
+    tcp::socket socket;
+    net::steady_timer timer{socket.get_executor()};
+    std::array<char, 1024> buffer;
+};
+
+}  // namespace
+
+void RejectConnection(tcp::socket&& socket) {
+    // Ответ не зависит от запроса, поэтому запрос не разбирается
+    static constexpr std::string_view Response = "HTTP/1.1 503 Service Unavailable\r\n"
+                                                 "Retry-After: 1\r\n"
+                                                 "Content-Length: 0\r\n"
+                                                 "Connection: close\r\n\r\n";
+    auto connection = std::make_shared<RejectedConnection>(std::move(socket));
+    net::async_write(connection->socket, net::buffer(Response.data(), Response.size()),
+                     [connection](beast::error_code ec, std::size_t) {
+                         if (ec) {
+                             return ReportError(ec, "reject"sv);
+                         }
+                         connection->socket.shutdown(tcp::socket::shutdown_send, ec);
+                         // Клиент, который не закрывает соединение, держит его не дольше таймера
+                         connection->timer.expires_after(RejectDrainTimeout);
+                         connection->timer.async_wait([connection](beast::error_code ec) {
+                             if (!ec) {
+                                 connection->socket.close(ec);
+                             }
+                         });
+                         connection->Drain();
+                     });
+}
+
+StringRequest DetachRequest(const StringRequest& request) {
+    // Копия получает аллокатор по умолчанию, см. RequestAllocator::select_on_container_copy_construction
+    return StringRequest{request};
+}
+
 void SessionBase::Run() {
+    if (coroutine_) {
+        net::co_spawn(stream_.get_executor(), Serve(GetSharedThis()), [](std::exception_ptr ex) {
+            if (!ex) {
+                return;
+            }
+            try {
+                std::rethrow_exception(ex);
+            } catch (const std::exception& e) {
+                Logger::LogError(0, e.what(), "session"sv);
+            } catch (...) {
+                Logger::LogError(0, "Unknown exception", "session"sv);
+            }
+        });
+        return;
+    }
     net::dispatch(stream_.get_executor(),
                   beast::bind_front_handler(&SessionBase::Read, GetSharedThis()));
 }
 
-void SessionBase::Read() {
+void SessionBase::PrepareRead() {
     using namespace std::literals;
-        
-    request_ = {};
+
+    // Предыдущий ответ отправлен, и всё, что выделялось под его запрос, больше не нужно
+    request_ = MakeRequest();
+    pending_response_.emplace<std::monostate>();
+    arena_.release();
     stream_.expires_after(30s);
+}
 
+bool SessionBase::BeginRequest() {
+    request_start_time_ = std::chrono::steady_clock::now();
+    ReportRequest(client_address_.to_string(),
+                  request_.target(),
+                  request_.method_string());
+
+    if (upgrade_handler_ && beast::websocket::is_upgrade(request_)) {
+        // Дальше соединением управляет WebSocket-сессия
+        upgrade_handler_(stream_.release_socket(), DetachRequest(request_));
+        return false;
+    }
+
+    WatchDisconnect();
+    return true;
+}
+
+bool SessionBase::FinishResponse(bool close, beast::error_code ec) {
+    beast::error_code cancel_ec;
+    stream_.socket().cancel(cancel_ec);
+
+    if (ec) {
+        ReportError(ec, "write"sv);
+        return false;
+    }
+
+    if (close) {
+        Close();
+        return false;
+    }
+
+    auto response_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - request_start_time_);
+    ReportResponse(client_address_.to_string(),
+                   response_time,
+                   response_status_,
+                   response_content_type_);
+    return true;
+}
+
+void SessionBase::Read() {
+    PrepareRead();
     http::async_read(stream_, buffer_, request_,
                      beast::bind_front_handler(&SessionBase::OnRead, GetSharedThis()));
 }
 
 void SessionBase::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read) {
-    using namespace std::literals;
     if (ec == http::error::end_of_stream) {
         return Close();
     }
@@ -45,12 +171,98 @@ void SessionBase::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t byte
         return ReportError(ec, "read"sv);
     }
 
-    request_start_time_ = std::chrono::steady_clock::now();
-    ReportRequest(stream_.socket().remote_endpoint().address().to_string(),
-                  request_.target(),
-                  request_.method_string());
-                  
-    HandleRequest(std::move(request_));
+    if (BeginRequest()) {
+        HandleRequest(std::move(request_));
+    }
+}
+
+net::awaitable<void> SessionBase::Serve(std::shared_ptr<SessionBase> self) {
+    // Ответ, который так и не пришёл, не должен держать сессию вечно
+    constexpr auto ResponseTimeout = std::chrono::seconds(60);
+
+    beast::error_code ec;
+    for (;;) {
+        PrepareRead();
+        co_await http::async_read(stream_, buffer_, request_, net::redirect_error(net::use_awaitable, ec));
+        if (ec == http::error::end_of_stream) {
+            co_return Close();
+        }
+        if (ec) {
+            co_return ReportError(ec, "read"sv);
+        }
+        if (!BeginRequest()) {
+            co_return;
+        }
+
+        HandleRequest(std::move(request_));
+        if (std::holds_alternative<std::monostate>(pending_response_)) {
+            // Ответ придёт позже из другого strand, Write отменит ожидание
+            response_ready_.expires_after(ResponseTimeout);
+            co_await response_ready_.async_wait(net::redirect_error(net::use_awaitable, ec));
+        }
+
+        if (std::holds_alternative<std::monostate>(pending_response_)) {
+            // Клиент отключился или ответа не дождались
+            co_return Close();
+        }
+
+        bool close = false;
+        ec = {};
+        if (auto* response = std::get_if<StringResponse>(&pending_response_)) {
+            close = response->need_eof();
+            co_await http::async_write(stream_, *response, net::redirect_error(net::use_awaitable, ec));
+        } else {
+            auto& file = std::get<FileResponse>(pending_response_);
+            close = file.header.need_eof();
+            co_await WriteFile(file, ec);
+        }
+        if (!FinishResponse(close, ec)) {
+            co_return;
+        }
+    }
+}
+
+net::awaitable<void> SessionBase::WriteFile(FileResponse& response, beast::error_code& ec) {
+    http::response_serializer<http::empty_body> serializer{response.header};
+    co_await http::async_write_header(stream_, serializer, net::redirect_error(net::use_awaitable, ec));
+    while (!ec && response.length > 0) {
+        switch (SendFileSome(response, ec)) {
+        case SendFileStatus::Partial:
+            co_await net::post(stream_.get_executor(), net::use_awaitable);
+            break;
+        case SendFileStatus::WouldBlock:
+            co_await stream_.socket().async_wait(tcp::socket::wait_write, net::redirect_error(net::use_awaitable, ec));
+            break;
+        case SendFileStatus::Done:
+        case SendFileStatus::Failed:
+            break;
+        }
+    }
+}
+
+void SessionBase::WatchDisconnect() {
+    // Обработчик выполняется в strand сессии, как и Write: Sender передаёт ответ туда через dispatch
+    stream_.socket().async_wait(tcp::socket::wait_read, [self = GetSharedThis()](beast::error_code ec) {
+        if (ec) {
+            // Ответ отправлен, и наблюдение отменено
+            return;
+        }
+        // Данные - это следующий запрос, его прочтут после ответа. Конец потока тоже не значит,
+        // что клиент ушёл: он мог лишь закончить отправку (half-close) и ждать ответа.
+        // Ушедшим считается только клиент, сбросивший соединение
+        auto& socket = self->stream_.socket();
+        char byte;
+        beast::error_code peek_ec;
+        socket.non_blocking(true, peek_ec);
+        if (!peek_ec) {
+            socket.receive(net::buffer(&byte, 1), tcp::socket::message_peek, peek_ec);
+        }
+        if (peek_ec && peek_ec != net::error::eof && peek_ec != net::error::would_block) {
+            self->abandoned_->store(true);
+            // Ответа для ушедшего клиента может и не быть, сопрограмме незачем его ждать
+            self->response_ready_.cancel();
+        }
+    });
 }
 
 void SessionBase::Close() {
@@ -62,21 +274,119 @@ void SessionBase::Close() {
 }
 
 void SessionBase::OnWrite(bool close, beast::error_code ec, [[maybe_unused]] std::size_t bytes_written) {
-    if (ec) {
-        return ReportError(ec, "write"sv);
+    if (FinishResponse(close, ec)) {
+        Read();
     }
+}
 
-    if (close) {
+StringRequest SessionBase::MakeRequest() {
+    return StringRequest{std::piecewise_construct, std::make_tuple(), std::make_tuple(&arena_)};
+}
+
+void SessionBase::RememberResponse(int status, bool has_content_length, std::string_view content_type) {
+    response_status_ = status;
+    response_content_type_ = has_content_length ? content_type : "null"sv;
+}
+
+void SessionBase::Write(StringResponse&& response) {
+    RememberResponse(response.result_int(), response.has_content_length(), response[http::field::content_type]);
+
+    if (coroutine_) {
+        pending_response_ = std::move(response);
+        response_ready_.cancel();
+        return;
+    }
+
+    // Ответы на одном соединении пишутся по очереди, поэтому ответу хватает места в самой сессии
+    write_response_ = std::move(response);
+    http::async_write(stream_, write_response_,
+                      [self = GetSharedThis()](beast::error_code ec, std::size_t bytes_written) {
+                          self->OnWrite(self->write_response_.need_eof(), ec, bytes_written);
+                      });
+}
+
+void SessionBase::Write(FileResponse&& response) {
+    RememberResponse(response.header.result_int(), response.header.has_content_length(),
+                     response.header[http::field::content_type]);
+
+    if (coroutine_) {
+        pending_response_ = std::move(response);
+        response_ready_.cancel();
+        return;
+    }
+
+    auto safe_response = std::make_shared<FileResponse>(std::move(response));
+    auto serializer = std::make_shared<http::response_serializer<http::empty_body>>(safe_response->header);
+    http::async_write_header(stream_, *serializer,
+                             [safe_response, serializer, self = GetSharedThis()](beast::error_code ec, std::size_t bytes_written) {
+                                 if (ec || safe_response->length == 0) {
+                                     return self->OnWrite(safe_response->header.need_eof(), ec, bytes_written);
+                                 }
+                                 self->SendFile(safe_response);
+                             });
+}
+
+void SessionBase::SendFile(std::shared_ptr<FileResponse> response) {
+    beast::error_code ec;
+    switch (SendFileSome(*response, ec)) {
+    case SendFileStatus::Done:
+        return OnWrite(response->header.need_eof(), {}, 0);
+    case SendFileStatus::Partial:
+        // Порция отправлена: уступаем поток другим сессиям и продолжаем
+        net::post(stream_.get_executor(), [response, self = GetSharedThis()]() {
+            self->SendFile(response);
+        });
+        return;
+    case SendFileStatus::WouldBlock:
+        // Буфер сокета заполнен: продолжим, когда клиент заберёт данные
+        stream_.socket().async_wait(tcp::socket::wait_write, [response, self = GetSharedThis()](beast::error_code ec) {
+            if (ec) {
+                return self->OnWrite(true, ec, 0);
+            }
+            self->SendFile(response);
+        });
+        return;
+    case SendFileStatus::Failed:
+        ReportError(ec, "sendfile"sv);
         return Close();
     }
+}
 
-    auto response_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - request_start_time_);
-    ReportResponse(stream_.socket().remote_endpoint().address().to_string(),
-                   response_time,
-                   response_.result_int(),
-                   response_.has_content_length() ? response_["Content-Type"] : "null"sv);
+SessionBase::SendFileStatus SessionBase::SendFileSome(FileResponse& response, beast::error_code& ec) {
+#ifdef __linux__
+    // За один вызов отправляем не больше этого, чтобы не держать поток на одном быстром клиенте
+    constexpr uint64_t MaxChunkSize = 1 << 20;
 
-    Read();
+    auto& socket = stream_.socket();
+    socket.non_blocking(true);
+    for (uint64_t chunk = std::min(response.length, MaxChunkSize); chunk > 0;) {
+        off_t offset = static_cast<off_t>(response.offset);
+        const auto sent = ::sendfile(socket.native_handle(), response.fd, &offset, chunk);
+        if (sent > 0) {
+            response.offset += sent;
+            response.length -= sent;
+            chunk -= sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return SendFileStatus::WouldBlock;
+        }
+        // 0 - файл стал короче, чем был при индексации. Длина уже объявлена, поэтому соединение закрывается
+        ec = sent < 0 ? beast::error_code{errno, sys::system_category()} : beast::error_code{net::error::eof};
+        return SendFileStatus::Failed;
+    }
+    if (response.length > 0) {
+        return SendFileStatus::Partial;
+    }
+    return SendFileStatus::Done;
+#else
+    (void)response;
+    ec = net::error::operation_not_supported;
+    return SendFileStatus::Failed;
+#endif
 }
 
 }  // namespace http_server
@@ -3,12 +3,22 @@
 // boost.beast будет использовать std::string_view вместо boost::string_view
 #define BOOST_BEAST_USE_STD_STRING_VIEW
 
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/dispatch.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
 #include <iostream>
+#include <memory_resource>
+#include <stdexcept>
 #include <variant>
 
 
@@ -18,7 +28,50 @@ namespace sys = boost::system;
 namespace beast = boost::beast;
 namespace http = beast::http;
 
-using StringRequest = http::request<http::string_body>;
+// Аллокатор заголовков запроса. Сессия читает запрос в свою арену, остальные запросы и все копии
+// используют обычную кучу. В отличие от std::pmr::polymorphic_allocator допускает присваивание,
+// которого требует Beast
+template <typename T>
+class RequestAllocator {
+public:
+    using value_type = T;
+
+    RequestAllocator() noexcept = default;
+    RequestAllocator(std::pmr::memory_resource* resource) noexcept
+        : resource_{resource} {
+    }
+    template <typename U>
+    RequestAllocator(const RequestAllocator<U>& other) noexcept
+        : resource_{other.GetResource()} {
+    }
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(resource_->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* ptr, std::size_t n) noexcept {
+        resource_->deallocate(ptr, n * sizeof(T), alignof(T));
+    }
+
+    // Копия запроса не должна ссылаться на арену сессии
+    RequestAllocator select_on_container_copy_construction() const noexcept {
+        return {};
+    }
+
+    std::pmr::memory_resource* GetResource() const noexcept {
+        return resource_;
+    }
+
+    template <typename U>
+    bool operator==(const RequestAllocator<U>& other) const noexcept {
+        return resource_ == other.GetResource();
+    }
+
+private:
+    std::pmr::memory_resource* resource_ = std::pmr::new_delete_resource();
+};
+
+using RequestFields = http::basic_fields<RequestAllocator<char>>;
+using StringRequest = http::request<http::string_body, RequestFields>;
 using StringResponse = http::response<http::string_body>;
 
 
@@ -26,6 +79,86 @@ namespace http_server {
 
 void ReportError(beast::error_code ec, std::string_view what);
 
+// Отвечает 503 с Retry-After соединению, для которого нет места, и закрывает его
+void RejectConnection(tcp::socket&& socket);
+
+// Копия запроса в общей куче. Нужна тем, кто хранит запрос дольше, чем длится ответ на него:
+// арена сессии очищается перед чтением следующего запроса
+StringRequest DetachRequest(const StringRequest& request);
+
+// Ответ, тело которого уходит из файла в сокет вызовом sendfile, без копирования в память процесса.
+// В заголовке должна быть указана длина. length == 0 - только заголовок (ответ на HEAD)
+struct FileResponse {
+    http::response<http::empty_body> header;
+    int fd = -1;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    // Владелец дескриптора: файл не закроется, пока ответ не отправлен
+    std::shared_ptr<const void> keeper;
+};
+
+// Обработчик запросов на переход к протоколу WebSocket. Получает сокет во владение
+using UpgradeHandler = std::function<void(tcp::socket&&, StringRequest&&)>;
+
+// Число открытых HTTP-сессий. Общее для слушателя и его сессий
+using SessionCounter = std::shared_ptr<std::atomic<size_t>>;
+
+// Поднимается, когда клиент отключился, не дождавшись ответа
+using AbandonFlag = std::shared_ptr<const std::atomic_bool>;
+
+struct ListenOptions {
+    // Сколько HTTP-сессий может быть открыто одновременно, 0 - без ограничения.
+    // Сверх него соединение получает 503 и закрывается, не дожидаясь запроса
+    size_t max_sessions = 0;
+    // Счётчик открытых сессий, общий для нескольких слушателей. Если не задан, у слушателя свой
+    SessionCounter sessions;
+    // Несколько слушателей на одном порту (SO_REUSEPORT), ядро распределяет соединения между ними
+    bool reuse_port = false;
+    // Сессии на сопрограммах: чтение, обработка и запись идут в одном кадре сопрограммы,
+    // а не цепочкой обработчиков
+    bool coroutines = false;
+};
+
+#ifdef SO_REUSEPORT
+// Опция SO_REUSEPORT для set_option: в Asio для неё нет готового типа
+class ReusePort {
+public:
+    explicit ReusePort(bool enabled)
+        : value_{enabled ? 1 : 0} {
+    }
+
+    template <typename Protocol>
+    int level(const Protocol&) const {
+        return SOL_SOCKET;
+    }
+
+    template <typename Protocol>
+    int name(const Protocol&) const {
+        return SO_REUSEPORT;
+    }
+
+    template <typename Protocol>
+    const void* data(const Protocol&) const {
+        return &value_;
+    }
+
+    template <typename Protocol>
+    std::size_t size(const Protocol&) const {
+        return sizeof(value_);
+    }
+
+private:
+    int value_;
+};
+#endif
+
+/*
+ *  HTTP-сессия: читает запросы один за другим и отправляет ответы в том же порядке.
+ *  Работает в одном из двух режимов:
+ *   - цепочка обработчиков: каждый шаг (чтение, запись) - отдельный обработчик завершения;
+ *   - сопрограмма (coroutine == true): весь цикл чтение-обработка-запись - один кадр сопрограммы,
+ *     память обработчиков переиспользуется. Ответ из другого strand будит сопрограмму через таймер.
+ */
 class SessionBase {
 public:
     SessionBase(const SessionBase&) = delete;
@@ -34,39 +167,95 @@ public:
     void Run();
 
 protected:
-    explicit SessionBase(tcp::socket&& socket)
-        : stream_(std::move(socket)) {
+    explicit SessionBase(tcp::socket&& socket, UpgradeHandler upgrade_handler, SessionCounter sessions, bool coroutine)
+        : stream_(std::move(socket))
+        , upgrade_handler_(std::move(upgrade_handler))
+        , sessions_(std::move(sessions))
+        , coroutine_(coroutine)
+        , request_(MakeRequest()) {
+        beast::error_code ec;
+        client_address_ = stream_.socket().remote_endpoint(ec).address();
+        if (sessions_) {
+            ++*sessions_;
+        }
     }
 
-    ~SessionBase() = default;
-
-    template <typename Body, typename Fields>
-    void Write(http::response<Body, Fields>&& response) {
-        response_ = response;
-        auto safe_response = std::make_shared<http::response<Body, Fields>>(std::move(response));
+    ~SessionBase() {
+        if (sessions_) {
+            --*sessions_;
+        }
+    }
 
-        auto self = GetSharedThis();
-        http::async_write(stream_, *safe_response,
-                          [safe_response, self](beast::error_code ec, std::size_t bytes_written) {
-                              self->OnWrite(safe_response->need_eof(), ec, bytes_written);
-                          });
+    AbandonFlag GetAbandonFlag() const {
+        return abandoned_;
+    }
+    const net::ip::address& GetClientAddress() const {
+        return client_address_;
     }
+    auto GetExecutor() {
+        return stream_.get_executor();
+    }
+
+    // Вызываются в strand сессии
+    void Write(StringResponse&& response);
+    void Write(FileResponse&& response);
 
 private:
+    // Partial - отправлена часть, остальное после других обработчиков потока
+    enum class SendFileStatus { Done, Partial, WouldBlock, Failed };
+
     void Read();
     void OnRead(beast::error_code ec, std::size_t bytes_read);
 
+    net::awaitable<void> Serve(std::shared_ptr<SessionBase> self);
+    net::awaitable<void> WriteFile(FileResponse& response, beast::error_code& ec);
+
     virtual std::shared_ptr<SessionBase> GetSharedThis() = 0;
-    
+
+    // Общее для обоих режимов
+    void PrepareRead();
+    // false, если соединение перешло к WebSocket-сессии
+    bool BeginRequest();
+    // false, если соединение пора закрыть
+    bool FinishResponse(bool close, beast::error_code ec);
+
     void Close();
+    // Пока запрос обрабатывается, сессия не читает сокет. Чтобы заметить отключение клиента,
+    // она ждёт готовности сокета к чтению: пустой сокет после этого означает, что соединение закрыто
+    void WatchDisconnect();
     void OnWrite(bool close, beast::error_code ec, std::size_t bytes_written);
+    // Для журнала запоминается только то, что в него попадёт, а не весь ответ
+    void RememberResponse(int status, bool has_content_length, std::string_view content_type);
+    void SendFile(std::shared_ptr<FileResponse> response);
+    // Отправляет из файла не больше одной порции, сколько сокет примет без ожидания
+    SendFileStatus SendFileSome(FileResponse& response, beast::error_code& ec);
 
     virtual void HandleRequest(StringRequest&& request) = 0;
 
+    // Пустой запрос, заголовки которого будут размещены в арене
+    StringRequest MakeRequest();
+
+    // Размер буфера арены. Заголовки типичного запроса в него помещаются, больший запрос
+    // берёт недостающее из кучи до конца ответа
+    static constexpr size_t ArenaSize = 4096;
+
     beast::tcp_stream stream_;
+    UpgradeHandler upgrade_handler_;
+    SessionCounter sessions_;
+    bool coroutine_;
+    // Запоминается при подключении: после отключения клиента сокет адреса уже не знает
+    net::ip::address client_address_;
+    std::shared_ptr<std::atomic_bool> abandoned_ = std::make_shared<std::atomic_bool>(false);
     beast::flat_buffer buffer_;
+    std::array<std::byte, ArenaSize> arena_buffer_;
+    std::pmr::monotonic_buffer_resource arena_{arena_buffer_.data(), arena_buffer_.size()};
     StringRequest request_;
-    StringResponse response_;
+    StringResponse write_response_;
+    // Режим сопрограммы: ответ, переданный обработчиком, и таймер, отмена которого будит сопрограмму
+    std::variant<std::monostate, StringResponse, FileResponse> pending_response_;
+    net::steady_timer response_ready_{stream_.get_executor()};
+    int response_status_ = 0;
+    std::string response_content_type_;
     std::chrono::time_point<std::chrono::steady_clock> request_start_time_;
 };
 
@@ -74,20 +263,45 @@ template <typename RequestHandler>
 class Session : public SessionBase, public std::enable_shared_from_this<Session<RequestHandler>> {
 public:
     template <typename Handler>
-    Session(tcp::socket&& socket, Handler&& request_handler)
-        : SessionBase(std::move(socket))
+    Session(tcp::socket&& socket, Handler&& request_handler, UpgradeHandler upgrade_handler, SessionCounter sessions,
+            bool coroutine)
+        : SessionBase(std::move(socket), std::move(upgrade_handler), std::move(sessions), coroutine)
         , request_handler_(std::forward<Handler>(request_handler)) {
     }
 
 private:
+    // Отправляет ответ в сессию. Обработчик может узнать у него адрес клиента, то, ждёт ли клиент ответа,
+    // и executor сессии
+    struct Sender {
+        std::shared_ptr<Session> self;
+
+        template <typename Response>
+        void operator()(Response&& response) const {
+            // Ответ может прийти из strand игры, а сокет сессии трогается только из её собственного strand
+            net::dispatch(self->GetExecutor(), [self = self, response = std::move(response)]() mutable {
+                self->Write(std::move(response));
+            });
+        }
+
+        auto GetExecutor() const {
+            return self->GetExecutor();
+        }
+
+        AbandonFlag GetAbandonFlag() const {
+            return self->GetAbandonFlag();
+        }
+
+        const net::ip::address& GetClientAddress() const {
+            return self->GetClientAddress();
+        }
+    };
+
     std::shared_ptr<SessionBase> GetSharedThis() override {
         return this->shared_from_this();
     }    
 
     void HandleRequest(StringRequest&& request) override {
-        request_handler_(std::move(request), [self = this->shared_from_this()](auto&& response) {
-            self->Write(std::move(response));
-        });
+        request_handler_(std::move(request), Sender{this->shared_from_this()});
     }
 
     RequestHandler request_handler_;
@@ -97,12 +311,24 @@ template <typename RequestHandler>
 class Listener : public std::enable_shared_from_this<Listener<RequestHandler>> {
 public:
     template <typename Handler>
-    Listener(net::io_context& ioc, const tcp::endpoint& endpoint, Handler&& request_handler)
+    Listener(net::io_context& ioc, const tcp::endpoint& endpoint, Handler&& request_handler, UpgradeHandler upgrade_handler,
+             ListenOptions options)
     : ioc_(ioc)
     , acceptor_(net::make_strand(ioc))
-    , request_handler_(std::forward<Handler>(request_handler)) {
+    , request_handler_(std::forward<Handler>(request_handler))
+    , upgrade_handler_(std::move(upgrade_handler))
+    , max_sessions_(options.max_sessions)
+    , coroutines_(options.coroutines)
+    , sessions_(options.sessions ? std::move(options.sessions) : std::make_shared<std::atomic<size_t>>(0)) {
         acceptor_.open(endpoint.protocol());
         acceptor_.set_option(net::socket_base::reuse_address(true));
+        if (options.reuse_port) {
+#ifdef SO_REUSEPORT
+            acceptor_.set_option(ReusePort{true});
+#else
+            throw std::runtime_error("SO_REUSEPORT is not supported on this platform");
+#endif
+        }
         acceptor_.bind(endpoint);
         acceptor_.listen(net::socket_base::max_listen_connections);
     }
@@ -125,24 +351,37 @@ private:
         if (ec) {
             return ReportError(ec, "accept"sv);
         }
-        AsyncRunSession(std::move(socket));
+        if (max_sessions_ && *sessions_ >= max_sessions_) {
+            RejectConnection(std::move(socket));
+        } else {
+            AsyncRunSession(std::move(socket));
+        }
         DoAccept();
     }
 
     void AsyncRunSession(tcp::socket&& socket) {
-        std::make_shared<Session<RequestHandler>>(std::move(socket), request_handler_)->Run();
+        std::make_shared<Session<RequestHandler>>(std::move(socket), request_handler_, upgrade_handler_, sessions_,
+                                                  coroutines_)->Run();
     }
     
     net::io_context& ioc_;
     tcp::acceptor acceptor_;
     RequestHandler request_handler_;
+    UpgradeHandler upgrade_handler_;
+    size_t max_sessions_;
+    bool coroutines_;
+    SessionCounter sessions_;
 };
 
+// Если upgrade_handler не задан, запросы на переход к WebSocket обрабатываются как обычные HTTP-запросы.
+// Сессии работают в strand того io_context, слушатель которого принял соединение
 template <typename RequestHandler>
-void ServeHttp(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler) {
+void ServeHttp(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler,
+               UpgradeHandler upgrade_handler = {}, ListenOptions options = {}) {
     using MyListener = Listener<std::decay_t<RequestHandler>>;
 
-    std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler))->Run();
+    std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler), std::move(upgrade_handler),
+                                 std::move(options))->Run();
 }
 
 }  // namespace http_server
@@ -1,6 +1,7 @@
 #include "json_loader.h"
 #include "constants.h"
 
+#include <algorithm>
 #include <fstream>
 
 using namespace model;
@@ -27,6 +28,22 @@ json::object GetRootJsonObject(const std::filesystem::path& json_path) {
     return jroot.as_object();
 }
 
+json::object SelectMaps(json::object jroot, const std::vector<std::string>& map_ids) {
+    json::array selected;
+    for (const auto& map_id : map_ids) {
+        const auto& jmaps = jroot.at(MAPS).as_array();
+        auto it = std::find_if(jmaps.begin(), jmaps.end(), [&map_id](const json::value& jmap) {
+            return jmap.at(ID).as_string() == map_id;
+        });
+        if (it == jmaps.end()) {
+            throw std::invalid_argument("Map " + map_id + " not found in config");
+        }
+        selected.push_back(*it);
+    }
+    jroot[MAPS] = std::move(selected);
+    return jroot;
+}
+
 int get_int(const json::value& value) {
     return static_cast<int>(value.as_int64());
 }
@@ -90,6 +107,17 @@ void LoadBagCapacity(const auto& jmap, auto& map, int default_capacity) {
     }
 }
 
+void LoadPlayerCap(const auto& jmap, auto& map, int default_cap) {
+    int cap = default_cap;
+    if (jmap.as_object().contains("maxPlayers")) {
+        cap = get_int(jmap.at("maxPlayers"));
+    }
+    if (cap < 0) {
+        throw std::invalid_argument("maxPlayers should not be negative");
+    }
+    map.SetPlayerCap(static_cast<size_t>(cap));
+}
+
 model::Game LoadGame(const json::object& jroot) {
     model::Game game{};
 
@@ -108,6 +136,12 @@ model::Game LoadGame(const json::object& jroot) {
         dog_retirement_time_s = jroot.at("dogRetirementTime").as_double();
     }
 
+    // Сколько игроков помещается в экземпляр карты, 0 - без ограничений
+    int default_max_players = 0;
+    if (jroot.contains("defaultMaxPlayers")) {
+        default_max_players = get_int(jroot.at("defaultMaxPlayers"));
+    }
+
     const auto& jmaps = jroot.at(MAPS);
     for (const auto& jmap : jmaps.as_array()) {
 
@@ -116,10 +150,12 @@ model::Game LoadGame(const json::object& jroot) {
         Map map{id, std::move(name)};
 
         LoadRoads(jmap, map);
+        map.BuildRoadGraph();
         LoadBuildings(jmap, map);
         LoadOffices(jmap, map);
         LoadDogSpeed(jmap, map, default_dog_speed);
         LoadBagCapacity(jmap, map, default_bag_capacity);
+        LoadPlayerCap(jmap, map, default_max_players);
         map.SetDogRetirementTime(dog_retirement_time_s);
 
         game.AddMap(map);
@@ -144,6 +180,44 @@ loot::Generator LoadLootGenerator(const json::object& jroot) {
     return {period_ms, probability};
 }
 
+RateLimit LoadRateLimit(const json::object& jlimit) {
+    RateLimit limit;
+    if (jlimit.contains("rate")) {
+        limit.rate = jlimit.at("rate").to_number<double>();
+    }
+    if (jlimit.contains("burst")) {
+        limit.burst = jlimit.at("burst").to_number<double>();
+    }
+    if (limit.rate < 0 || limit.burst < 0) {
+        throw std::invalid_argument("Rate limits should not be negative");
+    }
+    return limit;
+}
+
+RateLimits LoadRateLimits(const json::object& jroot) {
+    RateLimits limits;
+    if (!jroot.contains("rateLimits")) {
+        return limits;
+    }
+    const auto& jlimits = jroot.at("rateLimits").as_object();
+    if (jlimits.contains("perToken")) {
+        limits.per_token = LoadRateLimit(jlimits.at("perToken").as_object());
+    }
+    if (jlimits.contains("perIp")) {
+        limits.per_ip = LoadRateLimit(jlimits.at("perIp").as_object());
+    }
+    if (jlimits.contains("trustedProxies")) {
+        for (const auto& jproxy : jlimits.at("trustedProxies").as_array()) {
+            boost::system::error_code ec;
+            limits.trusted_proxies.push_back(boost::asio::ip::make_address(jproxy.as_string().c_str(), ec));
+            if (ec) {
+                throw std::invalid_argument("Invalid trusted proxy address");
+            }
+        }
+    }
+    return limits;
+}
+
 loot::Data LoadLootData(const json::object& jroot) {
     auto maps = jroot.at(MAPS).as_array();
 
@@ -3,9 +3,12 @@
 #include "model/model.h"
 #include "app/loot_data.h"
 #include "app/loot_generator.h"
+#include "rate_limiter.h"
 
 #include <boost/json.hpp>
 #include <filesystem>
+#include <string>
+#include <vector>
 
 
 namespace json = boost::json;
@@ -13,9 +16,14 @@ namespace json = boost::json;
 namespace json_loader {
 
 json::object GetRootJsonObject(const std::filesystem::path& json_path);
+// Оставляет в конфиге только карты map_ids: шард загружает лишь те карты, которыми владеет
+json::object SelectMaps(json::object jroot, const std::vector<std::string>& map_ids);
 
 model::Game LoadGame(const json::object& jroot);
 loot::Generator LoadLootGenerator(const json::object& jroot);
 loot::Data LoadLootData(const json::object& jroot);
+// "rateLimits": {"perToken": {"rate": 20, "burst": 40}, "perIp": {...}, "trustedProxies": ["10.0.0.1"]}.
+// Без раздела - без ограничений
+RateLimits LoadRateLimits(const json::object& jroot);
 
 }  // namespace json_loader
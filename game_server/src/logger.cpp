@@ -86,3 +86,30 @@ void Logger::LogError(int code, const std::string& text, std::string_view where)
     };
     Logger::GetInstance().Log(logging::trivial::error, "error", data);
 }
+
+void Logger::LogTickStats(int64_t period_ms, uint64_t ticks, uint64_t overruns, uint64_t merged, uint64_t dropped,
+                          const std::vector<std::pair<std::string_view, uint64_t>>& durations) {
+    json::object histogram;
+    for (const auto& [bucket, count] : durations) {
+        histogram[bucket] = count;
+    }
+    json::object data{
+        {"period_ms", period_ms},
+        {"ticks", ticks},
+        {"overruns", overruns},
+        {"merged", merged},
+        {"dropped", dropped},
+        {"durations", histogram}
+    };
+    Logger::GetInstance().Log(logging::trivial::info, "tick stats", data);
+}
+
+void Logger::LogLoadStats(uint64_t queue_depth, uint64_t peak_queue_depth, uint64_t shed, int64_t tick_lag_ms) {
+    json::object data{
+        {"queue_depth", queue_depth},
+        {"peak_queue_depth", peak_queue_depth},
+        {"shed", shed},
+        {"tick_lag_ms", tick_lag_ms}
+    };
+    Logger::GetInstance().Log(logging::trivial::info, "load stats", data);
+}
@@ -16,6 +16,8 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <iostream>
 #include <sstream>
+#include <utility>
+#include <vector>
 
 namespace logging = boost::log;
 namespace json = boost::json;
@@ -37,6 +39,13 @@ public:
     static void LogRequestReceived(const std::string& ip, std::string_view uri, std::string_view method);
     static void LogResponseSent(const std::string& ip, int response_time, int code, std::string_view content_type);
     static void LogError(int code, const std::string& text, std::string_view where);
+    // merged - тики, время которых вошло в delta следующего, dropped - тики, потерянные вместе со временем.
+    // durations - число тиков в каждой корзине гистограммы длительности
+    static void LogTickStats(int64_t period_ms, uint64_t ticks, uint64_t overruns, uint64_t merged, uint64_t dropped,
+                             const std::vector<std::pair<std::string_view, uint64_t>>& durations);
+    // queue_depth - очередь strand игры сейчас, peak_queue_depth и shed - наибольшая очередь
+    // и число отклонённых при перегрузке запросов с прошлой записи
+    static void LogLoadStats(uint64_t queue_depth, uint64_t peak_queue_depth, uint64_t shed, int64_t tick_lag_ms);
 
 private:
     Logger() {
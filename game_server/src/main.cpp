@@ -2,14 +2,24 @@
 #include <boost/asio/signal_set.hpp>
 
 #include <iostream>
+#include <memory>
 #include <thread>
 #include <cstdlib>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #include "sdk.h"
 #include "parser.h"
 #include "json_loader.h"
 #include "request_handler.h"
+#include "static_cache.h"
 #include "api_handler.h"
+#include "bot_fleet.h"
+#include "shard_router.h"
 #include "logger.h"
 #include "state_storage.h"
 #include "db/database.h"
@@ -33,6 +43,81 @@ void RunWorkers(unsigned n, const Fn& fn) {
     fn();
 }
 
+using IoContexts = std::vector<std::unique_ptr<net::io_context>>;
+
+// Привязывает текущий поток к ядру. Потоки сверх числа ядер не привязываются: по кругу
+// они попали бы на ядро 0 к потоку игры
+void PinThread(unsigned core) {
+#ifdef __linux__
+    if (core >= std::thread::hardware_concurrency()) {
+        return;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    if (const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)) {
+        Logger::LogError(error, "Failed to pin thread to core " + std::to_string(core), "affinity"sv);
+    }
+#else
+    (void)core;
+#endif
+}
+
+// Игра в своём потоке и по потоку на каждый io_context соединений. При pin поток игры
+// занимает ядро 0, потоки соединений - следующие ядра, если они есть
+void RunPerCore(net::io_context& game_ioc, const IoContexts& io_contexts, bool pin) {
+    std::vector<std::jthread> workers;
+    workers.reserve(io_contexts.size());
+    for (size_t i = 0; i < io_contexts.size(); ++i) {
+        workers.emplace_back([&ioc = *io_contexts[i], core = static_cast<unsigned>(i + 1), pin] {
+            if (pin) {
+                PinThread(core);
+            }
+            ioc.run();
+        });
+    }
+    if (pin) {
+        PinThread(0);
+    }
+    game_ioc.run();
+}
+
+// Режим маршрутизатора: игра не ведётся, запросы пересылаются процессам-шардам
+int RunRouter(const parser::Args& args) {
+    const unsigned num_threads = std::thread::hardware_concurrency();
+    net::io_context ioc(num_threads);
+
+    std::vector<shard_router::Shard> shards;
+    for (const auto& spec : args.shards) {
+        shards.push_back(shard_router::ParseShard(spec));
+    }
+    shard_router::Router router{ioc, shards, json_loader::GetRootJsonObject(args.config_file)};
+
+    const auto address = net::ip::make_address(args.address);
+    const auto port = static_cast<net::ip::port_type>(args.port);
+    http_server::ServeHttp(ioc, {address, port}, [&router](auto&& req, auto&& send) {
+        // Запрос ждёт ответа шарда, поэтому не должен зависеть от арены сессии
+        router(http_server::DetachRequest(req), send.GetClientAddress(), [send](StringResponse response) {
+            send(std::move(response));
+        });
+    }, [&router](tcp::socket&& socket, StringRequest&& req) {
+        router.HandleUpgrade(std::move(socket), std::move(req));
+    }, {static_cast<size_t>(args.max_sessions), nullptr, false, args.coroutine_sessions});
+
+    net::signal_set signals(ioc, SIGINT, SIGTERM);
+    signals.async_wait([&ioc](const sys::error_code& ec, [[maybe_unused]] int signal_number) {
+        ioc.stop();
+        Logger::LogServerStop(EXIT_SUCCESS, ec ? ec.message() : std::string{});
+    });
+
+    Logger::LogServerStart(address.to_string(), port);
+
+    RunWorkers(std::max(1u, num_threads), [&ioc] {
+        ioc.run();
+    });
+    return EXIT_SUCCESS;
+}
+
 }  // namespace
 
 int main(int argc, const char* argv[]) {
@@ -44,6 +129,15 @@ int main(int argc, const char* argv[]) {
         return EXIT_FAILURE;
     }
 
+    if (args.router) {
+        try {
+            return RunRouter(args);
+        } catch (const std::exception& ex) {
+            std::cerr << ex.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
     const char* db_url = std::getenv(DB_URL_ENV_NAME);
     if (!db_url) {
         std::cout << DB_URL_ENV_NAME + " environment variable not found"s << std::endl;
@@ -51,32 +145,80 @@ int main(int argc, const char* argv[]) {
     }    
     try {
         const unsigned num_threads = std::thread::hardware_concurrency();
-        net::io_context ioc(num_threads);
+        // С --io-contexts соединения обслуживают отдельные однопоточные io_context, а в ioc остаются
+        // только игра и её таймеры. Соединения меняют состояние игры лишь через strand ApiHandler,
+        // а вне его только ищут игрока по токену (App::FindPlayer) и кладут команды в очередь
+        const bool per_core = args.io_contexts > 0;
+        net::io_context ioc(per_core ? 1 : num_threads);
+        IoContexts io_contexts;
+        for (int i = 0; i < args.io_contexts; ++i) {
+            io_contexts.push_back(std::make_unique<net::io_context>(1));
+        }
 
         auto json_object = json_loader::GetRootJsonObject(args.config_file);
+        if (args.shard_id >= 0) {
+            json_object = json_loader::SelectMaps(std::move(json_object), shard_router::SplitMapIds(args.shard_maps));
+        }
         auto game = json_loader::LoadGame(json_object);
         auto loot_generator = json_loader::LoadLootGenerator(json_object);
         auto loot_data = json_loader::LoadLootData(json_object);
 
         App app{args.randomize_spawn_point};
+        if (args.shard_id >= 0) {
+            app.SetShard(args.shard_id);
+        }
         StateStorage storage(args.state_file, args.save_state_period_ms, game, app);
         storage.Read();
 
-        Database db_{db_url};
-
-        ApiHandler api_handler{ioc, game, app, storage, loot_generator, loot_data, db_, args.tick_time_ms};
-        http_handler::RequestHandler handler{args.static_folder, api_handler};
-
-        const auto address = net::ip::make_address("0.0.0.0");
-        constexpr net::ip::port_type port = 8080;
-        http_server::ServeHttp(ioc, {address, port}, [&handler](auto&& req, auto&& send) {
-            handler(std::forward<decltype(req)>(req), std::forward<decltype(send)>(send));
-        });
+        PostgresDatabase db_{db_url};
+
+        const StagePeriods stage_periods{args.publish_period_ms, args.retire_period_ms};
+        ApiHandler api_handler{ioc, game, app, storage, loot_generator, loot_data, db_, args.tick_time_ms,
+                                 args.tick_catch_up, stage_periods};
+        api_handler.SetLoadLimits({static_cast<size_t>(args.max_queue_depth), std::chrono::milliseconds(args.max_tick_lag_ms)});
+        // Перечитывание статики и сжатие ответов не для сессий HTTP не должны занимать поток игры
+        net::io_context& io_ioc = per_core ? *io_contexts.front() : ioc;
+        StaticCache static_cache{args.static_folder};
+        if (args.watch_static) {
+            static_cache.Watch(io_ioc);
+        }
+        http_handler::RequestHandler handler{io_ioc, static_cache, api_handler, json_loader::LoadRateLimits(json_object)};
+
+        if (args.bots_per_map > 0) {
+            auto bots = std::make_shared<BotFleet>(ioc, app, std::chrono::milliseconds(args.bot_move_period_ms),
+                                                   args.bot_script);
+            api_handler.AddBots(args.bots_per_map, [bots](std::vector<int> bot_ids) {
+                bots->Start(std::move(bot_ids));
+            });
+        }
+
+        const auto address = net::ip::make_address(args.address);
+        const auto port = static_cast<net::ip::port_type>(args.port);
+        const auto serve = [&](net::io_context& context, http_server::ListenOptions options) {
+            http_server::ServeHttp(context, {address, port}, [&handler](auto&& req, auto&& send) {
+                handler(std::forward<decltype(req)>(req), std::forward<decltype(send)>(send));
+            }, [&handler](tcp::socket&& socket, StringRequest&& req) {
+                handler.HandleUpgrade(std::move(socket), std::move(req));
+            }, std::move(options));
+        };
+        const auto max_sessions = static_cast<size_t>(args.max_sessions);
+        if (per_core) {
+            // Ограничение на число сессий общее для всех слушателей
+            auto sessions = std::make_shared<std::atomic<size_t>>(0);
+            for (auto& context : io_contexts) {
+                serve(*context, {max_sessions, sessions, true, args.coroutine_sessions});
+            }
+        } else {
+            serve(ioc, {max_sessions, nullptr, false, args.coroutine_sessions});
+        }
 
         net::signal_set signals(ioc, SIGINT, SIGTERM);
-        signals.async_wait([&ioc, &storage](const sys::error_code& ec, [[maybe_unused]] int signal_number) {
+        signals.async_wait([&ioc, &io_contexts, &storage](const sys::error_code& ec, [[maybe_unused]] int signal_number) {
             if (!ec) {
                 ioc.stop();
+                for (auto& context : io_contexts) {
+                    context->stop();
+                }
                 Logger::LogServerStop(EXIT_FAILURE, ec.message());
             }
             else {
@@ -87,9 +229,13 @@ int main(int argc, const char* argv[]) {
 
         Logger::LogServerStart(address.to_string(), port);
 
-        RunWorkers(std::max(1u, num_threads), [&ioc] {
-            ioc.run();
-        });
+        if (per_core) {
+            RunPerCore(ioc, io_contexts, args.pin_threads);
+        } else {
+            RunWorkers(std::max(1u, num_threads), [&ioc] {
+                ioc.run();
+            });
+        }
     } catch (const std::exception& ex) {
         std::cerr << ex.what() << std::endl;
         return EXIT_FAILURE;
@@ -4,6 +4,7 @@
 
 #include <optional>
 #include <string>
+#include <vector>
 #include <iostream>
 #include <stdexcept>
 
@@ -12,10 +13,29 @@ namespace parser {
 struct Args {
     std::string config_file;
     std::string static_folder;
+    bool watch_static = false;
     int tick_time_ms;
+    int tick_catch_up = 0;
     bool randomize_spawn_point;
     std::string state_file;
     int save_state_period_ms;
+    int publish_period_ms = 0;
+    int retire_period_ms = 0;
+    int bots_per_map = 0;
+    int bot_move_period_ms = 1000;
+    std::string bot_script;
+    std::string address = "0.0.0.0";
+    int port = 8080;
+    int max_sessions = 0;
+    int max_queue_depth = 0;
+    int max_tick_lag_ms = 0;
+    int io_contexts = 0;
+    bool pin_threads = false;
+    bool coroutine_sessions = false;
+    int shard_id = -1;
+    std::string shard_maps;
+    bool router = false;
+    std::vector<std::string> shards;
 };
 
 [[nodiscard]] std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
@@ -28,11 +48,30 @@ struct Args {
     desc.add_options()
         ("help,h", "produce help message")
         ("tick-period,t", po::value(&args.tick_time_ms)->value_name("milliseconds"s), "set tick period")
+        ("tick-catch-up", po::value(&args.tick_catch_up)->value_name("ticks"s), "run up to this many missed ticks (0 - merge them into one)")
         ("config-file,c", po::value(&args.config_file)->value_name("file"s), "set config file path")
         ("www-root,w", po::value(&args.static_folder)->value_name("dir"s), "set static folder")
+        ("watch-static", po::bool_switch(&args.watch_static), "reload static files when they change (inotify)")
         ("state-file", po::value(&args.state_file)->value_name("file"s), "set state file path")
         ("save-state-period", po::value(&args.save_state_period_ms)->value_name("milliseconds"s), "game time")
-        ("randomize-spawn-points", po::bool_switch(&args.randomize_spawn_point), "spawn dogs at random positions");
+        ("publish-period", po::value(&args.publish_period_ms)->value_name("milliseconds"s), "game time between state broadcasts (0 - every tick)")
+        ("retire-period", po::value(&args.retire_period_ms)->value_name("milliseconds"s), "game time between removals of retired players (0 - every tick)")
+        ("randomize-spawn-points", po::bool_switch(&args.randomize_spawn_point), "spawn dogs at random positions")
+        ("bots", po::value(&args.bots_per_map)->value_name("count"s), "add synthetic players to every map")
+        ("bot-move-period", po::value(&args.bot_move_period_ms)->value_name("milliseconds"s), "set how often bots change direction")
+        ("bot-script", po::value(&args.bot_script)->value_name("moves"s), "repeat moves (L, R, U, D, S) instead of random ones")
+        ("address", po::value(&args.address)->value_name("ip"s), "set listen address")
+        ("port,p", po::value(&args.port)->value_name("port"s), "set listen port")
+        ("max-sessions", po::value(&args.max_sessions)->value_name("count"s), "answer 503 to connections above this many open sessions (0 - no limit)")
+        ("max-queue-depth", po::value(&args.max_queue_depth)->value_name("handlers"s), "shed non-critical requests while the game strand queue is this deep (0 - no limit)")
+        ("max-tick-lag", po::value(&args.max_tick_lag_ms)->value_name("milliseconds"s), "shed non-critical requests while the tick is this late (0 - no limit)")
+        ("io-contexts", po::value(&args.io_contexts)->value_name("count"s), "serve connections from this many single-threaded io_contexts with SO_REUSEPORT acceptors, the game gets its own thread (0 - one shared io_context)")
+        ("pin-threads", po::bool_switch(&args.pin_threads), "pin the game thread and io_context threads to CPU cores (with --io-contexts)")
+        ("coroutine-sessions", po::bool_switch(&args.coroutine_sessions), "serve each connection with a C++20 coroutine instead of a chain of callbacks")
+        ("shard-id", po::value(&args.shard_id)->value_name("0..15"s), "run as a shard with this number (written to tokens)")
+        ("shard-maps", po::value(&args.shard_maps)->value_name("map1,map2"s), "maps owned by this shard")
+        ("router", po::bool_switch(&args.router), "forward requests to shards instead of running the game")
+        ("shard", po::value(&args.shards)->multitoken()->value_name("host:port=map1,map2"s), "shard address and maps for the router, in shard number order");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -46,9 +85,36 @@ struct Args {
     if (!vm.contains("config-file"s)) {
         throw std::runtime_error("Config file has not been specified"s);
     }
+    if (args.port <= 0 || args.port > 65535) {
+        throw std::runtime_error("Port should be in range [1, 65535]"s);
+    }
+    if (args.router) {
+        if (args.shards.empty()) {
+            throw std::runtime_error("Router needs at least one shard"s);
+        }
+        return args;
+    }
     if (!vm.contains("www-root"s)) {
         throw std::runtime_error("Static files folder path is not specified"s);
     }
+    if (args.tick_catch_up < 0 || args.publish_period_ms < 0 || args.retire_period_ms < 0) {
+        throw std::runtime_error("Tick catch-up and stage periods should not be negative"s);
+    }
+    if (args.bots_per_map < 0 || args.bot_move_period_ms <= 0) {
+        throw std::runtime_error("Bots count and move period should be positive"s);
+    }
+    if (args.max_sessions < 0 || args.max_queue_depth < 0 || args.max_tick_lag_ms < 0) {
+        throw std::runtime_error("Load limits should not be negative"s);
+    }
+    if (args.io_contexts < 0) {
+        throw std::runtime_error("io_context count should not be negative"s);
+    }
+    if (vm.contains("shard-id"s) != vm.contains("shard-maps"s)) {
+        throw std::runtime_error("Shard id and shard maps should be specified together"s);
+    }
+    if (vm.contains("shard-id"s) && (args.shard_id < 0 || args.shard_id > 15)) {
+        throw std::runtime_error("Shard id should be in range [0, 15]"s);
+    }
     
     return args;
 }
@@ -0,0 +1,76 @@
+#include "rate_limiter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+RateLimiter::RateLimiter(RateLimit limit)
+    : limit_{limit} {
+    // Без запаса хотя бы на один запрос корзина не пропустила бы ничего
+    if (limit_.burst < 1.0) {
+        limit_.burst = std::max(1.0, limit_.rate);
+    }
+}
+
+std::optional<std::chrono::seconds> RateLimiter::Acquire(std::string_view key, Clock::time_point now) {
+    return AcquireHashed(std::hash<std::string_view>{}(key), now);
+}
+
+std::optional<std::chrono::seconds> RateLimiter::Acquire(const boost::asio::ip::address& address,
+                                                         Clock::time_point now) {
+    if (address.is_v4()) {
+        const auto bytes = address.to_v4().to_bytes();
+        return Acquire(std::string_view{reinterpret_cast<const char*>(bytes.data()), bytes.size()}, now);
+    }
+    const auto bytes = address.to_v6().to_bytes();
+    return Acquire(std::string_view{reinterpret_cast<const char*>(bytes.data()), bytes.size()}, now);
+}
+
+std::optional<std::chrono::seconds> RateLimiter::AcquireHashed(uint64_t hash, Clock::time_point now) {
+    if (!IsEnabled()) {
+        return std::nullopt;
+    }
+
+    // Часть выбирается по старшим битам, а корзина внутри неё - по всему хешу
+    auto& shard = shards_[hash >> (64 - ShardBits)];
+    std::lock_guard lock{shard.mutex};
+
+    if (shard.buckets.size() >= shard.evict_at && !shard.buckets.contains(hash)) {
+        EvictFull(shard, now);
+    }
+    auto [it, inserted] = shard.buckets.try_emplace(hash, Bucket{limit_.burst, now});
+    auto& bucket = it->second;
+    if (!inserted) {
+        bucket.tokens = Refill(bucket, now);
+        bucket.updated = now;
+    }
+
+    if (bucket.tokens >= 1.0) {
+        bucket.tokens -= 1.0;
+        return std::nullopt;
+    }
+    const auto wait = std::ceil((1.0 - bucket.tokens) / limit_.rate);
+    return std::chrono::seconds{std::max<int64_t>(1, static_cast<int64_t>(wait))};
+}
+
+size_t RateLimiter::GetBucketCount() {
+    size_t count = 0;
+    for (auto& shard : shards_) {
+        std::lock_guard lock{shard.mutex};
+        count += shard.buckets.size();
+    }
+    return count;
+}
+
+double RateLimiter::Refill(const Bucket& bucket, Clock::time_point now) const {
+    const std::chrono::duration<double> elapsed = now - bucket.updated;
+    return std::min(limit_.burst, bucket.tokens + elapsed.count() * limit_.rate);
+}
+
+void RateLimiter::EvictFull(Shard& shard, Clock::time_point now) {
+    // Полная корзина ничем не отличается от новой, поэтому её можно забыть
+    std::erase_if(shard.buckets, [this, now](const auto& item) {
+        return Refill(item.second, now) >= limit_.burst;
+    });
+    shard.evict_at = std::max(MaxBucketsPerShard, shard.buckets.size() * 2);
+}
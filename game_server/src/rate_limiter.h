@@ -0,0 +1,88 @@
+#pragma once
+
+#include <boost/asio/ip/address.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// В среднем rate запросов в секунду и до burst подряд. rate == 0 - без ограничения
+struct RateLimit {
+    double rate = 0.0;
+    double burst = 0.0;
+};
+
+struct RateLimits {
+    RateLimit per_token;
+    RateLimit per_ip;
+    // Прокси, которым верят в X-Forwarded-For, например маршрутизатор перед шардами.
+    // Для их запросов per_ip считается по адресу из заголовка
+    std::vector<boost::asio::ip::address> trusted_proxies;
+};
+
+/*
+ *  Корзины токенов (token bucket) по ключу: токену игрока или адресу клиента.
+ *  Таблица разбита на части со своими мьютексами, поэтому потоки ввода-вывода почти не ждут друг друга.
+ *  Корзина ищется по 64-битному хешу ключа, сам ключ не хранится: клиенты с совпавшим хешем
+ *  делят одну корзину, зато проверка - один хеш и один поиск без выделения памяти.
+ *  Когда часть таблицы разрастается, из неё удаляются корзины, которые успели наполниться.
+ */
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit RateLimiter(RateLimit limit = {});
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    bool IsEnabled() const noexcept {
+        return limit_.rate > 0.0;
+    }
+
+    // Сколько корзин хранится сейчас
+    size_t GetBucketCount();
+
+    // Забирает из корзины ключа один токен. nullopt - запрос разрешён, иначе через сколько его повторить
+    std::optional<std::chrono::seconds> Acquire(std::string_view key, Clock::time_point now = Clock::now());
+    std::optional<std::chrono::seconds> Acquire(const boost::asio::ip::address& address,
+                                                Clock::time_point now = Clock::now());
+
+private:
+    struct Bucket {
+        double tokens = 0.0;
+        Clock::time_point updated;
+    };
+
+    static constexpr size_t ShardBits = 6;
+    static constexpr size_t MaxBucketsPerShard = 4096;
+
+    // Ключ таблицы - уже готовый хеш
+    struct IdentityHash {
+        size_t operator()(uint64_t key) const noexcept {
+            return static_cast<size_t>(key);
+        }
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Bucket, IdentityHash> buckets;
+        // Размер, при котором пора чистить. Если чистка почти ничего не удалила, следующая
+        // будет не раньше, чем таблица вырастет вдвое
+        size_t evict_at = MaxBucketsPerShard;
+    };
+
+    std::optional<std::chrono::seconds> AcquireHashed(uint64_t hash, Clock::time_point now);
+    // Токены корзины к моменту now
+    double Refill(const Bucket& bucket, Clock::time_point now) const;
+    void EvictFull(Shard& shard, Clock::time_point now);
+
+    RateLimit limit_;
+    std::array<Shard, size_t{1} << ShardBits> shards_;
+};
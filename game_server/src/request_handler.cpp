@@ -1,15 +1,14 @@
 #include "request_handler.h"
+#include "binary_encoding.h"
 #include "constants.h"
 
-#include <filesystem>
 #include <unordered_map>
 #include <algorithm>
+#include <charconv>
+#include <cmath>
 #include <iostream>
-#include <fstream>
-#include <regex>
 
 namespace sys = boost::system;
-namespace fs = std::filesystem;
 
 using namespace constants;
 using namespace std::literals;
@@ -18,66 +17,6 @@ namespace http_handler {
 
 const int MaxRecordsCount = 100;
 
-bool IsSubPath(fs::path path, fs::path base) {
-    path = fs::weakly_canonical(path);
-    base = fs::weakly_canonical(base);
-
-    for (auto b = base.begin(), p = path.begin(); b != base.end(); ++b, ++p) {
-        if (p == path.end() || *p != *b) {
-            return false;
-        }
-    }
-    return true;
-}
-
-std::string GetContentType(const std::string& path) {
-    std::unordered_map<std::string, std::string> contentTypes = {
-        {".htm", "text/html"},
-        {".html", "text/html"},
-        {".css", "text/css"},
-        {".txt", "text/plain"},
-        {".js", "text/javascript"},
-        {".json", "application/json"},
-        {".xml", "application/xml"},
-        {".png", "image/png"},
-        {".jpg", "image/jpeg"},
-        {".jpe", "image/jpeg"},
-        {".jpeg", "image/jpeg"},
-        {".gif", "image/gif"},
-        {".bmp", "image/bmp"},
-        {".ico", "image/vnd.microsoft.icon"},
-        {".tiff", "image/tiff"},
-        {".tif", "image/tiff"},
-        {".svg", "image/svg+xml"},
-        {".svgz", "image/svg+xml"},
-        {".mp3", "audio/mpeg"}
-    };
-
-    size_t dot = path.find_last_of('.');
-    if (dot != std::string::npos) {
-        std::string extension = path.substr(dot);
-        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
-
-        auto it = contentTypes.find(extension);
-        if (it != contentTypes.end()) {
-            return it->second;
-        }
-    }
-
-    return "application/octet-stream";
-}
-
-std::string ReadFileToString(fs::path file_path) {
-    std::ifstream file(file_path, std::ios::in | std::ios::binary);
-    if (!file) {
-        throw std::runtime_error("Failed to open file: " + file_path.string());
-    }
-    std::ostringstream contents;
-    contents << file.rdbuf();
-    return contents.str();
-}
-
-
 std::string DecodeUrl(const std::string& url) {
     std::string result;
     result.reserve(url.size());
@@ -102,7 +41,7 @@ std::string DecodeUrl(const std::string& url) {
     return result;
 }
 
-auto ExtractQueryParams(const std::string& target) {
+auto ExtractQueryParams(std::string_view target) {
     std::unordered_map<std::string, std::string> query_params;
 
     std::size_t query_start = target.find('?');
@@ -110,7 +49,7 @@ auto ExtractQueryParams(const std::string& target) {
         return query_params;
     }
 
-    std::string query_string = target.substr(query_start + 1);
+    std::string query_string{target.substr(query_start + 1)};
 
     std::istringstream query_stream(query_string);
     std::string param;
@@ -128,7 +67,95 @@ auto ExtractQueryParams(const std::string& target) {
     return query_params;
 }
 
-std::string RequestHandler::GetToken(const http::fields& headers) const {
+// Параметры зрителя: map=<id> и необязательный instance=<номер экземпляра карты>
+struct SpectatorParams {
+    std::string map_id;
+    size_t instance = 0;
+};
+
+std::optional<SpectatorParams> GetSpectatorParams(std::string_view target) {
+    const auto& params = ExtractQueryParams(target);
+    if (!params.contains("map") || params.at("map").empty()) {
+        return std::nullopt;
+    }
+
+    SpectatorParams result{params.at("map")};
+    if (params.contains("instance")) {
+        const auto& instance = params.at("instance");
+        if (instance.empty() || instance.size() > 9 || !std::all_of(instance.begin(), instance.end(), ::isdigit)) {
+            return std::nullopt;
+        }
+        result.instance = std::stoul(instance);
+    }
+    return result;
+}
+
+// Двоичный формат отдаём только тем, кто явно его запросил
+Encoding GetAcceptedEncoding(const RequestFields& headers) {
+    auto it = headers.find(http::field::accept);
+    if (it != headers.end() && it->value().find(binary::ContentType) != std::string_view::npos) {
+        return Encoding::Binary;
+    }
+    return Encoding::Json;
+}
+
+std::string_view GetEncodingContentType(Encoding encoding) {
+    return encoding == Encoding::Binary ? binary::ContentType : "application/json"sv;
+}
+
+std::string_view GetEncodingVariant(Encoding encoding) {
+    return encoding == Encoding::Binary ? ":bin"sv : ":json"sv;
+}
+
+// Проверяет, есть ли etag среди перечисленных в If-None-Match. Сжатые на лету варианты
+// отличаются суффиксом кодировки, но проверяются против того же etag
+bool IsNotModified(const RequestFields& headers, std::string_view etag) {
+    auto it = headers.find(http::field::if_none_match);
+    if (it == headers.end()) {
+        return false;
+    }
+
+    std::string_view tags = it->value();
+    while (!tags.empty()) {
+        const auto comma = tags.find(',');
+        auto tag = tags.substr(0, comma);
+        tags = comma == std::string_view::npos ? std::string_view{} : tags.substr(comma + 1);
+
+        while (!tag.empty() && tag.front() == ' ') {
+            tag.remove_prefix(1);
+        }
+        while (!tag.empty() && tag.back() == ' ') {
+            tag.remove_suffix(1);
+        }
+        if (tag.starts_with("W/"sv)) {
+            tag.remove_prefix(2);
+        }
+        if (tag == "*"sv || compression::MatchesETag(tag, etag)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string RequestHandler::MakeETag(char kind, uint64_t version, std::string_view variant) const {
+    std::string etag = "\"";
+    etag += std::to_string(etag_epoch_);
+    etag += '-';
+    etag += kind;
+    etag += std::to_string(version);
+    etag += variant;
+    etag += '"';
+    return etag;
+}
+
+StringResponse RequestHandler::HandleNotModified(const std::string& etag) const {
+    return HandleResponse(http::status::not_modified, {},
+                          {{http::field::cache_control, "no-cache"},
+                           {http::field::etag, etag},
+                           {http::field::vary, "Accept, Accept-Encoding"}});
+}
+
+std::string RequestHandler::GetToken(const RequestFields& headers) const {
     if (headers.find(http::field::authorization) != headers.end()) {
         const auto& auth_header = headers[http::field::authorization];
         const auto& bearer_prefix = "Bearer "sv;
@@ -136,8 +163,7 @@ std::string RequestHandler::GetToken(const http::fields& headers) const {
             std::string token_str{auth_header.substr(bearer_prefix.size())};
 
             //проверка валидности
-            static const std::regex hex_regex("^[0-9a-zA-Z]{32}$");
-            if (std::regex_match(token_str, hex_regex)) {
+            if (PlayerTokens::IsValid(token_str)) {
                 return token_str;
             }
         }
@@ -145,10 +171,10 @@ std::string RequestHandler::GetToken(const http::fields& headers) const {
     return {};
 }
 
-StringResponse RequestHandler::HandleResponse(http::status status, const std::string& data, const HttpHeaders& headers) const {
+StringResponse RequestHandler::HandleResponse(http::status status, std::string data, HttpHeaders headers) const {
     StringResponse res;
     res.result(status);
-    res.body() = data;
+    res.body() = std::move(data);
     for (auto const& [field, value] : headers) {
         res.set(field, value);
     }
@@ -156,7 +182,7 @@ StringResponse RequestHandler::HandleResponse(http::status status, const std::st
     return res;
 }
 
-StringResponse RequestHandler::HandleError(http::status status, const std::string& code, const std::string& message, const HttpHeaders& headers) const {
+StringResponse RequestHandler::HandleError(http::status status, const std::string& code, const std::string& message, HttpHeaders headers) const {
     json::object obj;
     obj[CODE] = code;
     obj[MESSAGE] = message;
@@ -166,12 +192,10 @@ StringResponse RequestHandler::HandleError(http::status status, const std::strin
 
 StringResponse RequestHandler::HandleAuthorizationError() const {
     return HandleError(http::status::unauthorized,
-                       "invalidToken", "Authorization header is missing",
-                        {{http::field::content_type, "application/json"},
-                         {http::field::cache_control, "no-cache"}});
+                       "invalidToken", "Authorization header is missing", JsonHeaders);
 }
 
-StringResponse RequestHandler::HandleAllowMethodError(const std::string& allowed_methods) const {
+StringResponse RequestHandler::HandleAllowMethodError(std::string_view allowed_methods) const {
     return HandleError(http::status::method_not_allowed,
                        "invalidMethod", "Invalid method",
                        {{http::field::content_type, "application/json"},
@@ -179,275 +203,593 @@ StringResponse RequestHandler::HandleAllowMethodError(const std::string& allowed
                         {http::field::allow, allowed_methods}});
 }
 
-
-void RequestHandler::HandleRequest(http::verb method, const std::string& target, const std::string& body,
-                                    const http::fields& headers, const ResponseCallback& callback) const {
-    //старт игры
-    if (target == "/api/v1/game/join") {
-        if (method == http::verb::post) {
-            HandleJoinGame(body, callback);
-            return;
-        } else {
-            callback(HandleAllowMethodError("POST"));
-            return;
-        }
+std::array<StringResponse, Routes.size()> RequestHandler::MakeMethodNotAllowedResponses() const {
+    std::array<StringResponse, Routes.size()> responses;
+    for (size_t i = 0; i < Routes.size(); ++i) {
+        responses[i] = HandleAllowMethodError(Routes[i].allow);
     }
+    return responses;
+}
 
-    //игровое состояние
-    if (target == "/api/v1/game/state") {
-        if (method == http::verb::get || method == http::verb::head) {
-            if (auto token = GetToken(headers); !token.empty()) {
-                HandleGetGameState(token, callback);
-                return;
-            }
-            callback(HandleAuthorizationError());
-            return;
-        } else {
-            callback(HandleAllowMethodError("GET, HEAD"));
-            return;
-        }
-    }
+StringResponse RequestHandler::MakeOverloadedResponse() const {
+    return HandleError(http::status::service_unavailable,
+                       "serverOverloaded", "Server is overloaded, retry later",
+                       {{http::field::content_type, "application/json"},
+                        {http::field::cache_control, "no-cache"},
+                        {http::field::retry_after, "1"}});
+}
 
-    //управление временем
-    if (target == "/api/v1/game/tick") {
-        if (method == http::verb::post) {
-            HandleGameTick(body, callback);
-            return;
-        } else {
-            callback(HandleAllowMethodError("POST"));
-            return;
-        }
+void RequestHandler::HandleUpgrade(tcp::socket&& socket, StringRequest&& request) const {
+    // Адрес клиента нужен для ограничения частоты сообщений, пока сокет ещё не отдан сессии
+    sys::error_code ec;
+    const auto peer = socket.remote_endpoint(ec);
+    const auto client = ec ? std::nullopt
+                           : std::optional{ResolveClientAddress(peer.address(), request[ForwardedForHeader], trusted_proxies_)};
+    auto session = std::make_shared<http_server::WebSocketSession>(std::move(socket));
+
+    const auto& target = DecodeUrl(std::string{request.target()});
+    const auto& path = target.substr(0, target.find('?'));
+    if (path == "/api/v1/game/spectate") {
+        HandleSpectatorUpgrade(session, target, std::move(request));
+        return;
     }
-
-    //список карт
-    if (target == "/api/v1/maps") {
-        if (method == http::verb::get || method == http::verb::head) {
-            HandleGetMaps(callback);
-            return;    
-        } else {
-            callback(HandleAllowMethodError("GET, HEAD"));
-            return;
-        }
+    if (path != "/api/v1/game/ws") {
+        session->Decline(HandleError(http::status::bad_request,
+                                     "badRequest", "Bad request", JsonHeaders));
+        return;
     }
 
-    //данные карты
-    if (target.starts_with("/api/v1/maps/")) {
-        if (method == http::verb::get || method == http::verb::head) {
-            const auto& id = target.substr(std::string("/api/v1/maps/").size());
-            HandleGetMapById(id, callback);
-            return;
-        } else {
-            callback(HandleAllowMethodError("GET, HEAD"));
-            return;
+    // Браузер не умеет передавать заголовки при подключении, поэтому токен можно указать в параметрах запроса
+    auto token = GetToken(request.base());
+    if (token.empty()) {
+        const auto& params = ExtractQueryParams(target);
+        if (params.contains("token") && PlayerTokens::IsValid(params.at("token"))) {
+            token = params.at("token");
         }
     }
+    if (token.empty()) {
+        session->Decline(HandleAuthorizationError());
+        return;
+    }
 
-    //список игроков
-    if (target == "/api/v1/game/players") {
-        if (method == http::verb::get || method == http::verb::head) {
-            if (auto token = GetToken(headers); !token.empty()) {
-                HandleGetPlayers(token, callback);
+    auto safe_request = std::make_shared<StringRequest>(std::move(request));
+    try {
+        api_handler_.Subscribe(token, session, [this, session, safe_request, token, client](bool subscribed) {
+            if (!subscribed) {
+                session->Decline(HandleError(http::status::unauthorized, "unknownToken",
+                                             "Player token has not been found", JsonHeaders));
                 return;
             }
-            callback(HandleAuthorizationError());
-            return;
-        } else {
-            callback(HandleAllowMethodError("GET, HEAD"));
-            return;
-        }
+            // Команды принимаются в том же формате, что и /api/v1/game/player/action.
+            // Каждое сообщение расходует те же корзины, что и HTTP-запрос, сверх лимита сообщения отбрасываются
+            session->Run(std::move(*safe_request), [this, token, client](const std::string& message) {
+                if ((client && ip_limiter_.Acquire(*client)) || token_limiter_.Acquire(token)) {
+                    return;
+                }
+                try {
+                    api_handler_.PlayerAction(token, message, Encoding::Json, [](const std::string&){});
+                } catch (const std::exception& ex) {
+                    Logger::LogError(0, ex.what(), "websocket: player action");
+                }
+            });
+        });
+    } catch (const ApiException& ex) {
+        session->Decline(HandleError(ex.status, ex.code, ex.what(), JsonHeaders));
+    }
+}
+
+void RequestHandler::HandleSpectatorUpgrade(const std::shared_ptr<http_server::WebSocketSession>& session,
+                                            const std::string& target, StringRequest&& request) const {
+    const auto params = GetSpectatorParams(target);
+    if (!params) {
+        session->Decline(HandleError(http::status::bad_request, "invalidArgument",
+                                     "map should be specified, instance should be a non-negative number", JsonHeaders));
+        return;
     }
 
-    if (target == "/api/v1/game/player/action") {
-        if (method == http::verb::post) {
-            if (headers.find(http::field::content_type) == headers.end() || headers[http::field::content_type] != "application/json") {
-                callback(HandleError(http::status::bad_request,
-                                     "invalidArgument", "Invalid content type",
-                                     {{http::field::content_type, "application/json"},
-                                      {http::field::cache_control, "no-cache"}}));
+    auto safe_request = std::make_shared<StringRequest>(std::move(request));
+    try {
+        api_handler_.FindSpectatedMap(params->map_id, params->instance, [this, session, safe_request](std::optional<model::Map::InstanceId> instance) {
+            if (!instance) {
+                session->Decline(HandleError(http::status::not_found, "mapNotFound", "Map instance not found", JsonHeaders));
                 return;
             }
-            if (auto token = GetToken(headers); !token.empty()) {
-                HandlePlayerAction(token, body, callback);
+            if (!api_handler_.SubscribeSpectator(*instance, session)) {
+                session->Decline(HandleError(http::status::not_found, "mapNotFound", "Map instance not found", JsonHeaders));
                 return;
             }
-            callback(HandleAuthorizationError());
-            return;
-        } else {
-            callback(HandleAllowMethodError("POST"));
+            // Зритель только смотрит, его сообщения игнорируются
+            session->Run(std::move(*safe_request), [](const std::string&) {});
+        });
+    } catch (const ApiException& ex) {
+        session->Decline(HandleError(ex.status, ex.code, ex.what(), JsonHeaders));
+    }
+}
+
+std::optional<StringResponse> RequestHandler::CheckContentType(const RequestFields& headers, bool allow_binary) const {
+    const auto content_type = headers.find(http::field::content_type) != headers.end()
+                            ? headers[http::field::content_type] : ""sv;
+    if (content_type == "application/json" || (allow_binary && content_type == binary::ContentType)) {
+        return std::nullopt;
+    }
+    return HandleError(http::status::bad_request,
+                       "invalidArgument", "Invalid content type", JsonHeaders);
+}
+
+StringResponse RequestHandler::HandleTooManyRequests(std::chrono::seconds retry_after) const {
+    const auto seconds = std::to_string(retry_after.count());
+    return HandleError(http::status::too_many_requests,
+                       "tooManyRequests", "Too many requests, retry later",
+                       {{http::field::content_type, "application/json"},
+                        {http::field::cache_control, "no-cache"},
+                        {http::field::retry_after, seconds}});
+}
+
+void RequestHandler::HandleRequest(http::verb method, std::string_view target, const std::string& body,
+                                   const RequestFields& headers, const std::optional<net::ip::address>& client,
+                                   const ResponseCallback& callback) const {
+    const auto match = MatchRoute(target);
+    if (!match) {
+        callback(HandleError(http::status::bad_request,
+                             "badRequest", "Bad request", JsonHeaders));
+        return;
+    }
+    const auto route = match->spec->route;
+    if (!(match->spec->methods & ToMethodMask(method))) {
+        callback(method_not_allowed_[static_cast<size_t>(route)]);
+        return;
+    }
+    if (client) {
+        if (const auto retry_after = ip_limiter_.Acquire(*client)) {
+            callback(HandleTooManyRequests(*retry_after));
             return;
         }
     }
+    if (match->spec->priority == Priority::Sheddable && api_handler_.IsOverloaded()) {
+        api_handler_.CountShedRequest();
+        callback(overloaded_);
+        return;
+    }
+
+    switch (route) {
+    //старт игры
+    case Route::JoinGame:
+        HandleJoinGame(body, callback);
+        return;
+
+    //управление временем
+    case Route::GameTick:
+        HandleGameTick(body, callback);
+        return;
+
+    case Route::Maps:
+        HandleGetMaps(callback);
+        return;
+
+    case Route::MapById:
+        HandleGetMapById(match->param, callback);
+        return;
+
+    case Route::Spectate:
+        HandleSpectate(target, callback);
+        return;
 
-    //таблица рекордов
-    if (target.starts_with("/api/v1/game/records")) {
-        if (method == http::verb::get) {
-            HandleGetRecords(target, callback);
+    case Route::Records:
+        HandleGetRecords(target, callback);
+        return;
+
+    case Route::PlayerBatch:
+        if (auto error = CheckContentType(headers, false)) {
+            callback(std::move(*error));
             return;
         }
-	callback(HandleAllowMethodError("GET"));
-	return;
+        HandlePlayerBatch(body, callback);
+        return;
+
+    // Остальные маршруты требуют токен игрока
+    case Route::GameState:
+    case Route::Players:
+    case Route::PlayerAction:
+    case Route::NavigatePlayer:
+        break;
     }
 
-    if (!target.starts_with("/api/")) {
-        if (method == http::verb::get || method == http::verb::head) {
-            HandleGetResource(target.substr(1), callback);//удаляем первый /, чтобы сделать путь относительным
+    // Тип содержимого проверяется раньше токена
+    if (route == Route::PlayerAction || route == Route::NavigatePlayer) {
+        if (auto error = CheckContentType(headers, route == Route::PlayerAction)) {
+            callback(std::move(*error));
             return;
         }
     }
+    const auto token = GetToken(headers);
+    if (token.empty()) {
+        callback(HandleAuthorizationError());
+        return;
+    }
+    if (const auto retry_after = token_limiter_.Acquire(token)) {
+        callback(HandleTooManyRequests(*retry_after));
+        return;
+    }
 
-    callback(HandleError(http::status::bad_request,
-                         "badRequest", "Bad request",
-                         {{http::field::content_type, "application/json"},
-                          {http::field::cache_control, "no-cache"}}));
+    switch (route) {
+    case Route::GameState:
+        HandleGetGameState(token, target, GetAcceptedEncoding(headers), headers, callback);
+        return;
+    case Route::Players:
+        HandleGetPlayers(token, GetAcceptedEncoding(headers), headers, callback);
+        return;
+    case Route::PlayerAction: {
+        const auto encoding = headers[http::field::content_type] == binary::ContentType ? Encoding::Binary : Encoding::Json;
+        HandlePlayerAction(token, body, encoding, callback);
+        return;
+    }
+    case Route::NavigatePlayer:
+        HandleNavigatePlayer(token, body, callback);
+        return;
+    default:
+        return;
+    }
 }
 
 void RequestHandler::HandleGetMaps(const ResponseCallback& callback) const {
-    api_handler_.GetMaps([this, callback](const std::string& data){
-        callback(HandleResponse(http::status::ok, data,
-                                {{http::field::content_type, "application/json"},
-                                 {http::field::cache_control, "no-cache"}}));
+    api_handler_.GetMaps([this, callback](std::string data){
+        callback(HandleResponse(http::status::ok, std::move(data), JsonHeaders));
     });
 }
 
-void RequestHandler::HandleGetMapById(const std::string& id, const ResponseCallback& callback) const {
+void RequestHandler::HandleGetMapById(std::string_view id, const ResponseCallback& callback) const {
     try {
-        api_handler_.GetMapById(id, [this, callback](const std::string& data){
-            callback(HandleResponse(http::status::ok, data,
-                                    {{http::field::content_type, "application/json"},
-                                     {http::field::cache_control, "no-cache"}}));
+        api_handler_.GetMapById(std::string{id}, [this, callback](std::string data){
+            callback(HandleResponse(http::status::ok, std::move(data), JsonHeaders));
         });
     } catch (const ApiException& ex) {
-        callback(HandleError(ex.status, ex.code, ex.what(),
-                             {{http::field::content_type, "application/json"},
-                              {http::field::cache_control, "no-cache"}}));
+        callback(HandleError(ex.status, ex.code, ex.what(), JsonHeaders));
     }
 }
 
-void RequestHandler::HandleGetResource(const std::string& target, const ResponseCallback& callback) const {
-    fs::path path{target};
-    fs::path resources_path{resources_};
+std::optional<RangeRequest> ParseRange(std::string_view value, uint64_t size) {
+    constexpr auto prefix = "bytes="sv;
+    if (!value.starts_with(prefix) || value.find(',') != std::string_view::npos) {
+        return std::nullopt;
+    }
+    value.remove_prefix(prefix.size());
+    const auto dash = value.find('-');
+    if (dash == std::string_view::npos) {
+        return std::nullopt;
+    }
 
-    fs::path abs_path = fs::weakly_canonical(resources_path / path);
-    if (!IsSubPath(abs_path, resources_path)) {
-        callback(HandleError(http::status::bad_request,
-                             "BadRequest", "Path is out of resources folder",
-                             {{http::field::content_type, "text/plain"}}));
-        return;
+    auto parse = [](std::string_view number) -> std::optional<uint64_t> {
+        uint64_t result = 0;
+        const auto [end, ec] = std::from_chars(number.data(), number.data() + number.size(), result);
+        if (number.empty() || ec != std::errc{} || end != number.data() + number.size()) {
+            return std::nullopt;
+        }
+        return result;
+    };
+    const auto first = value.substr(0, dash);
+    const auto last = value.substr(dash + 1);
+
+    // bytes=-n - последние n байт
+    if (first.empty()) {
+        const auto suffix = parse(last);
+        if (!suffix) {
+            return std::nullopt;
+        }
+        if (*suffix == 0 || size == 0) {
+            return RangeRequest{false};
+        }
+        const auto length = std::min(*suffix, size);
+        return RangeRequest{true, size - length, length};
     }
-    if (!fs::exists(abs_path)) {
-        callback(HandleError(http::status::not_found,
-                             "NotFound", "Resource not found",
-                             {{http::field::content_type, "text/plain"}}));
-        return;
+
+    const auto start = parse(first);
+    // bytes=n- - с n-го байта до конца файла
+    const auto end = last.empty() ? start : parse(last);
+    if (!start || !end || *end < *start) {
+        return std::nullopt;
     }
-    if (fs::is_directory(abs_path)) {
-        abs_path /= "index.html";
+    if (*start >= size) {
+        return RangeRequest{false};
     }
+    const auto last_byte = last.empty() ? size - 1 : std::min(*end, size - 1);
+    return RangeRequest{true, *start, last_byte - *start + 1};
+}
 
-    std::string file_content;
-    try {
-        file_content = ReadFileToString(abs_path);
-        callback(HandleResponse(http::status::ok, std::move(file_content),
-                                {{http::field::content_type, GetContentType(abs_path)}}));
-    } catch( const std::exception& ex) {
-        callback(HandleError(http::status::not_found,
-                             "NotFound", "Failed to open file",
-                             {{http::field::content_type, "text/plain"}}));
+net::ip::address ResolveClientAddress(const net::ip::address& peer, std::string_view forwarded_for,
+                                      const std::vector<net::ip::address>& trusted_proxies) {
+    if (forwarded_for.empty() || std::find(trusted_proxies.begin(), trusted_proxies.end(), peer) == trusted_proxies.end()) {
+        return peer;
+    }
+    auto last = forwarded_for.substr(forwarded_for.rfind(',') + 1);
+    while (!last.empty() && last.front() == ' ') {
+        last.remove_prefix(1);
+    }
+    while (!last.empty() && last.back() == ' ') {
+        last.remove_suffix(1);
+    }
+    sys::error_code ec;
+    const auto address = net::ip::make_address(std::string{last}, ec);
+    // Неразборчивый заголовок прокси: лимит остаётся на самом прокси
+    return ec ? peer : address;
+}
+
+RequestHandler::StaticResponse RequestHandler::MakeStaticResponse(http::verb method, std::string_view target,
+                                                                  const RequestFields& headers) const {
+    // Удаляем первый /, чтобы сделать путь относительным
+    const auto key = StaticCache::NormalizePath(target.substr(0, target.find('?')).substr(1));
+    if (!key) {
+        return HandleError(http::status::bad_request,
+                           "BadRequest", "Path is out of resources folder",
+                           {{http::field::content_type, "text/plain"}});
+    }
+    const auto entry = static_cache_.Find(*key);
+    if (!entry) {
+        return HandleError(http::status::not_found,
+                           "NotFound", "Resource not found",
+                           {{http::field::content_type, "text/plain"}});
+    }
+
+    // Range учитывается, только если If-Range совпадает с текущей версией файла
+    std::optional<RangeRequest> range;
+    if (auto it = headers.find(http::field::range); it != headers.end()) {
+        const auto if_range = headers.find(http::field::if_range);
+        if (if_range == headers.end() || if_range->value() == entry->etag || if_range->value() == entry->last_modified) {
+            range = ParseRange(it->value(), entry->size);
+        }
+    }
+
+    // Сжатый вариант отдаётся, если клиент принимает gzip. Диапазоны - только от исходного файла
+    const bool gzip = !range && !entry->gzip_body.empty()
+        && compression::NegotiateCoding(headers[http::field::accept_encoding]) == compression::ContentCoding::Gzip;
+    const auto& etag = gzip ? entry->gzip_etag : entry->etag;
+    StringResponse response;
+    response.set(http::field::etag, etag);
+    response.set(http::field::last_modified, entry->last_modified);
+    response.set(http::field::accept_ranges, "bytes");
+    // Ответ зависит от Accept-Encoding, если у файла есть сжатый вариант или он сжимается на лету.
+    // Vary нужен и в ответе 304
+    if (!entry->gzip_body.empty() || compression::IsCompressibleType(entry->content_type)) {
+        response.set(http::field::vary, "Accept-Encoding");
+    }
+
+    // If-Modified-Since учитывается, только если клиент не прислал If-None-Match
+    bool not_modified = IsNotModified(headers, etag);
+    if (headers.find(http::field::if_none_match) == headers.end()) {
+        if (auto it = headers.find(http::field::if_modified_since); it != headers.end()) {
+            const auto since = StaticCache::ParseHttpDate(std::string{it->value()});
+            not_modified = since && entry->mtime <= *since;
+        }
+    }
+    if (not_modified) {
+        response.result(http::status::not_modified);
+        response.prepare_payload();
+        return response;
+    }
+
+    if (range && !range->satisfiable) {
+        response.result(http::status::range_not_satisfiable);
+        response.set(http::field::content_range, "bytes */" + std::to_string(entry->size));
+        response.prepare_payload();
+        return response;
+    }
+
+    response.result(http::status::ok);
+    uint64_t offset = 0;
+    uint64_t length = gzip ? entry->gzip_body.size() : entry->size;
+    if (range) {
+        response.result(http::status::partial_content);
+        offset = range->offset;
+        length = range->length;
+        response.set(http::field::content_range,
+                     "bytes " + std::to_string(offset) + "-" + std::to_string(offset + length - 1)
+                     + "/" + std::to_string(entry->size));
+    }
+    response.set(http::field::content_type, entry->content_type);
+    if (gzip) {
+        response.set(http::field::content_encoding, "gzip");
+    }
+    // Ответ на HEAD сообщает длину, но тела не содержит
+    response.content_length(length);
+
+    const bool head = method == http::verb::head;
+    if (entry->file && !gzip) {
+        http_server::FileResponse file_response;
+        file_response.header.base() = std::move(response.base());
+        file_response.fd = entry->file->Get();
+        file_response.offset = offset;
+        file_response.length = head ? 0 : length;
+        file_response.keeper = entry;
+        return file_response;
+    }
+
+    if (!head) {
+        const auto& body = gzip ? entry->gzip_body : entry->body;
+        response.body().assign(body, offset, length);
     }
+    return response;
 }
 
 void RequestHandler::HandleJoinGame(const std::string& body, const ResponseCallback& callback) const {
     try {
-        api_handler_.JoinGame(body, [this, callback](const std::string& data){
-            callback(HandleResponse(http::status::ok, data,
-                                    {{http::field::content_type, "application/json"},
-                                     {http::field::cache_control, "no-cache"}}));
-        });
+        api_handler_.JoinGame(body, callback.Bind([this, callback](std::string data){
+            callback(HandleResponse(http::status::ok, std::move(data), JsonHeaders));
+        }));
         return;
     } catch (const ApiException& ex) {
-        callback(HandleError(ex.status, ex.code, ex.what(),
-                             {{http::field::content_type, "application/json"},
-                              {http::field::cache_control, "no-cache"}}));
+        callback(HandleError(ex.status, ex.code, ex.what(), JsonHeaders));
     } catch (const std::exception& ex) {
         callback(HandleError(http::status::bad_request, "invalidArgument",
-                             "Join game request parse error",
-                             {{http::field::content_type, "application/json"},
-                              {http::field::cache_control, "no-cache"}}));
+                             "Join game request parse error", JsonHeaders));
     }
 }
 
-void RequestHandler::HandleGetPlayers(const std::string& token, const ResponseCallback& callback) const {
+void RequestHandler::HandleGetPlayers(const std::string& token, Encoding encoding, const RequestFields& headers,
+                                      const ResponseCallback& callback) const {
     try {
-        api_handler_.GetPlayers(token, [this, callback](const std::string& data){
-            callback(HandleResponse(http::status::ok, data,
-                                    {{http::field::content_type, "application/json"},
-                                     {http::field::cache_control, "no-cache"}}));
-        });
+        // Список игроков меняется только при входе и выходе игроков
+        const auto etag = MakeETag('m', api_handler_.GetMapVersions(token).members, GetEncodingVariant(encoding));
+        if (IsNotModified(headers, etag)) {
+            callback(HandleNotModified(etag));
+            return;
+        }
+
+        api_handler_.GetPlayers(token, encoding, callback.Bind([this, encoding, etag, callback](std::string data){
+            callback(HandleResponse(http::status::ok, std::move(data),
+                                    {{http::field::content_type, GetEncodingContentType(encoding)},
+                                     {http::field::cache_control, "no-cache"},
+                                     {http::field::etag, etag},
+                                     {http::field::vary, "Accept"}}));
+        }));
         return;
     } catch (const ApiException& ex) {
-        callback(HandleError(ex.status, ex.code, ex.what(),
-                             {{http::field::content_type, "application/json"},
-                              {http::field::cache_control, "no-cache"}}));
+        callback(HandleError(ex.status, ex.code, ex.what(), JsonHeaders));
     }
 }
 
-void RequestHandler::HandleGetGameState(const std::string& token, const ResponseCallback& callback) const {
+void RequestHandler::HandleSpectate(std::string_view target, const ResponseCallback& callback) const {
+    const auto params = GetSpectatorParams(target);
+    if (!params) {
+        callback(HandleError(http::status::bad_request, "invalidArgument",
+                             "map should be specified, instance should be a non-negative number", JsonHeaders));
+        return;
+    }
+    const auto& query = ExtractQueryParams(target);
+    const bool wait = query.contains("wait") && query.at("wait") == "1";
+
     try {
-        api_handler_.GetGameState(token, [this, callback](const std::string& data){
-            callback(HandleResponse(http::status::ok, data,
-                                    {{http::field::content_type, "application/json"},
-                                     {http::field::cache_control, "no-cache"}}));
+        api_handler_.FindSpectatedMap(params->map_id, params->instance, [this, wait, callback](std::optional<model::Map::InstanceId> instance) {
+            if (!instance) {
+                callback(HandleError(http::status::not_found, "mapNotFound", "Map instance not found", JsonHeaders));
+                return;
+            }
+            api_handler_.SpectateGameState(*instance, wait, callback.Bind([this, callback](std::string data) {
+                callback(HandleResponse(http::status::ok, std::move(data), JsonHeaders));
+            }));
         });
+    } catch (const ApiException& ex) {
+        callback(HandleError(ex.status, ex.code, ex.what(), JsonHeaders));
+    }
+}
+
+void RequestHandler::HandleGetGameState(const std::string& token, std::string_view target, Encoding encoding,
+                                        const RequestFields& headers, const ResponseCallback& callback) const {
+    const auto& params = ExtractQueryParams(target);
+    const bool wait = params.contains("wait") && params.at("wait") == "1";
+
+    std::optional<double> radius;
+    if (params.contains("radius")) {
+        // Число целиком, без хвоста вроде "5abc", конечное и положительное
+        const auto& value = params.at("radius");
+        double parsed = 0.0;
+        const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), parsed);
+        if (ec == std::errc{} && end == value.data() + value.size() && std::isfinite(parsed) && parsed > 0.0) {
+            radius = parsed;
+        } else {
+            callback(HandleError(http::status::bad_request, "invalidArgument",
+                                 "radius should be a positive number", JsonHeaders));
+            return;
+        }
+    }
+
+    // Кадры для ожидающих запросов готовятся один раз на тик, целиком и только в JSON
+    if (wait && (radius || encoding != Encoding::Json)) {
+        callback(HandleError(http::status::bad_request, "invalidArgument",
+                             "wait supports neither radius nor binary encoding", JsonHeaders));
+        return;
+    }
+
+    try {
+        if (wait) {
+            api_handler_.WaitGameState(token, callback.Bind([this, callback](std::string data){
+                callback(HandleResponse(http::status::ok, std::move(data), JsonHeaders));
+            }));
+            return;
+        }
+
+        // Версию читаем до сериализации: отданное состояние будет не старше неё
+        std::string variant{GetEncodingVariant(encoding)};
+        if (radius) {
+            variant += ":r" + params.at("radius");
+        }
+        const auto etag = MakeETag('s', api_handler_.GetMapVersions(token).state, variant);
+        if (IsNotModified(headers, etag)) {
+            callback(HandleNotModified(etag));
+            return;
+        }
+
+        api_handler_.GetGameState(token, encoding, radius, callback.Bind([this, encoding, etag, callback](std::string data){
+            callback(HandleResponse(http::status::ok, std::move(data),
+                                    {{http::field::content_type, GetEncodingContentType(encoding)},
+                                     {http::field::cache_control, "no-cache"},
+                                     {http::field::etag, etag},
+                                     {http::field::vary, "Accept"}}));
+        }));
         return;
     } catch (const ApiException& ex) {
-        callback(HandleError(ex.status, ex.code, ex.what(),
-                             {{http::field::content_type, "application/json"},
-                              {http::field::cache_control, "no-cache"}}));
+        callback(HandleError(ex.status, ex.code, ex.what(), JsonHeaders));
 
     }
 }
 
-void RequestHandler::HandlePlayerAction(const std::string& token, const std::string& body, const ResponseCallback& callback) const {
+void RequestHandler::HandlePlayerAction(const std::string& token, const std::string& body, Encoding encoding, const ResponseCallback& callback) const {
     try {
-        api_handler_.PlayerAction(token, body, [this, callback](const std::string& data){
-            callback(HandleResponse(http::status::ok, data,
-                                    {{http::field::content_type, "application/json"},
+        api_handler_.PlayerAction(token, body, encoding, callback.Bind([this, encoding, callback](std::string data){
+            callback(HandleResponse(http::status::ok, std::move(data),
+                                    {{http::field::content_type, GetEncodingContentType(encoding)},
                                      {http::field::cache_control, "no-cache"}}));
-        });
+        }));
         return;
     } catch (const ApiException& ex) {
-        callback(HandleError(ex.status, ex.code, ex.what(),
-                             {{http::field::content_type, "application/json"},
-                              {http::field::cache_control, "no-cache"}}));
+        callback(HandleError(ex.status, ex.code, ex.what(), JsonHeaders));
     } catch (const std::exception& ex) {
         callback(HandleError(http::status::bad_request, "invalidArgument",
-                             "Failed to parse action",
-                             {{http::field::content_type, "application/json"},
-                              {http::field::cache_control, "no-cache"}}));
+                             "Failed to parse action", JsonHeaders));
+    }
+}
+
+void RequestHandler::HandleNavigatePlayer(const std::string& token, const std::string& body, const ResponseCallback& callback) const {
+    try {
+        api_handler_.NavigatePlayer(token, body, callback.Bind([this, callback](std::string data){
+            callback(HandleResponse(http::status::ok, std::move(data), JsonHeaders));
+        }));
+        return;
+    } catch (const ApiException& ex) {
+        callback(HandleError(ex.status, ex.code, ex.what(), JsonHeaders));
+    } catch (const std::exception& ex) {
+        callback(HandleError(http::status::bad_request, "invalidArgument",
+                             "Failed to parse navigation target", JsonHeaders));
+    }
+}
+
+void RequestHandler::HandlePlayerBatch(const std::string& body, const ResponseCallback& callback) const {
+    try {
+        api_handler_.PlayerBatch(body, callback.Bind([this, callback](std::string data){
+            callback(HandleResponse(http::status::ok, std::move(data), JsonHeaders));
+        }));
+        return;
+    } catch (const ApiException& ex) {
+        callback(HandleError(ex.status, ex.code, ex.what(), JsonHeaders));
+    } catch (const std::exception& ex) {
+        callback(HandleError(http::status::bad_request, "invalidArgument",
+                             "Failed to parse batch request JSON", JsonHeaders));
     }
 }
 
 void RequestHandler::HandleGameTick(const std::string& body, const ResponseCallback& callback) const {
     try {
-        api_handler_.GameTick(body, [this, callback](const std::string& data){
-            callback(HandleResponse(http::status::ok, data,
-                                    {{http::field::content_type, "application/json"},
-                                     {http::field::cache_control, "no-cache"}}));
-        });
+        api_handler_.GameTick(body, callback.Bind([this, callback](std::string data){
+            callback(HandleResponse(http::status::ok, std::move(data), JsonHeaders));
+        }));
         return;
     } catch (const ApiException& ex) {
-        callback(HandleError(ex.status, ex.code, ex.what(),
-                             {{http::field::content_type, "application/json"},
-                              {http::field::cache_control, "no-cache"}}));
+        callback(HandleError(ex.status, ex.code, ex.what(), JsonHeaders));
     } catch (const std::exception& ex) {
         callback(HandleError(http::status::bad_request, "invalidArgument",
-                             "Failed to parse tick request JSON",
-                             {{http::field::content_type, "application/json"},
-                              {http::field::cache_control, "no-cache"}}));
+                             "Failed to parse tick request JSON", JsonHeaders));
     }
 }
 
-void RequestHandler::HandleGetRecords(const std::string& target, const ResponseCallback& callback) const {
+void RequestHandler::HandleGetRecords(std::string_view target, const ResponseCallback& callback) const {
     std::optional<int> start;
     std::optional<int> max_items;
     const auto& params = ExtractQueryParams(target);
@@ -465,24 +807,18 @@ void RequestHandler::HandleGetRecords(const std::string& target, const ResponseC
 
         if (max_items && *max_items <= 0 || *max_items > MaxRecordsCount) {
             callback(HandleError(http::status::bad_request, "invalidArgument",
-                                "maxItems shoul be 1-100",
-                                {{http::field::content_type, "application/json"},
-                                {http::field::cache_control, "no-cache"}}));
+                                "maxItems shoul be 1-100", JsonHeaders));
             return;
         }
     }
 
     try {
-        api_handler_.GetRecords(start, max_items, [this, callback](const std::string& data){
-            callback(HandleResponse(http::status::ok, data,
-                                    {{http::field::content_type, "application/json"},
-                                     {http::field::cache_control, "no-cache"}}));
-        });
+        api_handler_.GetRecords(start, max_items, callback.Bind([this, callback](std::string data){
+            callback(HandleResponse(http::status::ok, std::move(data), JsonHeaders));
+        }));
         return;
     } catch (const ApiException& ex) {
-        callback(HandleError(ex.status, ex.code, ex.what(),
-                             {{http::field::content_type, "application/json"},
-                              {http::field::cache_control, "no-cache"}}));
+        callback(HandleError(ex.status, ex.code, ex.what(), JsonHeaders));
     }
 }
 
@@ -2,22 +2,136 @@
 #include "http_server.h"
 #include "logger.h"
 #include "api_handler.h"
+#include "websocket_session.h"
+#include "static_cache.h"
+#include "compression.h"
+#include "route_table.h"
+#include "rate_limiter.h"
 
+#include <boost/asio/post.hpp>
+
+#include <chrono>
+#include <array>
 #include <functional>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <string_view>
+#include <variant>
+#include <vector>
 
 namespace http_handler {
 namespace beast = boost::beast;
 namespace http = beast::http;
-using ResponseCallback = std::function<void(StringResponse)>;
+
+// Получатель ответа. Копии ссылаются на один и тот же обработчик, поэтому копирование
+// по пути запроса через strand игры не выделяет память
+class ResponseCallback {
+public:
+    template <typename Handler>
+        requires (!std::is_same_v<std::decay_t<Handler>, ResponseCallback>)
+    ResponseCallback(Handler&& handler, http_server::AbandonFlag abandoned = nullptr)
+        : impl_{std::make_shared<Impl<std::decay_t<Handler>>>(std::forward<Handler>(handler))}
+        , abandoned_{std::move(abandoned)} {
+    }
+
+    void operator()(StringResponse response) const {
+        impl_->Call(std::move(response));
+    }
+
+    // Обработчик ответа API, который ApiHandler отбросит, если клиент отключится раньше
+    template <typename Handler>
+    Callback Bind(Handler&& handler) const {
+        return Callback{std::forward<Handler>(handler), abandoned_};
+    }
+
+private:
+    struct ImplBase {
+        virtual ~ImplBase() = default;
+        virtual void Call(StringResponse response) = 0;
+    };
+
+    template <typename Handler>
+    struct Impl : ImplBase {
+        explicit Impl(Handler handler)
+            : handler{std::move(handler)} {
+        }
+        void Call(StringResponse response) override {
+            handler(std::move(response));
+        }
+        Handler handler;
+    };
+
+    std::shared_ptr<ImplBase> impl_;
+    http_server::AbandonFlag abandoned_;
+};
+
+using HttpHeader = std::pair<http::field, std::string_view>;
+
+// Заголовки ответа: список в фигурных скобках или заранее собранный набор. Не владеет строками
+class HttpHeaders {
+public:
+    HttpHeaders(std::initializer_list<HttpHeader> headers)
+        : begin_{headers.begin()}
+        , end_{headers.end()} {
+    }
+
+    template <size_t N>
+    constexpr HttpHeaders(const std::array<HttpHeader, N>& headers)
+        : begin_{headers.data()}
+        , end_{headers.data() + N} {
+    }
+
+    const HttpHeader* begin() const {return begin_;}
+    const HttpHeader* end() const {return end_;}
+
+private:
+    const HttpHeader* begin_;
+    const HttpHeader* end_;
+};
+
+// Заголовки большинства ответов API
+inline constexpr std::array JsonHeaders{
+    HttpHeader{http::field::content_type, "application/json"},
+    HttpHeader{http::field::cache_control, "no-cache"}
+};
 
 std::string DecodeUrl(const std::string& url);
 
+// Диапазон байт из заголовка Range. Поддерживается только один диапазон,
+// остальные формы игнорируются, и клиент получает файл целиком
+struct RangeRequest {
+    bool satisfiable = true;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+};
+
+std::optional<RangeRequest> ParseRange(std::string_view value, uint64_t size);
+
+inline constexpr std::string_view ForwardedForHeader = "X-Forwarded-For";
+
+// Адрес клиента для лимитов. У доверенного прокси это последний адрес в X-Forwarded-For:
+// его дописал сам прокси, а всё, что левее, мог прислать клиент
+net::ip::address ResolveClientAddress(const net::ip::address& peer, std::string_view forwarded_for,
+                                      const std::vector<net::ip::address>& trusted_proxies);
+
 class RequestHandler {
     
 public:
-    explicit RequestHandler(std::string static_folder, ApiHandler& api_handler)
-        : resources_{std::move(static_folder)}
-        , api_handler_(api_handler) {
+    RequestHandler(net::io_context& ioc, const StaticCache& static_cache, ApiHandler& api_handler,
+                   RateLimits rate_limits = {})
+        : compress_executor_{ioc.get_executor()}
+        , static_cache_{static_cache}
+        , api_handler_(api_handler)
+        , etag_epoch_(std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::system_clock::now().time_since_epoch()).count())
+        , method_not_allowed_{MakeMethodNotAllowedResponses()}
+        , overloaded_{MakeOverloadedResponse()}
+        , token_limiter_{rate_limits.per_token}
+        , ip_limiter_{rate_limits.per_ip}
+        , trusted_proxies_{std::move(rate_limits.trusted_proxies)} {
     }
 
     RequestHandler(const RequestHandler&) = delete;
@@ -25,36 +139,114 @@ public:
 
     template <typename Body, typename Allocator, typename Send>
     void operator()(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
-        const auto& target = DecodeUrl(std::string{req.target()});
-        const auto& body = std::string{req.body()};
-        HandleRequest(req.method(), target, body, req.base(), [send](StringResponse response) {
-            send(std::move(response));
-        });
+        // Большинство путей не содержит экранированных символов, и тогда копия не нужна
+        std::string decoded;
+        std::string_view target{req.target().data(), req.target().size()};
+        if (target.find_first_of("%+") != std::string_view::npos) {
+            decoded = DecodeUrl(std::string{target});
+            target = decoded;
+        }
+        const auto method = req.method();
+        const auto coding = compression::NegotiateCoding(req[http::field::accept_encoding]);
+        auto respond = [this, send, coding, head = method == http::verb::head](StringResponse response) {
+            // Ответ на HEAD сообщает длину тела, но само тело не отправляется и не сжимается
+            if (head && !response.body().empty()) {
+                const auto size = response.body().size();
+                std::string{}.swap(response.body());
+                response.content_length(size);
+            }
+            if (!compression::ShouldCompress(response)) {
+                return send(std::move(response));
+            }
+            // Ответ может прийти из strand игры, а сжатию там не место. Сессия HTTP сжимает ответ
+            // в своём потоке, остальные получатели - в общем пуле
+            auto compress = [send, coding, response = std::move(response)]() mutable {
+                compression::CompressResponse(response, coding);
+                send(std::move(response));
+            };
+            if constexpr (requires { send.GetExecutor(); }) {
+                net::post(send.GetExecutor(), std::move(compress));
+            } else {
+                net::post(compress_executor_, std::move(compress));
+            }
+        };
+
+        if (!target.starts_with("/api/") && (method == http::verb::get || method == http::verb::head)) {
+            auto response = MakeStaticResponse(method, target, req.base());
+            if (auto* file = std::get_if<http_server::FileResponse>(&response)) {
+                return send(std::move(*file));
+            }
+            return respond(std::move(std::get<StringResponse>(response)));
+        }
+        // Сессия HTTP сообщает адрес клиента и то, что клиент отключился: тогда его запрос не тратит время strand
+        http_server::AbandonFlag abandoned;
+        std::optional<net::ip::address> client;
+        if constexpr (requires { send.GetAbandonFlag(); send.GetClientAddress(); }) {
+            abandoned = send.GetAbandonFlag();
+            client = ResolveClientAddress(send.GetClientAddress(), req[ForwardedForHeader], trusted_proxies_);
+        }
+        HandleRequest(method, target, req.body(), req.base(), client,
+                      ResponseCallback{std::move(respond), std::move(abandoned)});
    }
 
+    // Подключение по WebSocket: /api/v1/game/ws?token=<authToken>
+    // или /api/v1/game/spectate?map=<id> для зрителей
+    void HandleUpgrade(tcp::socket&& socket, StringRequest&& request) const;
+
 private:
-    std::string GetToken(const http::fields& headers) const;
+    std::string GetToken(const RequestFields& headers) const;
 
-    using HttpHeaders = std::unordered_map<http::field, std::string>;
-    StringResponse HandleResponse(http::status status, const std::string& data, const HttpHeaders& headers) const;
-    StringResponse HandleError(http::status status, const std::string& code, const std::string& message, const HttpHeaders& headers) const;
+    StringResponse HandleResponse(http::status status, std::string data, HttpHeaders headers) const;
+    StringResponse HandleError(http::status status, const std::string& code, const std::string& message, HttpHeaders headers) const;
     StringResponse HandleAuthorizationError() const;
-    StringResponse HandleAllowMethodError(const std::string& allowed_methods) const;
+    // Ответ 400, если тип содержимого не JSON (и не двоичный формат, если он разрешён)
+    std::optional<StringResponse> CheckContentType(const RequestFields& headers, bool allow_binary) const;
+    StringResponse HandleAllowMethodError(std::string_view allowed_methods) const;
+    // Ответы 405 не зависят от запроса и собираются один раз для каждого маршрута
+    std::array<StringResponse, Routes.size()> MakeMethodNotAllowedResponses() const;
+    // 503 с Retry-After для второстепенных маршрутов при перегрузке
+    StringResponse MakeOverloadedResponse() const;
+    // 429 с Retry-After для клиента, исчерпавшего свой лимит запросов
+    StringResponse HandleTooManyRequests(std::chrono::seconds retry_after) const;
+    // 304 для ответов, формат которых выбирается по Accept
+    StringResponse HandleNotModified(const std::string& etag) const;
+
+    // Версии данных начинаются заново при каждом запуске, поэтому в ETag добавляется время запуска
+    std::string MakeETag(char kind, uint64_t version, std::string_view variant) const;
 
-    void HandleRequest(boost::beast::http::verb method, const std::string& target, const std::string& body,
-                        const http::fields& headers, const ResponseCallback& callback) const;
+    // Лимиты проверяются до обращения к strand игры: по адресу client, если он известен, и по токену игрока
+    void HandleRequest(boost::beast::http::verb method, std::string_view target, const std::string& body,
+                        const RequestFields& headers, const std::optional<net::ip::address>& client,
+                        const ResponseCallback& callback) const;
     void HandleGetMaps(const ResponseCallback& callback) const;
-    void HandleGetMapById(const std::string& id, const ResponseCallback& callback) const;
-    void HandleGetResource(const std::string& target, const ResponseCallback& callback) const;
+    void HandleGetMapById(std::string_view id, const ResponseCallback& callback) const;
+    // Статический файл. Большие файлы без сжатия отдаются из дескриптора, остальные - из памяти.
+    // Поддерживается Range с одним диапазоном
+    using StaticResponse = std::variant<StringResponse, http_server::FileResponse>;
+    StaticResponse MakeStaticResponse(http::verb method, std::string_view target, const RequestFields& headers) const;
     void HandleJoinGame(const std::string& body, const ResponseCallback& callback) const;
-    void HandleGetPlayers(const std::string& token, const ResponseCallback& callback) const;
-    void HandleGetGameState(const std::string& token, const ResponseCallback& callback) const;
-    void HandlePlayerAction(const std::string& token, const std::string& body, const ResponseCallback& callback) const;
+    void HandleGetPlayers(const std::string& token, Encoding encoding, const RequestFields& headers,
+                          const ResponseCallback& callback) const;
+    void HandleSpectate(std::string_view target, const ResponseCallback& callback) const;
+    void HandleSpectatorUpgrade(const std::shared_ptr<http_server::WebSocketSession>& session,
+                                const std::string& target, StringRequest&& request) const;
+    void HandleGetGameState(const std::string& token, std::string_view target, Encoding encoding,
+                            const RequestFields& headers, const ResponseCallback& callback) const;
+    void HandlePlayerAction(const std::string& token, const std::string& body, Encoding encoding, const ResponseCallback& callback) const;
+    void HandleNavigatePlayer(const std::string& token, const std::string& body, const ResponseCallback& callback) const;
+    void HandlePlayerBatch(const std::string& body, const ResponseCallback& callback) const;
     void HandleGameTick(const std::string& body, const ResponseCallback& callback) const;
-    void HandleGetRecords(const std::string& target, const ResponseCallback& callback) const;
+    void HandleGetRecords(std::string_view target, const ResponseCallback& callback) const;
 
-    std::string resources_;
+    net::io_context::executor_type compress_executor_;
+    const StaticCache& static_cache_;
     ApiHandler& api_handler_;
+    int64_t etag_epoch_;
+    const std::array<StringResponse, Routes.size()> method_not_allowed_;
+    const StringResponse overloaded_;
+    mutable RateLimiter token_limiter_;
+    mutable RateLimiter ip_limiter_;
+    const std::vector<net::ip::address> trusted_proxies_;
 };
 
 }  // namespace http_handler
@@ -0,0 +1,176 @@
+#pragma once
+#include <boost/beast/http/verb.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+namespace http_handler {
+
+namespace http = boost::beast::http;
+
+enum class Route : uint8_t {
+    JoinGame,
+    GameState,
+    Spectate,
+    GameTick,
+    Maps,
+    MapById,
+    Players,
+    PlayerAction,
+    NavigatePlayer,
+    PlayerBatch,
+    Records
+};
+
+// Разрешённые методы маршрута - битовая маска
+namespace methods {
+constexpr uint8_t Get = 1;
+constexpr uint8_t Head = 2;
+constexpr uint8_t Post = 4;
+}  // namespace methods
+
+constexpr uint8_t ToMethodMask(http::verb verb) {
+    switch (verb) {
+    case http::verb::get:
+        return methods::Get;
+    case http::verb::head:
+        return methods::Head;
+    case http::verb::post:
+        return methods::Post;
+    default:
+        return 0;
+    }
+}
+
+// Второстепенные маршруты при перегрузке сразу получают 503, чтобы не отнимать strand у команд игроков
+enum class Priority : uint8_t { Critical, Sheddable };
+
+struct RouteSpec {
+    // Для маршрута с параметром - путь до параметра, заканчивается на '/'
+    std::string_view path;
+    Route route;
+    uint8_t methods;
+    // Значение заголовка Allow для ответа 405
+    std::string_view allow;
+    Priority priority;
+    bool has_param = false;
+};
+
+// Порядок совпадает с порядком Route
+inline constexpr std::array Routes{
+    RouteSpec{"/api/v1/game/join", Route::JoinGame, methods::Post, "POST", Priority::Sheddable},
+    // wait=1 - дождаться следующего тика, radius=R - только объекты рядом с собакой игрока
+    RouteSpec{"/api/v1/game/state", Route::GameState, methods::Get | methods::Head, "GET, HEAD", Priority::Sheddable},
+    // состояние карты для зрителей: map=<id>, instance=N, wait=1
+    RouteSpec{"/api/v1/game/spectate", Route::Spectate, methods::Get | methods::Head, "GET, HEAD", Priority::Sheddable},
+    RouteSpec{"/api/v1/game/tick", Route::GameTick, methods::Post, "POST", Priority::Critical},
+    RouteSpec{"/api/v1/maps", Route::Maps, methods::Get | methods::Head, "GET, HEAD", Priority::Sheddable},
+    RouteSpec{"/api/v1/maps/", Route::MapById, methods::Get | methods::Head, "GET, HEAD", Priority::Sheddable, true},
+    RouteSpec{"/api/v1/game/players", Route::Players, methods::Get | methods::Head, "GET, HEAD", Priority::Sheddable},
+    RouteSpec{"/api/v1/game/player/action", Route::PlayerAction, methods::Post, "POST", Priority::Critical},
+    RouteSpec{"/api/v1/game/player/navigate", Route::NavigatePlayer, methods::Post, "POST", Priority::Critical},
+    // команды нескольких игроков одним запросом, токены передаются в теле
+    RouteSpec{"/api/v1/game/batch", Route::PlayerBatch, methods::Post, "POST", Priority::Critical},
+    RouteSpec{"/api/v1/game/records", Route::Records, methods::Get, "GET", Priority::Sheddable}
+};
+
+namespace detail {
+
+constexpr size_t RouteSlots = 32;
+constexpr int8_t EmptySlot = -1;
+
+constexpr uint32_t HashPath(std::string_view path, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (char c : path) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+struct RouteIndex {
+    uint32_t seed = 0;
+    std::array<int8_t, RouteSlots> slots{};
+};
+
+// Совершенный хеш: подбирается seed, при котором все пути попадают в разные ячейки.
+// Подбор идёт при компиляции, поэтому поиск маршрута - одно вычисление хеша и одно сравнение
+constexpr RouteIndex BuildRouteIndex() {
+    for (uint32_t seed = 0; seed < 100000; ++seed) {
+        RouteIndex index{seed, {}};
+        index.slots.fill(EmptySlot);
+        bool collision = false;
+        for (size_t i = 0; i < Routes.size() && !collision; ++i) {
+            auto& slot = index.slots[HashPath(Routes[i].path, seed) % RouteSlots];
+            collision = slot != EmptySlot;
+            slot = static_cast<int8_t>(i);
+        }
+        if (!collision) {
+            return index;
+        }
+    }
+    throw std::logic_error("No perfect hash for routes");
+}
+
+inline constexpr RouteIndex Index = BuildRouteIndex();
+
+constexpr const RouteSpec* FindRoute(std::string_view path) {
+    const auto slot = Index.slots[HashPath(path, Index.seed) % RouteSlots];
+    if (slot == EmptySlot || Routes[slot].path != path) {
+        return nullptr;
+    }
+    return &Routes[slot];
+}
+
+constexpr bool IsOrdered() {
+    for (size_t i = 0; i < Routes.size(); ++i) {
+        if (static_cast<size_t>(Routes[i].route) != i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace detail
+
+static_assert(detail::IsOrdered(), "Routes should be listed in the order of Route");
+
+struct RouteMatch {
+    const RouteSpec* spec = nullptr;
+    // Последний сегмент пути для маршрутов с параметром
+    std::string_view param;
+    // Часть после '?', без него
+    std::string_view query;
+};
+
+// Ищет маршрут по пути запроса. Строка не копируется, параметр и запрос ссылаются на target
+constexpr std::optional<RouteMatch> MatchRoute(std::string_view target) {
+    const auto query_start = target.find('?');
+    const auto path = target.substr(0, query_start);
+    const auto query = query_start == std::string_view::npos ? std::string_view{} : target.substr(query_start + 1);
+
+    if (const auto* spec = detail::FindRoute(path); spec && !spec->has_param) {
+        return RouteMatch{spec, {}, query};
+    }
+    const auto slash = path.rfind('/');
+    if (slash == std::string_view::npos || slash + 1 == path.size()) {
+        return std::nullopt;
+    }
+    if (const auto* spec = detail::FindRoute(path.substr(0, slash + 1)); spec && spec->has_param) {
+        return RouteMatch{spec, path.substr(slash + 1), query};
+    }
+    return std::nullopt;
+}
+
+static_assert(MatchRoute("/api/v1/maps")->spec->route == Route::Maps);
+static_assert(MatchRoute("/api/v1/maps/map1")->param == "map1");
+static_assert(MatchRoute("/api/v1/game/state?wait=1")->query == "wait=1");
+static_assert(!MatchRoute("/api/v1/maps/"));
+static_assert(!MatchRoute("/api/v1/game"));
+static_assert(MatchRoute("/api/v1/game/player/action")->spec->priority == Priority::Critical);
+
+}  // namespace http_handler
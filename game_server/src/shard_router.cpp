@@ -0,0 +1,509 @@
+#include "shard_router.h"
+#include "request_handler.h"
+#include "logger.h"
+#include "constants.h"
+
+#include "app/app.h"
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/write.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <stdexcept>
+#include <unordered_set>
+
+#include <sys/socket.h>
+
+using namespace std::literals;
+
+namespace shard_router {
+
+namespace {
+
+constexpr auto ConnectTimeout = std::chrono::seconds(5);
+// Больше, чем длится long-poll запрос состояния
+constexpr auto ForwardTimeout = std::chrono::seconds(30);
+constexpr uint64_t MaxResponseBodySize = 64 * 1024 * 1024;
+
+StringResponse MakeJsonResponse(http::status status, std::string body, bool keep_alive) {
+    StringResponse response{status, 11};
+    response.set(http::field::content_type, "application/json");
+    response.set(http::field::cache_control, "no-cache");
+    response.body() = std::move(body);
+    response.keep_alive(keep_alive);
+    response.prepare_payload();
+    return response;
+}
+
+StringResponse MakeError(http::status status, const std::string& code, const std::string& message, bool keep_alive) {
+    json::object error;
+    error[constants::CODE] = code;
+    error[constants::MESSAGE] = message;
+    return MakeJsonResponse(status, json::serialize(error), keep_alive);
+}
+
+// Маршрутизатор принимает соединения клиентов сам, поэтому заголовок, присланный клиентом, заменяется
+void SetForwardedFor(StringRequest& request, const net::ip::address& client) {
+    request.set(http_handler::ForwardedForHeader, client.to_string());
+}
+
+// Значение параметра name из строки запроса, без декодирования
+std::string GetQueryParam(std::string_view target, std::string_view name) {
+    const auto query_start = target.find('?');
+    if (query_start == std::string_view::npos) {
+        return {};
+    }
+    auto query = target.substr(query_start + 1);
+    while (!query.empty()) {
+        const auto amp = query.find('&');
+        const auto param = query.substr(0, amp);
+        const auto eq = param.find('=');
+        if (eq != std::string_view::npos && param.substr(0, eq) == name) {
+            return std::string{param.substr(eq + 1)};
+        }
+        query = amp == std::string_view::npos ? std::string_view{} : query.substr(amp + 1);
+    }
+    return {};
+}
+
+// Повтор такого запроса не меняет результат, поэтому его можно отправить ещё раз,
+// даже если шард мог его уже выполнить
+bool IsIdempotent(http::verb method) {
+    return method == http::verb::get || method == http::verb::head || method == http::verb::options
+        || method == http::verb::put || method == http::verb::delete_;
+}
+
+// Простаивающее соединение, которое шард уже закрыл, сразу готово к чтению: 0 байт или ошибка.
+// Проверка сужает окно, в котором запрос уходит в закрытое соединение, но не закрывает его
+bool IsReusable(tcp::socket& socket) {
+    char byte;
+    const auto received = ::recv(socket.native_handle(), &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+std::optional<size_t> GetTokenShard(const std::string& token, size_t shards_count) {
+    if (token.empty()) {
+        return std::nullopt;
+    }
+    const auto shard = PlayerTokens::GetShard(Token{token});
+    if (!shard || static_cast<size_t>(*shard) >= shards_count) {
+        return std::nullopt;
+    }
+    return static_cast<size_t>(*shard);
+}
+
+/*
+ *  Туннель для WebSocket: после пересылки запроса на установку соединения
+ *  байты копируются в обе стороны без разбора кадров.
+ *  Оба сокета работают в одном strand, поэтому закрытие из любой половины безопасно.
+ */
+class Tunnel : public std::enable_shared_from_this<Tunnel> {
+public:
+    Tunnel(tcp::socket&& client, tcp::socket&& shard)
+        : client_{std::move(client)}
+        , shard_{std::move(shard)} {
+    }
+
+    void Run(StringRequest&& request) {
+        request_ = std::move(request);
+        http::async_write(shard_.socket, request_, [self = shared_from_this()](sys::error_code ec, std::size_t) {
+            if (ec) {
+                http_server::ReportError(ec, "shard upgrade"sv);
+                return self->Close();
+            }
+            self->Pump(self->client_, self->shard_);
+            self->Pump(self->shard_, self->client_);
+        });
+    }
+
+private:
+    static constexpr size_t BufferSize = 16 * 1024;
+
+    struct Side {
+        tcp::socket socket;
+        std::array<char, BufferSize> buffer{};
+    };
+
+    void Pump(Side& from, Side& to) {
+        from.socket.async_read_some(net::buffer(from.buffer),
+                                    [self = shared_from_this(), &from, &to](sys::error_code ec, std::size_t bytes_read) {
+            if (ec) {
+                return self->Close();
+            }
+            net::async_write(to.socket, net::buffer(from.buffer.data(), bytes_read),
+                             [self, &from, &to](sys::error_code ec, std::size_t) {
+                if (ec) {
+                    return self->Close();
+                }
+                self->Pump(from, to);
+            });
+        });
+    }
+
+    void Close() {
+        sys::error_code ec;
+        client_.socket.shutdown(tcp::socket::shutdown_both, ec);
+        client_.socket.close(ec);
+        shard_.socket.shutdown(tcp::socket::shutdown_both, ec);
+        shard_.socket.close(ec);
+    }
+
+    Side client_;
+    Side shard_;
+    StringRequest request_;
+};
+
+}  // namespace
+
+Shard ParseShard(const std::string& spec) {
+    const auto eq = spec.find('=');
+    const auto colon = spec.rfind(':', eq);
+    if (eq == std::string::npos || colon == std::string::npos || colon == 0 || colon + 1 == eq) {
+        throw std::invalid_argument("Shard should be specified as host:port=map1,map2: "s + spec);
+    }
+
+    Shard shard{spec.substr(0, colon), spec.substr(colon + 1, eq - colon - 1), SplitMapIds(spec.substr(eq + 1))};
+    if (shard.map_ids.empty()) {
+        throw std::invalid_argument("Shard has no maps: "s + spec);
+    }
+    return shard;
+}
+
+std::vector<std::string> SplitMapIds(const std::string& map_ids) {
+    std::vector<std::string> result;
+    size_t start = 0;
+    while (start <= map_ids.size()) {
+        const auto comma = std::min(map_ids.find(',', start), map_ids.size());
+        if (comma > start) {
+            result.push_back(map_ids.substr(start, comma - start));
+        }
+        start = comma + 1;
+    }
+    return result;
+}
+
+/*
+ *  Один обмен запрос-ответ с шардом.
+ *  Соединение из пула шард мог уже закрыть по таймауту, тогда запрос
+ *  один раз повторяется по новому соединению. Если запрос уже отправлен целиком,
+ *  шард мог его выполнить, поэтому повторяются только идемпотентные запросы.
+ */
+class ShardClient::Exchange : public std::enable_shared_from_this<ShardClient::Exchange> {
+public:
+    Exchange(ShardClient& client, StringRequest&& request, Callback&& callback)
+        : client_{client}
+        , request_{std::move(request)}
+        , callback_{std::move(callback)} {
+        client_keep_alive_ = request_.keep_alive();
+        request_.keep_alive(true);
+    }
+
+    void Run() {
+        stream_ = client_.TakeIdle();
+        reused_ = stream_ != nullptr;
+        if (reused_) {
+            return Write();
+        }
+        Connect();
+    }
+
+private:
+    void Connect() {
+        stream_ = std::make_unique<beast::tcp_stream>(net::make_strand(client_.ioc_));
+        stream_->expires_after(ConnectTimeout);
+        stream_->async_connect(client_.endpoints_, [self = shared_from_this()](sys::error_code ec, const tcp::endpoint&) {
+            if (ec) {
+                return self->Fail(ec, "shard connect"sv);
+            }
+            self->Write();
+        });
+    }
+
+    void Write() {
+        stream_->expires_after(ForwardTimeout);
+        http::async_write(*stream_, request_, [self = shared_from_this()](sys::error_code ec, std::size_t) {
+            if (ec) {
+                // Запрос не дошёл целиком, и шард не мог его выполнить
+                return self->Retry(ec, "shard write"sv, false);
+            }
+            self->Read();
+        });
+    }
+
+    void Read() {
+        buffer_.clear();
+        parser_.emplace();
+        parser_->body_limit(MaxResponseBodySize);
+        // Ответ на HEAD содержит Content-Length, но не тело
+        parser_->skip(request_.method() == http::verb::head);
+        http::async_read(*stream_, buffer_, *parser_, [self = shared_from_this()](sys::error_code ec, std::size_t) {
+            if (ec) {
+                return self->Retry(ec, "shard read"sv, true);
+            }
+            self->Complete();
+        });
+    }
+
+    void Complete() {
+        auto response = parser_->release();
+        if (response.keep_alive()) {
+            client_.ReturnIdle(std::move(stream_));
+        }
+        response.keep_alive(client_keep_alive_);
+        callback_(std::move(response));
+    }
+
+    void Retry(sys::error_code ec, std::string_view what, bool sent) {
+        const bool closed_by_shard = ec == http::error::end_of_stream
+                                     || ec == net::error::connection_reset
+                                     || ec == net::error::broken_pipe
+                                     || ec == net::error::eof;
+        if (reused_ && closed_by_shard && (!sent || IsIdempotent(request_.method()))) {
+            reused_ = false;
+            return Connect();
+        }
+        Fail(ec, what);
+    }
+
+    void Fail(sys::error_code ec, std::string_view what) {
+        http_server::ReportError(ec, what);
+        stream_.reset();
+        callback_(MakeError(http::status::bad_gateway, "shardUnavailable", "Shard is unavailable", client_keep_alive_));
+    }
+
+    ShardClient& client_;
+    StringRequest request_;
+    Callback callback_;
+    bool client_keep_alive_ = false;
+    bool reused_ = false;
+    std::unique_ptr<beast::tcp_stream> stream_;
+    beast::flat_buffer buffer_;
+    std::optional<http::response_parser<http::string_body>> parser_;
+};
+
+ShardClient::ShardClient(net::io_context& ioc, const Shard& shard)
+    : ioc_{ioc}
+    , endpoints_{tcp::resolver{ioc}.resolve(shard.host, shard.port)} {
+}
+
+void ShardClient::Forward(StringRequest request, Callback callback) {
+    std::make_shared<Exchange>(*this, std::move(request), std::move(callback))->Run();
+}
+
+void ShardClient::Connect(const tcp::socket::executor_type& executor,
+                          std::function<void(sys::error_code, tcp::socket)> handler) {
+    auto socket = std::make_shared<tcp::socket>(executor);
+    net::async_connect(*socket, endpoints_, [socket, handler = std::move(handler)](sys::error_code ec, const tcp::endpoint&) {
+        handler(ec, std::move(*socket));
+    });
+}
+
+std::unique_ptr<beast::tcp_stream> ShardClient::TakeIdle() {
+    std::lock_guard lock{mutex_};
+    while (!idle_.empty()) {
+        auto stream = std::move(idle_.back());
+        idle_.pop_back();
+        if (IsReusable(stream->socket())) {
+            return stream;
+        }
+    }
+    return nullptr;
+}
+
+void ShardClient::ReturnIdle(std::unique_ptr<beast::tcp_stream> stream) {
+    stream->expires_never();
+    std::lock_guard lock{mutex_};
+    idle_.push_back(std::move(stream));
+}
+
+Router::Router(net::io_context& ioc, const std::vector<Shard>& shards, const json::object& config) {
+    if (shards.empty() || shards.size() > PlayerTokens::MaxShards) {
+        throw std::invalid_argument("Router needs from 1 to 16 shards");
+    }
+
+    json::array maps;
+    std::unordered_set<std::string> config_map_ids;
+    for (const auto& jmap : config.at(constants::MAPS).as_array()) {
+        const std::string id{jmap.at(constants::ID).as_string()};
+        json::object obj;
+        obj[constants::ID] = id;
+        obj[constants::NAME] = jmap.at(constants::NAME);
+        maps.push_back(std::move(obj));
+        config_map_ids.insert(id);
+    }
+    maps_json_ = json::serialize(maps);
+
+    for (size_t i = 0; i < shards.size(); ++i) {
+        for (const auto& map_id : shards[i].map_ids) {
+            if (!config_map_ids.contains(map_id)) {
+                throw std::invalid_argument("Unknown map "s + map_id + " in shard list"s);
+            }
+            if (!map_to_shard_.emplace(map_id, i).second) {
+                throw std::invalid_argument("Map "s + map_id + " is assigned to several shards"s);
+            }
+        }
+        clients_.push_back(std::make_unique<ShardClient>(ioc, shards[i]));
+    }
+    for (const auto& map_id : config_map_ids) {
+        if (!map_to_shard_.contains(map_id)) {
+            throw std::invalid_argument("Map "s + map_id + " is not assigned to any shard"s);
+        }
+    }
+}
+
+void Router::operator()(StringRequest&& request, const net::ip::address& client, ResponseCallback callback) {
+    SetForwardedFor(request, client);
+    const auto target = http_handler::DecodeUrl(std::string{request.target()});
+    const auto path = target.substr(0, target.find('?'));
+    const auto method = request.method();
+
+    std::optional<size_t> shard;
+    if (path == "/api/v1/maps" && (method == http::verb::get || method == http::verb::head)) {
+        auto response = MakeJsonResponse(http::status::ok, maps_json_, request.keep_alive());
+        if (method == http::verb::head) {
+            response.body().clear();
+        }
+        return callback(std::move(response));
+    } else if (path.starts_with("/api/v1/maps/")) {
+        shard = FindMapShard(path.substr("/api/v1/maps/"sv.size()));
+    } else if (path == "/api/v1/game/spectate") {
+        shard = FindMapShard(GetQueryParam(target, "map"sv));
+    } else if (path == "/api/v1/game/join") {
+        shard = FindJoinShard(request.body());
+    } else if (path == "/api/v1/game/tick") {
+        return Broadcast(std::move(request), std::move(callback));
+    } else if (path == "/api/v1/game/batch") {
+        const auto shards = FindBatchShards(request.body());
+        if (shards.size() > 1) {
+            return callback(MakeError(http::status::bad_request, "invalidArgument",
+                                      "Batch actions should belong to players of one shard", request.keep_alive()));
+        }
+        if (!shards.empty()) {
+            shard = shards.front();
+        }
+    } else {
+        shard = FindTokenShard(request, target);
+    }
+
+    // Запросы, которые нельзя отнести к шарду, отвечает первый шард, в том числе ошибками
+    clients_.at(shard.value_or(0))->Forward(std::move(request), std::move(callback));
+}
+
+void Router::HandleUpgrade(tcp::socket&& socket, StringRequest&& request) {
+    const auto target = http_handler::DecodeUrl(std::string{request.target()});
+    const auto shard = (target.substr(0, target.find('?')) == "/api/v1/game/spectate"
+                        ? FindMapShard(GetQueryParam(target, "map"sv))
+                        : FindTokenShard(request, target)).value_or(0);
+    sys::error_code ec;
+    if (const auto endpoint = socket.remote_endpoint(ec); !ec) {
+        SetForwardedFor(request, endpoint.address());
+    } else {
+        request.erase(http_handler::ForwardedForHeader);
+    }
+
+    auto client = std::make_shared<tcp::socket>(std::move(socket));
+    auto upgrade = std::make_shared<StringRequest>(std::move(request));
+    clients_.at(shard)->Connect(client->get_executor(), [client, upgrade](sys::error_code ec, tcp::socket shard_socket) {
+        if (ec) {
+            http_server::ReportError(ec, "shard connect"sv);
+            auto response = std::make_shared<StringResponse>(
+                MakeError(http::status::bad_gateway, "shardUnavailable", "Shard is unavailable", false));
+            http::async_write(*client, *response, [client, response](sys::error_code, std::size_t) {
+                sys::error_code ignored;
+                client->shutdown(tcp::socket::shutdown_send, ignored);
+            });
+            return;
+        }
+        std::make_shared<Tunnel>(std::move(*client), std::move(shard_socket))->Run(std::move(*upgrade));
+    });
+}
+
+std::optional<size_t> Router::FindMapShard(const std::string& map_id) const {
+    if (auto it = map_to_shard_.find(map_id); it != map_to_shard_.end()) {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+std::optional<size_t> Router::FindTokenShard(const StringRequest& request, const std::string& target) const {
+    if (auto it = request.find(http::field::authorization); it != request.end()) {
+        const auto header = it->value();
+        if (header.starts_with("Bearer "sv)) {
+            return GetTokenShard(std::string{header.substr("Bearer "sv.size())}, clients_.size());
+        }
+    }
+    return GetTokenShard(GetQueryParam(target, "token"sv), clients_.size());
+}
+
+std::optional<size_t> Router::FindJoinShard(const std::string& body) const {
+    json::error_code ec;
+    const auto value = json::parse(body, ec);
+    if (ec || !value.is_object()) {
+        return std::nullopt;
+    }
+    const auto* map_id = value.as_object().if_contains("mapId");
+    if (!map_id || !map_id->is_string()) {
+        return std::nullopt;
+    }
+    return FindMapShard(std::string{map_id->as_string()});
+}
+
+std::vector<size_t> Router::FindBatchShards(const std::string& body) const {
+    std::vector<size_t> shards;
+    json::error_code ec;
+    const auto value = json::parse(body, ec);
+    if (ec || !value.is_object()) {
+        return shards;
+    }
+    const auto* actions = value.as_object().if_contains("actions");
+    if (!actions || !actions->is_array()) {
+        return shards;
+    }
+    for (const auto& action : actions->as_array()) {
+        const auto* token = action.is_object() ? action.as_object().if_contains("token") : nullptr;
+        if (!token || !token->is_string()) {
+            continue;
+        }
+        const auto shard = GetTokenShard(std::string{token->as_string()}, clients_.size());
+        if (shard && std::find(shards.begin(), shards.end(), *shard) == shards.end()) {
+            shards.push_back(*shard);
+        }
+    }
+    return shards;
+}
+
+void Router::Broadcast(StringRequest&& request, ResponseCallback callback) {
+    // Отвечаем первой ошибкой, если она была, иначе ответом первого шарда
+    struct Pending {
+        std::mutex mutex;
+        std::vector<std::optional<StringResponse>> responses;
+        size_t left;
+        ResponseCallback callback;
+    };
+    auto pending = std::make_shared<Pending>();
+    pending->responses.resize(clients_.size());
+    pending->left = clients_.size();
+    pending->callback = std::move(callback);
+
+    for (size_t i = 0; i < clients_.size(); ++i) {
+        clients_[i]->Forward(request, [pending, i](StringResponse response) {
+            {
+                std::lock_guard lock{pending->mutex};
+                pending->responses[i] = std::move(response);
+                if (--pending->left > 0) {
+                    return;
+                }
+            }
+            auto& responses = pending->responses;
+            auto it = std::find_if(responses.begin(), responses.end(), [](const auto& response) {
+                return response->result_int() >= 400;
+            });
+            pending->callback(std::move(it != responses.end() ? **it : *responses.front()));
+        });
+    }
+}
+
+}  // namespace shard_router
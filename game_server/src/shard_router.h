@@ -0,0 +1,100 @@
+#pragma once
+#include "http_server.h"
+
+#include <boost/json.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace shard_router {
+
+namespace json = boost::json;
+
+// Процесс-шард: адрес, на котором он слушает, и карты, которыми он владеет.
+// Номер шарда - его позиция в списке, он же записан в первой цифре выданных им токенов
+struct Shard {
+    std::string host;
+    std::string port;
+    std::vector<std::string> map_ids;
+};
+
+// Разбирает описание шарда вида "127.0.0.1:9001=map1,map2"
+Shard ParseShard(const std::string& spec);
+// Разбирает список идентификаторов карт через запятую
+std::vector<std::string> SplitMapIds(const std::string& map_ids);
+
+/*
+ *  Соединения с одним шардом. Запрос отправляется по свободному соединению
+ *  из пула или по новому, после ответа соединение возвращается в пул.
+ */
+class ShardClient {
+public:
+    using Callback = std::function<void(StringResponse)>;
+
+    ShardClient(net::io_context& ioc, const Shard& shard);
+
+    ShardClient(const ShardClient&) = delete;
+    ShardClient& operator=(const ShardClient&) = delete;
+
+    // callback вызывается ровно один раз: с ответом шарда или с ответом 502
+    void Forward(StringRequest request, Callback callback);
+    // Открывает отдельное соединение для WebSocket. Оно не возвращается в пул,
+    // и обработчики работают в executor клиентского сокета
+    void Connect(const tcp::socket::executor_type& executor,
+                 std::function<void(sys::error_code, tcp::socket)> handler);
+
+private:
+    class Exchange;
+
+    std::unique_ptr<beast::tcp_stream> TakeIdle();
+    void ReturnIdle(std::unique_ptr<beast::tcp_stream> stream);
+
+    net::io_context& ioc_;
+    tcp::resolver::results_type endpoints_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<beast::tcp_stream>> idle_;
+};
+
+/*
+ *  Маршрутизатор перед процессами-шардами. Сам игру не ведёт, а пересылает запросы:
+ *  - по идентификатору карты (вход в игру, описание карты, зрители) - шарду, владеющему картой;
+ *  - по токену (состояние, действия, WebSocket) - шарду, выдавшему токен;
+ *  - ручной тик - всем шардам;
+ *  - остальное (статика, рекорды) - первому шарду.
+ *  Список карт собирается из общего конфига, чтобы не опрашивать шарды.
+ *  Адрес клиента передаётся шарду в X-Forwarded-For: шард, доверяющий маршрутизатору
+ *  (rateLimits.trustedProxies), считает по нему лимиты.
+ */
+class Router {
+public:
+    using ResponseCallback = std::function<void(StringResponse)>;
+
+    Router(net::io_context& ioc, const std::vector<Shard>& shards, const json::object& config);
+
+    Router(const Router&) = delete;
+    Router& operator=(const Router&) = delete;
+
+    void operator()(StringRequest&& request, const net::ip::address& client, ResponseCallback callback);
+    void HandleUpgrade(tcp::socket&& socket, StringRequest&& request);
+
+private:
+    std::optional<size_t> FindMapShard(const std::string& map_id) const;
+    std::optional<size_t> FindTokenShard(const StringRequest& request, const std::string& target) const;
+    std::optional<size_t> FindJoinShard(const std::string& body) const;
+    // Шарды всех токенов пакета действий
+    std::vector<size_t> FindBatchShards(const std::string& body) const;
+
+    void Broadcast(StringRequest&& request, ResponseCallback callback);
+
+    std::vector<std::unique_ptr<ShardClient>> clients_;
+    std::unordered_map<std::string, size_t> map_to_shard_;
+    std::string maps_json_;
+};
+
+}  // namespace shard_router
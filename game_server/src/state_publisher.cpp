@@ -0,0 +1,110 @@
+#include "state_publisher.h"
+
+void StatePublisher::OpenChannel(model::Map::InstanceId map) {
+    std::lock_guard lock{mutex_};
+    channels_.try_emplace(map);
+}
+
+bool StatePublisher::Subscribe(model::Map::InstanceId map, std::weak_ptr<StateSubscriber> subscriber) {
+    std::lock_guard lock{mutex_};
+    auto it = channels_.find(map);
+    if (it == channels_.end()) {
+        return false;
+    }
+    it->second.subscribers.push_back(std::move(subscriber));
+    return true;
+}
+
+std::optional<StatePublisher::WaitId> StatePublisher::Wait(model::Map::InstanceId map, Waiter waiter) {
+    std::lock_guard lock{mutex_};
+    auto it = channels_.find(map);
+    if (it == channels_.end()) {
+        return std::nullopt;
+    }
+    const auto id = ++next_wait_id_;
+    it->second.waiters.emplace_back(id, std::move(waiter));
+    return id;
+}
+
+void StatePublisher::CancelWait(model::Map::InstanceId map, WaitId id) {
+    std::lock_guard lock{mutex_};
+    if (auto it = channels_.find(map); it != channels_.end()) {
+        std::erase_if(it->second.waiters, [id](const auto& waiter) {
+            return waiter.first == id;
+        });
+    }
+}
+
+bool StatePublisher::IsWatched(model::Map::InstanceId map) const {
+    std::lock_guard lock{mutex_};
+    auto it = channels_.find(map);
+    return it != channels_.end() && (!it->second.subscribers.empty() || !it->second.waiters.empty());
+}
+
+void StatePublisher::Publish(model::Map::InstanceId map, StateFrame frame) {
+    std::vector<std::shared_ptr<StateSubscriber>> alive;
+    std::vector<std::pair<WaitId, Waiter>> waiters;
+    {
+        std::lock_guard lock{mutex_};
+        auto it = channels_.find(map);
+        if (it == channels_.end()) {
+            return;
+        }
+        auto& channel = it->second;
+        channel.latest = frame;
+        channel.latest_state = channel.versions.state;
+
+        // Заодно вычищаем подписчиков, чьи сессии уже закрыты
+        std::erase_if(channel.subscribers, [&alive](const auto& weak_subscriber) {
+            if (auto subscriber = weak_subscriber.lock()) {
+                alive.push_back(std::move(subscriber));
+                return false;
+            }
+            return true;
+        });
+        waiters.swap(channel.waiters);
+    }
+
+    // Отправляем вне блокировки: получатель может сразу же зарегистрироваться снова
+    for (const auto& subscriber : alive) {
+        subscriber->OnFrame(frame);
+    }
+    for (const auto& [_, waiter] : waiters) {
+        waiter(frame);
+    }
+}
+
+StateFrame StatePublisher::GetLatest(model::Map::InstanceId map) const {
+    std::lock_guard lock{mutex_};
+    auto it = channels_.find(map);
+    if (it == channels_.end() || it->second.latest_state != it->second.versions.state) {
+        return nullptr;
+    }
+    return it->second.latest;
+}
+
+void StatePublisher::RemoveChannel(model::Map::InstanceId map) {
+    std::lock_guard lock{mutex_};
+    channels_.erase(map);
+}
+
+StatePublisher::Versions StatePublisher::GetVersions(model::Map::InstanceId map) const {
+    std::lock_guard lock{mutex_};
+    auto it = channels_.find(map);
+    return it != channels_.end() ? it->second.versions : Versions{};
+}
+
+void StatePublisher::UpdateState(model::Map::InstanceId map) {
+    std::lock_guard lock{mutex_};
+    if (auto it = channels_.find(map); it != channels_.end()) {
+        ++it->second.versions.state;
+    }
+}
+
+void StatePublisher::UpdateMembers(model::Map::InstanceId map) {
+    std::lock_guard lock{mutex_};
+    if (auto it = channels_.find(map); it != channels_.end()) {
+        ++it->second.versions.state;
+        ++it->second.versions.members;
+    }
+}
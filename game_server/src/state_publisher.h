@@ -0,0 +1,85 @@
+#pragma once
+
+#include "model/model.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Сериализованное состояние карты. Один буфер на тик разделяется всеми получателями
+using StateFrame = std::shared_ptr<const std::string>;
+
+class StateSubscriber {
+public:
+    virtual void OnFrame(StateFrame frame) = 0;
+
+protected:
+    ~StateSubscriber() = default;
+};
+
+/*
+ *  Рассылает состояние карты после очередного тика и ведёт версии этого состояния.
+ *  Подписчики (WebSocket-сессии) получают каждый кадр, ожидающие (long-poll запросы) -
+ *  только ближайший, после чего удаляются из списка.
+ *  Регистрация и рассылка выполняются из разных потоков, поэтому списки
+ *  защищены мьютексом. Подписчики хранятся по weak_ptr и удаляются из списка,
+ *  как только соответствующая сессия закрывается.
+ *  Каналы ведутся по номеру экземпляра карты: номер не используется повторно,
+ *  поэтому таймер, сработавший после удаления экземпляра, не попадёт в чужой канал.
+ *  Канал открывается при создании экземпляра и закрывается при его удалении. Обращения
+ *  к закрытому каналу игнорируются, иначе запоздавший запрос создал бы его заново.
+ */
+class StatePublisher {
+public:
+    using Waiter = std::function<void(StateFrame)>;
+    // Номер ожидающего, чтобы снять его, не дождавшись кадра
+    using WaitId = uint64_t;
+
+    // Версии меняются при любом изменении состояния карты и состава игроков на ней.
+    // Читаются из потоков ввода-вывода без обращения к strand игры
+    struct Versions {
+        uint64_t state = 0;
+        uint64_t members = 0;
+    };
+
+    void OpenChannel(model::Map::InstanceId map);
+    // false, если канала экземпляра нет
+    bool Subscribe(model::Map::InstanceId map, std::weak_ptr<StateSubscriber> subscriber);
+    std::optional<WaitId> Wait(model::Map::InstanceId map, Waiter waiter);
+    // Снимает ожидающего, если кадр ему ещё не отправлен (например, по таймауту long-poll)
+    void CancelWait(model::Map::InstanceId map, WaitId id);
+
+    // Есть ли кому отправлять состояние карты
+    bool IsWatched(model::Map::InstanceId map) const;
+    void Publish(model::Map::InstanceId map, StateFrame frame);
+    // Последний разосланный кадр, если состояние карты с тех пор не менялось, иначе nullptr.
+    // Позволяет отвечать зрителям без сериализации
+    StateFrame GetLatest(model::Map::InstanceId map) const;
+
+    // Удаляет всё, что связано с удаляемым экземпляром карты
+    void RemoveChannel(model::Map::InstanceId map);
+
+    Versions GetVersions(model::Map::InstanceId map) const;
+    void UpdateState(model::Map::InstanceId map);
+    // Изменение состава игроков меняет и состояние карты
+    void UpdateMembers(model::Map::InstanceId map);
+
+private:
+    struct Channel {
+        std::vector<std::weak_ptr<StateSubscriber>> subscribers;
+        std::vector<std::pair<WaitId, Waiter>> waiters;
+        Versions versions;
+        StateFrame latest;
+        uint64_t latest_state = 0;
+    };
+
+    mutable std::mutex mutex_;
+    std::unordered_map<model::Map::InstanceId, Channel> channels_;
+    WaitId next_wait_id_ = 0;
+};
@@ -8,6 +8,7 @@
 #include "logger.h"
 
 #include <ranges>
+#include <unordered_map>
 #include <algorithm>
 
 
@@ -29,15 +30,20 @@ public:
 
         serialization::Manager manager{filename_, serialization::Manager::Mode::Write};
 
+        // Экземпляры сохраняются в порядке Game::GetInstances, номер экземпляра - позиция в этом порядке
         std::vector<serialization::LootRepresentation> loot_reps;
-        std::ranges::transform(game_.GetMaps(), std::back_inserter(loot_reps), [](const auto& map) {
-            return serialization::LootRepresentation(map);
+        std::unordered_map<const model::Map*, size_t> instance_numbers;
+        std::unordered_map<model::Map::Id, size_t, util::TaggedHasher<model::Map::Id>> instance_counts;
+        game_.ForEachInstance([&](const model::Map& map) {
+            const auto number = instance_counts[map.GetId()]++;
+            instance_numbers[&map] = number;
+            loot_reps.emplace_back(map, number);
         });
 
         std::vector<serialization::PlayerRepresentation> player_reps;
-        std::ranges::transform(app_.GetPlayers(), std::back_inserter(player_reps), [](const auto& pair) {
+        std::ranges::transform(app_.GetPlayers(), std::back_inserter(player_reps), [&instance_numbers](const auto& pair) {
             const auto& [token, player_ptr] = pair;
-            return serialization::PlayerRepresentation(token, *player_ptr);
+            return serialization::PlayerRepresentation(token, *player_ptr, instance_numbers.at(player_ptr->GetMap()));
         });
 
         try{
@@ -64,24 +70,44 @@ public:
         }
         
         std::ranges::for_each(loot_reps, [this](const auto& loot_rep) {
-            auto* map = const_cast<model::Map*>(game_.FindMap(loot_rep.GetMapId()));
+            auto* map = RestoreInstance(loot_rep.GetMapId(), loot_rep.GetInstance());
             if (map != nullptr) {
                 map->AddLostObjects(loot_rep.Restore());
             }
         });
 
-        
+        // Игрок возвращается в свой экземпляр, если там есть место. Иначе его размещают так же, как нового
         std::ranges::for_each(player_reps, [this](const auto& player_rep) {
             auto [token, player] = player_rep.Restore();
-            const auto* map = game_.FindMap(player_rep.GetMapId());
-            player->SetMap(map);
-            if (map != nullptr) {
-                app_.AddPlayer(std::move(token), std::move(player));
+            const auto* primary = game_.FindMap(player_rep.GetMapId());
+            if (primary == nullptr) {
+                return;
             }
+            const auto instances = game_.GetInstances(primary->GetId());
+            const model::Map* map = player_rep.GetInstance() < instances.size() ? instances[player_rep.GetInstance()] : nullptr;
+            const auto cap = primary->GetPlayerCap();
+            if (map == nullptr || (cap != 0 && app_.GetPlayersOnMap(map).size() >= cap)) {
+                map = app_.PlacePlayer(game_, *primary);
+            }
+            player->SetMap(map);
+            app_.AddPlayer(std::move(token), std::move(player));
         });
     }
 
 private:
+    // Экземпляр карты с номером number, недостающие экземпляры создаются
+    model::Map* RestoreInstance(const model::Map::Id& id, size_t number) {
+        const auto* primary = game_.FindMap(id);
+        if (primary == nullptr) {
+            return nullptr;
+        }
+        auto instances = game_.GetInstances(id);
+        while (instances.size() <= number) {
+            instances.push_back(game_.AddInstance(*primary));
+        }
+        return const_cast<model::Map*>(instances[number]);
+    }
+
     bool IsTimeToSave(int64_t time_ms) {
         last_time_ms_ += time_ms;
         return last_time_ms_ >= save_state_period_ms_;
@@ -0,0 +1,309 @@
+#include "static_cache.h"
+#include "logger.h"
+#include "compression.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace fs = std::filesystem;
+namespace sys = boost::system;
+using namespace std::literals;
+
+namespace {
+
+// Правки обычно приходят пачкой событий, поэтому папка перечитывается один раз после затишья
+constexpr auto ReloadDelay = std::chrono::milliseconds(200);
+
+std::string ReadFile(const FileDescriptor& file) {
+    std::string contents;
+    std::array<char, 64 * 1024> buffer;
+    while (true) {
+        const auto size = ::read(file.Get(), buffer.data(), buffer.size());
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size < 0) {
+            throw std::system_error(errno, std::generic_category(), "Failed to read file");
+        }
+        if (size == 0) {
+            return contents;
+        }
+        contents.append(buffer.data(), size);
+    }
+}
+
+// Сильный ETag: меняется вместе с содержимым и не зависит от времени запуска
+std::string MakeETag(const std::string& body) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : body) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    std::ostringstream etag;
+    etag << '"' << std::hex << std::setw(16) << std::setfill('0') << hash << '-' << body.size() << '"';
+    return etag.str();
+}
+
+std::time_t GetModificationTime(const fs::path& path) {
+    const auto file_time = fs::last_write_time(path);
+    const auto system_time = std::chrono::file_clock::to_sys(file_time);
+    return std::chrono::system_clock::to_time_t(std::chrono::time_point_cast<std::chrono::seconds>(system_time));
+}
+
+bool IsInside(const fs::path& path, const fs::path& root) {
+    const auto relative = path.lexically_relative(root);
+    return !relative.empty() && *relative.begin() != "..";
+}
+
+}  // namespace
+
+FileDescriptor::FileDescriptor(const fs::path& path)
+    : fd_{::open(path.c_str(), O_RDONLY | O_CLOEXEC)} {
+    if (fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), "Failed to open file: " + path.string());
+    }
+}
+
+FileDescriptor::~FileDescriptor() {
+    ::close(fd_);
+}
+
+StaticCache::StaticCache(fs::path root)
+    : root_{fs::weakly_canonical(std::move(root))}
+    , index_{BuildIndex()} {
+}
+
+std::optional<std::string> StaticCache::NormalizePath(std::string_view path) {
+    std::string key = fs::path(path).lexically_normal().generic_string();
+    while (!key.empty() && key.back() == '/') {
+        key.pop_back();
+    }
+    if (key == ".") {
+        key.clear();
+    }
+    if (key.starts_with('/') || key == ".." || key.starts_with("../")) {
+        return std::nullopt;
+    }
+    return key;
+}
+
+StaticCache::EntryPtr StaticCache::Find(const std::string& key) const {
+    std::shared_lock lock{mutex_};
+    if (auto it = index_.find(key); it != index_.end()) {
+        return it->second;
+    }
+    return nullptr;
+}
+
+std::string StaticCache::GetContentType(const fs::path& path) {
+    static const std::unordered_map<std::string, std::string> content_types = {
+        {".htm", "text/html"},
+        {".html", "text/html"},
+        {".css", "text/css"},
+        {".txt", "text/plain"},
+        {".js", "text/javascript"},
+        {".json", "application/json"},
+        {".xml", "application/xml"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".jpe", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".gif", "image/gif"},
+        {".bmp", "image/bmp"},
+        {".ico", "image/vnd.microsoft.icon"},
+        {".tiff", "image/tiff"},
+        {".tif", "image/tiff"},
+        {".svg", "image/svg+xml"},
+        {".svgz", "image/svg+xml"},
+        {".mp3", "audio/mpeg"}
+    };
+
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (auto it = content_types.find(extension); it != content_types.end()) {
+        return it->second;
+    }
+    return "application/octet-stream";
+}
+
+std::string StaticCache::FormatHttpDate(std::time_t time) {
+    std::tm tm{};
+    gmtime_r(&time, &tm);
+    char buffer[64];
+    const auto size = std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return {buffer, size};
+}
+
+std::optional<std::time_t> StaticCache::ParseHttpDate(const std::string& date) {
+    std::tm tm{};
+    const char* end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end != '\0') {
+        return std::nullopt;
+    }
+    return timegm(&tm);
+}
+
+StaticCache::Index StaticCache::BuildIndex() const {
+    // Сначала только список файлов. Содержимое читается по одному файлу, и в памяти
+    // остаются лишь тела, которые отдаются из памяти
+    struct File {
+        fs::path path;
+        std::time_t mtime;
+    };
+    std::unordered_map<std::string, File> files;
+    for (const auto& item : fs::recursive_directory_iterator(root_, fs::directory_options::skip_permission_denied)) {
+        if (!item.is_regular_file()) {
+            continue;
+        }
+        // Ссылки не должны выводить за пределы папки со статикой
+        if (item.is_symlink() && !IsInside(fs::weakly_canonical(item.path()), root_)) {
+            continue;
+        }
+        try {
+            files.emplace(item.path().lexically_relative(root_).generic_string(),
+                          File{item.path(), GetModificationTime(item.path())});
+        } catch (const std::exception& ex) {
+            Logger::LogError(0, ex.what(), "static index"sv);
+        }
+    }
+
+    Index index;
+    for (const auto& [key, file] : files) {
+        // Файл без прав на чтение или удалённый во время обхода не мешает отдавать остальные
+        auto entry = std::make_shared<Entry>();
+        std::shared_ptr<FileDescriptor> descriptor;
+        std::string body;
+        try {
+            descriptor = std::make_shared<FileDescriptor>(file.path);
+            body = ReadFile(*descriptor);
+        } catch (const std::exception& ex) {
+            Logger::LogError(0, ex.what(), "static index"sv);
+            continue;
+        }
+        entry->size = body.size();
+        entry->content_type = GetContentType(file.path);
+        entry->etag = MakeETag(body);
+        entry->mtime = file.mtime;
+        entry->last_modified = FormatHttpDate(entry->mtime);
+
+        // Заранее сжатый файл рядом с исходным предпочтительнее: его могли сжать сильнее.
+        // Но только если он не старше исходного, иначе в нём прежнее содержимое
+        auto gz = files.find(key + ".gz");
+        if (gz != files.end() && gz->second.mtime >= file.mtime) {
+            try {
+                entry->gzip_body = ReadFile(FileDescriptor{gz->second.path});
+            } catch (const std::exception& ex) {
+                Logger::LogError(0, ex.what(), "static index"sv);
+            }
+        } else if (compression::IsCompressibleType(entry->content_type)) {
+            entry->gzip_body = compression::Compress(body, compression::ContentCoding::Gzip,
+                                                     compression::StaticLevel);
+        }
+        if (entry->gzip_body.size() >= entry->size) {
+            std::string{}.swap(entry->gzip_body);
+        } else {
+            // У разных представлений одного файла должны быть разные ETag
+            entry->gzip_etag = entry->etag;
+            entry->gzip_etag.insert(entry->gzip_etag.size() - 1, "-gz");
+        }
+
+        // Большие файлы отправляются из того же дескриптора, из которого прочитаны
+#ifdef __linux__
+        if (entry->size >= FileBodyThreshold) {
+            entry->file = std::move(descriptor);
+        } else {
+            entry->body = std::move(body);
+        }
+#else
+        entry->body = std::move(body);
+#endif
+
+        index.emplace(key, entry);
+        // Запрос папки отдаёт её index.html
+        const fs::path path{key};
+        if (path.filename() == "index.html") {
+            index.emplace(path.parent_path().generic_string(), entry);
+        }
+    }
+    return index;
+}
+
+void StaticCache::Reload() {
+    try {
+        auto index = BuildIndex();
+        AddWatches();
+        std::unique_lock lock{mutex_};
+        index_.swap(index);
+    } catch (const std::exception& ex) {
+        Logger::LogError(0, ex.what(), "static reload"sv);
+    }
+}
+
+void StaticCache::Watch(net::io_context& ioc) {
+#ifdef __linux__
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "inotify_init1");
+    }
+    inotify_fd_ = fd;
+
+    // Чтение событий и таймер перечитывания работают в одном strand
+    auto strand = net::make_strand(ioc);
+    events_ = std::make_unique<net::posix::stream_descriptor>(strand, fd);
+    reload_timer_ = std::make_unique<net::steady_timer>(strand);
+
+    AddWatches();
+    ReadEvents();
+#else
+    (void)ioc;
+    throw std::runtime_error("Watching static files is supported only on Linux");
+#endif
+}
+
+void StaticCache::AddWatches() {
+#ifdef __linux__
+    if (inotify_fd_ < 0) {
+        return;
+    }
+    // Повторное добавление наблюдения за папкой безопасно, новые папки подхватываются при перечитывании
+    constexpr uint32_t Mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF;
+    inotify_add_watch(inotify_fd_, root_.c_str(), Mask);
+    for (const auto& item : fs::recursive_directory_iterator(root_, fs::directory_options::skip_permission_denied)) {
+        if (item.is_directory()) {
+            inotify_add_watch(inotify_fd_, item.path().c_str(), Mask);
+        }
+    }
+#endif
+}
+
+void StaticCache::ReadEvents() {
+    events_->async_read_some(net::buffer(events_buffer_), [this](sys::error_code ec, std::size_t) {
+        if (ec) {
+            if (ec != net::error::operation_aborted) {
+                Logger::LogError(ec.value(), ec.message(), "static watch"sv);
+            }
+            return;
+        }
+        // Что именно изменилось, неважно: папка перечитывается целиком
+        reload_timer_->expires_after(ReloadDelay);
+        reload_timer_->async_wait([this](sys::error_code ec) {
+            if (!ec) {
+                Reload();
+            }
+        });
+        ReadEvents();
+    });
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace net = boost::asio;
+
+// Открытый на чтение файл. Закрывается вместе с объектом
+class FileDescriptor {
+public:
+    explicit FileDescriptor(const std::filesystem::path& path);
+    ~FileDescriptor();
+
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int Get() const noexcept {return fd_;}
+
+private:
+    int fd_ = -1;
+};
+
+/*
+ *  Статические файлы в памяти. Папка индексируется при запуске целиком:
+ *  содержимое, тип, ETag по содержимому, время изменения и сжатый вариант. После этого
+ *  ответы на запросы статики не обращаются к файловой системе.
+ *  Большие файлы в памяти не хранятся: для них держится открытый дескриптор,
+ *  и тело ответа отправляется прямо из файла (sendfile). При индексации файлы читаются
+ *  по одному, так что в памяти не оказывается вся папка сразу.
+ *  Файлы, изменённые после запуска, видны только в режиме наблюдения (Watch),
+ *  который перечитывает папку по событиям inotify.
+ *  Файлы нужно заменять целиком (записать новый и переименовать поверх старого):
+ *  открытый дескриптор продолжит отдавать прежнее содержимое, согласованное с ETag и длиной
+ *  в индексе. Правка на месте меняет байты под прежним ETag, а укороченный файл обрывает ответ.
+ */
+class StaticCache {
+public:
+    struct Entry {
+        // Пусто, если содержимое отправляется из file
+        std::string body;
+        std::shared_ptr<const FileDescriptor> file;
+        uint64_t size = 0;
+        std::string content_type;
+        std::string etag;
+        std::string last_modified;
+        std::time_t mtime = 0;
+        // Сжатый gzip вариант: соседний файл .gz или сжатое при загрузке содержимое.
+        // Пустой, если сжатие не уменьшает размер
+        std::string gzip_body;
+        std::string gzip_etag;
+    };
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+    // Файлы от этого размера отправляются из файла, а не из памяти
+    static constexpr uint64_t FileBodyThreshold = 256 * 1024;
+
+    explicit StaticCache(std::filesystem::path root);
+
+    StaticCache(const StaticCache&) = delete;
+    StaticCache& operator=(const StaticCache&) = delete;
+
+    // Приводит путь из URL (без начального '/') к ключу индекса без обращения к диску.
+    // nullopt, если путь выходит за пределы корня
+    static std::optional<std::string> NormalizePath(std::string_view path);
+    // Для папки возвращается её index.html. nullptr, если такого файла нет
+    EntryPtr Find(const std::string& key) const;
+
+    // Перечитывает папку после изменений в ней. Только для Linux
+    void Watch(net::io_context& ioc);
+
+    static std::string GetContentType(const std::filesystem::path& path);
+    // Дата в формате HTTP (RFC 9110, IMF-fixdate)
+    static std::string FormatHttpDate(std::time_t time);
+    static std::optional<std::time_t> ParseHttpDate(const std::string& date);
+
+private:
+    using Index = std::unordered_map<std::string, EntryPtr>;
+
+    Index BuildIndex() const;
+    void Reload();
+
+    void AddWatches();
+    void ReadEvents();
+
+    std::filesystem::path root_;
+    mutable std::shared_mutex mutex_;
+    Index index_;
+
+    int inotify_fd_ = -1;
+    std::unique_ptr<net::posix::stream_descriptor> events_;
+    std::unique_ptr<net::steady_timer> reload_timer_;
+    std::array<char, 4096> events_buffer_{};
+};
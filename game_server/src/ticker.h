@@ -1,39 +1,102 @@
 #pragma once
 
+#include "logger.h"
+
 #include <boost/asio.hpp>
 #include <boost/system/error_code.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <functional>
 #include <memory>
-#include <cassert> 
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <cassert>
 
 namespace net = boost::asio;
 namespace sys = boost::system;
 
+/*
+ *  Вызывает handler с фиксированным периодом. Тики планируются по абсолютным
+ *  дедлайнам, поэтому время работы обработчика не сдвигает расписание.
+ *  Если тики пропущены (обработчик или сервер не успевали):
+ *   - max_catch_up == 0: пропущенные тики схлопываются в один, delta равна всему прошедшему времени;
+ *   - max_catch_up > 0: выполняется до max_catch_up дополнительных тиков с delta == period,
+ *     остальные пропускаются.
+ *  Раз в StatsInterval в лог пишется число тиков, перерасходов (обработчик дольше периода),
+ *  схлопнутых тиков (их время вошло в delta), отброшенных тиков (их время потеряно)
+ *  и распределение длительности тиков относительно периода.
+ */
 class Ticker : public std::enable_shared_from_this<Ticker> {
 public:
     using Strand = net::strand<net::io_context::executor_type>;
     using Handler = std::function<void(std::chrono::milliseconds delta)>;
 
     // Функция handler будет вызываться внутри strand с интервалом period
-    Ticker(Strand strand, std::chrono::milliseconds period, Handler handler)
+    Ticker(Strand strand, std::chrono::milliseconds period, Handler handler, int max_catch_up = 0)
         : strand_{strand}
         , period_{period}
-        , handler_{std::move(handler)} {
+        , handler_{std::move(handler)}
+        , max_catch_up_{std::max(0, max_catch_up)} {
     }
 
     void Start() {
         net::dispatch(strand_, [self = shared_from_this()] {
             self->last_tick_ = Clock::now();
+            self->deadline_ = self->last_tick_ + self->period_;
+            self->PublishDeadline();
+            self->stats_start_ = self->last_tick_;
             self->ScheduleTick();
         });
     }
 
+    // На сколько опаздывает ближайший тик. Растёт, пока strand занят или тик затянулся.
+    // Можно вызывать из любого потока
+    std::chrono::milliseconds GetLag() const {
+        const Clock::time_point deadline{Clock::duration{published_deadline_.load(std::memory_order_relaxed)}};
+        const auto now = Clock::now();
+        if (now <= deadline) {
+            return std::chrono::milliseconds{0};
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(now - deadline);
+    }
+
+    // Верхние границы корзин гистограммы в долях периода, последняя корзина - всё остальное
+    static constexpr std::array<double, 4> DurationBounds{0.25, 0.5, 1.0, 2.0};
+    static constexpr std::array<std::string_view, DurationBounds.size() + 1> DurationLabels{
+        "<0.25", "<0.5", "<1", "<2", ">=2"};
+
+    struct Stats {
+        uint64_t ticks = 0;
+        uint64_t overruns = 0;
+        // Пропущенные дедлайны без max_catch_up: их время пришло в delta следующего тика
+        uint64_t merged = 0;
+        // Пропущенные дедлайны сверх max_catch_up: их время не попало в игру
+        uint64_t dropped = 0;
+        std::array<uint64_t, DurationLabels.size()> durations{};
+    };
+
+    // Счётчики с начала текущего интервала статистики. Читаются внутри strand
+    const Stats& GetStats() const {
+        return stats_;
+    }
+
+    // Вызывается внутри strand сразу после записи статистики тиков. Задаётся до Start
+    void SetStatsListener(std::function<void()> listener) {
+        stats_listener_ = std::move(listener);
+    }
+
 private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr auto StatsInterval = std::chrono::seconds(60);
+
     void ScheduleTick() {
         assert(strand_.running_in_this_thread());
-        timer_.expires_after(period_);
+        timer_.expires_at(deadline_);
         timer_.async_wait([self = shared_from_this()](sys::error_code ec) {
             self->OnTick(ec);
         });
@@ -43,22 +106,110 @@ private:
         using namespace std::chrono;
         assert(strand_.running_in_this_thread());
 
-        if (!ec) {
-            auto this_tick = Clock::now();
-            auto delta = duration_cast<milliseconds>(this_tick - last_tick_);
-            last_tick_ = this_tick;
-            try {
-                handler_(delta);
-            } catch (const std::exception& ex) {}
-            ScheduleTick();
+        if (ec) {
+            return;
+        }
+
+        const auto this_tick = Clock::now();
+        // Сколько дедлайнов уже наступило, включая текущий
+        const int64_t due = 1 + std::max<int64_t>(0, (this_tick - deadline_) / period_);
+
+        if (max_catch_up_ == 0) {
+            RunHandler(duration_cast<milliseconds>(this_tick - last_tick_));
+            stats_.merged += due - 1;
+        } else {
+            const int64_t runs = std::min<int64_t>(due, max_catch_up_ + 1);
+            for (int64_t i = 0; i < runs; ++i) {
+                RunHandler(period_);
+            }
+            stats_.dropped += due - runs;
         }
+        last_tick_ = this_tick;
+        deadline_ += period_ * due;
+        PublishDeadline();
+
+        ReportStats(this_tick);
+        ScheduleTick();
     }
 
-    using Clock = std::chrono::steady_clock;
+    void PublishDeadline() {
+        published_deadline_.store(deadline_.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    void RunHandler(std::chrono::milliseconds delta) {
+        const auto start = Clock::now();
+        try {
+            handler_(delta);
+        } catch (const std::exception& ex) {
+            Logger::LogError(0, ex.what(), "tick");
+        }
+        const std::chrono::duration<double> duration = Clock::now() - start;
+
+        ++stats_.ticks;
+        const double ratio = duration / period_;
+        if (ratio > 1.0) {
+            ++stats_.overruns;
+        }
+        const auto bucket = std::upper_bound(DurationBounds.begin(), DurationBounds.end(), ratio) - DurationBounds.begin();
+        ++stats_.durations[bucket];
+    }
+
+    void ReportStats(Clock::time_point now) {
+        if (now - stats_start_ < StatsInterval) {
+            return;
+        }
+
+        std::vector<std::pair<std::string_view, uint64_t>> durations;
+        for (size_t i = 0; i < DurationLabels.size(); ++i) {
+            durations.emplace_back(DurationLabels[i], stats_.durations[i]);
+        }
+        Logger::LogTickStats(period_.count(), stats_.ticks, stats_.overruns, stats_.merged, stats_.dropped, durations);
+        if (stats_listener_) {
+            stats_listener_();
+        }
+
+        stats_ = {};
+        stats_start_ = now;
+    }
 
     Strand strand_;
     std::chrono::milliseconds period_;
     net::steady_timer timer_{strand_};
     Handler handler_;
-    std::chrono::steady_clock::time_point last_tick_;
+    std::function<void()> stats_listener_;
+    int max_catch_up_;
+    Clock::time_point last_tick_;
+    Clock::time_point deadline_;
+    // Копия deadline_ для чтения из других потоков. До запуска тиков опоздания нет
+    std::atomic<Clock::rep> published_deadline_{Clock::time_point::max().time_since_epoch().count()};
+    Clock::time_point stats_start_;
+    Stats stats_;
+};
+
+/*
+ *  Этап тика со своим периодом в игровом времени: копит время прошедших тиков
+ *  и сообщает, когда этап пора выполнить. Период 0 - выполнять на каждом тике.
+ */
+class TickStage {
+public:
+    explicit TickStage(int64_t period_ms = 0)
+        : period_ms_{period_ms} {
+    }
+
+    bool Advance(int64_t time_ms) {
+        if (period_ms_ <= 0) {
+            return true;
+        }
+        elapsed_ms_ += time_ms;
+        if (elapsed_ms_ < period_ms_) {
+            return false;
+        }
+        // Остаток переносится, чтобы средняя частота этапа не зависела от длины тика
+        elapsed_ms_ %= period_ms_;
+        return true;
+    }
+
+private:
+    int64_t period_ms_;
+    int64_t elapsed_ms_ = 0;
 };
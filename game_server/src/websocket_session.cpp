@@ -0,0 +1,105 @@
+#include "websocket_session.h"
+
+#include <boost/asio/post.hpp>
+
+using namespace std::literals;
+
+namespace http_server {
+
+namespace {
+
+// Команды клиента короткие, всё что длиннее - ошибка или злой умысел
+constexpr std::size_t MaxMessageSize = 4096;
+
+}  // namespace
+
+void WebSocketSession::Run(StringRequest&& request, MessageHandler on_message) {
+    request_ = std::move(request);
+    on_message_ = std::move(on_message);
+
+    ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+    ws_.read_message_max(MaxMessageSize);
+    ws_.text(true);
+
+    ws_.async_accept(request_,
+                     beast::bind_front_handler(&WebSocketSession::OnAccept, shared_from_this()));
+}
+
+void WebSocketSession::Decline(StringResponse&& response) {
+    auto safe_response = std::make_shared<StringResponse>(std::move(response));
+    safe_response->keep_alive(false);
+
+    http::async_write(ws_.next_layer(), *safe_response,
+                      [safe_response, self = shared_from_this()](beast::error_code ec, std::size_t) {
+                          if (ec) {
+                              return ReportError(ec, "websocket decline"sv);
+                          }
+                          self->ws_.next_layer().socket().shutdown(tcp::socket::shutdown_send, ec);
+                      });
+}
+
+void WebSocketSession::OnFrame(StateFrame frame) {
+    // Кадры приходят из strand игры, а с сокетом работаем только в strand сессии
+    net::post(ws_.get_executor(), [self = shared_from_this(), frame = std::move(frame)]() mutable {
+        self->Enqueue(std::move(frame));
+    });
+}
+
+void WebSocketSession::OnAccept(beast::error_code ec) {
+    if (ec) {
+        return ReportError(ec, "websocket accept"sv);
+    }
+
+    open_ = true;
+    request_ = {};
+    if (pending_frame_) {
+        Write();
+    }
+    Read();
+}
+
+void WebSocketSession::Read() {
+    ws_.async_read(buffer_, beast::bind_front_handler(&WebSocketSession::OnRead, shared_from_this()));
+}
+
+void WebSocketSession::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read) {
+    if (ec) {
+        open_ = false;
+        if (ec != websocket::error::closed) {
+            ReportError(ec, "websocket read"sv);
+        }
+        return;
+    }
+
+    on_message_(beast::buffers_to_string(buffer_.data()));
+    buffer_.consume(buffer_.size());
+    Read();
+}
+
+void WebSocketSession::Enqueue(StateFrame frame) {
+    // Неотправленный кадр устарел - достаточно отправить последний
+    pending_frame_ = std::move(frame);
+    if (open_ && !writing_frame_) {
+        Write();
+    }
+}
+
+void WebSocketSession::Write() {
+    writing_frame_ = std::move(pending_frame_);
+    ws_.async_write(net::buffer(*writing_frame_),
+                    beast::bind_front_handler(&WebSocketSession::OnWrite, shared_from_this()));
+}
+
+void WebSocketSession::OnWrite(beast::error_code ec, [[maybe_unused]] std::size_t bytes_written) {
+    writing_frame_.reset();
+    if (ec) {
+        open_ = false;
+        return ReportError(ec, "websocket write"sv);
+    }
+
+    if (open_ && pending_frame_) {
+        Write();
+    }
+}
+
+}  // namespace http_server
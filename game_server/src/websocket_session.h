@@ -0,0 +1,57 @@
+#pragma once
+#include "http_server.h"
+#include "state_publisher.h"
+
+#include <boost/beast/websocket.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace http_server {
+
+namespace websocket = beast::websocket;
+
+/*
+ *  WebSocket-сессия: получает от сервера состояние карты после каждого тика
+ *  и принимает команды игрока.
+ *  Очередь отправки ограничена одним кадром: если клиент не успевает забирать
+ *  данные, ещё не отправленный кадр заменяется более свежим.
+ */
+class WebSocketSession : public StateSubscriber, public std::enable_shared_from_this<WebSocketSession> {
+public:
+    using MessageHandler = std::function<void(const std::string&)>;
+
+    explicit WebSocketSession(tcp::socket&& socket)
+        : ws_(std::move(socket)) {
+    }
+
+    WebSocketSession(const WebSocketSession&) = delete;
+    WebSocketSession& operator=(const WebSocketSession&) = delete;
+
+    // Завершает рукопожатие и начинает читать сообщения клиента
+    void Run(StringRequest&& request, MessageHandler on_message);
+    // Отклоняет запрос на установку соединения обычным HTTP-ответом
+    void Decline(StringResponse&& response);
+
+    void OnFrame(StateFrame frame) override;
+
+private:
+    void OnAccept(beast::error_code ec);
+    void Read();
+    void OnRead(beast::error_code ec, std::size_t bytes_read);
+
+    void Enqueue(StateFrame frame);
+    void Write();
+    void OnWrite(beast::error_code ec, std::size_t bytes_written);
+
+    websocket::stream<beast::tcp_stream> ws_;
+    beast::flat_buffer buffer_;
+    StringRequest request_;
+    MessageHandler on_message_;
+    bool open_ = false;
+    StateFrame writing_frame_;
+    StateFrame pending_frame_;
+};
+
+}  // namespace http_server
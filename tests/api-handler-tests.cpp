@@ -0,0 +1,342 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "test-server.h"
+#include "binary_encoding.h"
+
+#include <string>
+
+using namespace std::literals;
+using namespace test_server;
+
+namespace json = boost::json;
+
+namespace {
+
+// Карта, в экземпляр которой помещается один игрок
+constexpr std::string_view OneSeatConfig = R"({
+    "maps": [{
+        "id": "map1",
+        "name": "Map 1",
+        "maxPlayers": 1,
+        "lootTypes": [{"name": "key", "file": "key.obj", "type": "obj", "value": 10}],
+        "roads": [{"x0": 0, "y0": 0, "x1": 40}],
+        "buildings": [],
+        "offices": []
+    }]
+})";
+
+}  // namespace
+
+TEST_CASE("Token format", "[ApiHandler]") {
+    CHECK(PlayerTokens::IsValid("0123456789abcdefABCDEF0123456789"sv));
+    CHECK_FALSE(PlayerTokens::IsValid(""sv));
+    CHECK_FALSE(PlayerTokens::IsValid("0123456789abcdef0123456789abcde"sv));
+    CHECK_FALSE(PlayerTokens::IsValid("0123456789abcdef0123456789abcdef0"sv));
+    CHECK_FALSE(PlayerTokens::IsValid("0123456789abcdef-123456789abcdef"sv));
+    CHECK_FALSE(PlayerTokens::IsValid("0123456789abcdef 123456789abcdef"sv));
+
+    PlayerTokens tokens;
+    CHECK(PlayerTokens::IsValid(*tokens.GenerateToken()));
+}
+
+TEST_CASE("Batch checks every token like a single request does", "[ApiHandler]") {
+    TestServer server;
+    const auto token = server.Join("dog");
+    const auto unknown = "0123456789abcdef0123456789abcdef"s;
+    REQUIRE(token != unknown);
+
+    // Токен, который одиночный запрос отклонил бы ещё до поиска игрока
+    const auto malformed = token.substr(0, 31) + "-";
+    const auto body = R"({"actions": [
+        {"token": ")" + token + R"(", "move": "R"},
+        {"token": ")" + unknown + R"(", "move": "L"},
+        {"token": ")" + malformed + R"(", "move": "L"},
+        {"token": ")" + token + R"(x", "move": "L"},
+        {"token": 42, "move": "L"},
+        {"move": "L"},
+        {"token": ")" + token + R"(", "move": "X"}
+    ]})";
+
+    const auto response = server.Exchange(MakeRequest(http::verb::post, "/api/v1/game/batch", body));
+    REQUIRE(response);
+    REQUIRE(response->result() == http::status::ok);
+
+    const auto results = json::parse(response->body()).at("results").as_array();
+    REQUIRE(results.size() == 7);
+    auto code = [&results](size_t i) {
+        const auto& result = results.at(i).as_object();
+        return result.contains("code") ? std::string{result.at("code").as_string()} : std::string{};
+    };
+    CHECK(code(0).empty());
+    CHECK(code(1) == "unknownToken");
+    CHECK(code(2) == "invalidToken");
+    CHECK(code(3) == "invalidToken");
+    CHECK(code(4) == "invalidToken");
+    CHECK(code(5) == "invalidToken");
+    CHECK(code(6) == "invalidArgument");
+
+    // Ошибки соседей не отменяют правильную команду
+    const auto* player = server.app.GetPlayer(Token{token});
+    REQUIRE(player);
+    CHECK(player->GetDog()->GetDirection() == 'R');
+}
+
+TEST_CASE("Fast-forward writes records and publishes once", "[ApiHandler]") {
+    // Собаки без команд уходят на покой через секунду
+    TestServer server{R"({
+        "dogRetirementTime": 1.0,
+        "maps": [{
+            "id": "map1",
+            "name": "Map 1",
+            "lootTypes": [{"name": "key", "file": "key.obj", "type": "obj", "value": 10}],
+            "roads": [{"x0": 0, "y0": 0, "x1": 40}],
+            "buildings": [],
+            "offices": []
+        }]
+    })"};
+    server.Join("first");
+    // Второй игрок приходит на полсекунды позже и уходит на покой на другом шаге
+    REQUIRE(server.Exchange(MakeRequest(http::verb::post, "/api/v1/game/tick", R"({"timeDelta": 500})")));
+    server.Join("second");
+
+    const auto response = server.Exchange(MakeRequest(http::verb::post, "/api/v1/game/tick",
+                                                      R"({"timeDelta": 100, "steps": 30})"));
+    REQUIRE(response);
+    REQUIRE(response->result() == http::status::ok);
+    const auto result = json::parse(response->body()).as_object();
+    CHECK(result.at("steps").as_int64() == 30);
+    CHECK(result.at("gameTime").as_int64() == 3000);
+
+    // Рекорды обоих игроков записаны одним вызовом
+    CHECK(server.db.GetAll().size() == 2);
+    CHECK(server.db.GetWriteCount() == 1);
+    CHECK(server.app.GetPlayers().empty());
+}
+
+TEST_CASE("Fast-forward is limited in steps", "[ApiHandler]") {
+    TestServer server;
+    server.Join("dog");
+
+    const auto response = server.Exchange(MakeRequest(http::verb::post, "/api/v1/game/tick",
+                                                      R"({"timeDelta": 10, "steps": 10001})"));
+    REQUIRE(response);
+    CHECK(response->result() == http::status::bad_request);
+}
+
+TEST_CASE("Spectator asking for a missing instance gets not found", "[ApiHandler]") {
+    TestServer server;
+    server.Join("dog");
+
+    const auto missing = server.Exchange(MakeRequest(http::verb::get, "/api/v1/game/spectate?map=map1&instance=1", ""));
+    REQUIRE(missing);
+    CHECK(missing->result() == http::status::not_found);
+
+    const auto unknown_map = server.Exchange(MakeRequest(http::verb::get, "/api/v1/game/spectate?map=map2", ""));
+    REQUIRE(unknown_map);
+    CHECK(unknown_map->result() == http::status::not_found);
+}
+
+namespace {
+
+// Ставит запрос в очередь strand игры, не выполняя её
+void Enqueue(TestServer& server, StringRequest request) {
+    server.handler(std::move(request), [](auto&&) {});
+}
+
+}  // namespace
+
+TEST_CASE("Under load only sheddable routes get 503", "[ApiHandler]") {
+    TestServer server;
+    const auto token = server.Join("dog");
+    server.api_handler.SetLoadLimits({2, {}});
+
+    const auto tick = MakeRequest(http::verb::post, "/api/v1/game/tick", R"({"timeDelta": 10})");
+    auto overload = [&] {
+        Enqueue(server, tick);
+        Enqueue(server, tick);
+        REQUIRE(server.api_handler.IsOverloaded());
+    };
+
+    for (const auto target : {"/api/v1/maps"sv, "/api/v1/maps/map1"sv, "/api/v1/game/players"sv,
+                              "/api/v1/game/state"sv, "/api/v1/game/records"sv}) {
+        overload();
+        const auto response = server.Exchange(MakeRequest(http::verb::get, target, "", token));
+        REQUIRE(response);
+        CHECK(response->result() == http::status::service_unavailable);
+        CHECK((*response)[http::field::retry_after] == "1");
+    }
+    overload();
+    const auto join = server.Exchange(MakeRequest(http::verb::post, "/api/v1/game/join",
+                                                  R"({"userName": "cat", "mapId": "map1"})"));
+    REQUIRE(join);
+    CHECK(join->result() == http::status::service_unavailable);
+
+    // Команды игроков и тики обслуживаются и при перегрузке
+    overload();
+    const auto action = server.Exchange(MakeRequest(http::verb::post, "/api/v1/game/player/action",
+                                                    R"({"move": "R"})", token));
+    REQUIRE(action);
+    CHECK(action->result() == http::status::ok);
+    overload();
+    const auto ticked = server.Exchange(tick);
+    REQUIRE(ticked);
+    CHECK(ticked->result() == http::status::ok);
+
+    // Очередь разобрана, второстепенные запросы снова обслуживаются
+    CHECK_FALSE(server.api_handler.IsOverloaded());
+    const auto maps = server.Exchange(MakeRequest(http::verb::get, "/api/v1/maps", ""));
+    REQUIRE(maps);
+    CHECK(maps->result() == http::status::ok);
+}
+
+TEST_CASE("Load stats report peak queue depth and shed requests", "[ApiHandler]") {
+    TestServer server;
+    server.api_handler.SetLoadLimits({3, {}});
+    server.api_handler.TakeLoadStats();
+
+    const auto tick = MakeRequest(http::verb::post, "/api/v1/game/tick", R"({"timeDelta": 10})");
+    for (int i = 0; i < 3; ++i) {
+        Enqueue(server, tick);
+    }
+    Enqueue(server, MakeRequest(http::verb::get, "/api/v1/maps", ""));
+    Enqueue(server, MakeRequest(http::verb::get, "/api/v1/maps", ""));
+    server.ioc.restart();
+    server.ioc.poll();
+
+    const auto stats = server.api_handler.TakeLoadStats();
+    CHECK(stats.queue_depth == 0);
+    CHECK(stats.peak_queue_depth == 3);
+    CHECK(stats.shed == 2);
+
+    // Пик и счётчик начинаются заново
+    const auto next = server.api_handler.TakeLoadStats();
+    CHECK(next.peak_queue_depth == 0);
+    CHECK(next.shed == 0);
+}
+
+TEST_CASE("Player retired while the request waited for the strand gets an empty answer", "[ApiHandler]") {
+    TestServer server{R"({
+        "dogRetirementTime": 1.0,
+        "maps": [{
+            "id": "map1",
+            "name": "Map 1",
+            "lootTypes": [{"name": "key", "file": "key.obj", "type": "obj", "value": 10}],
+            "roads": [{"x0": 0, "y0": 0, "x1": 40}],
+            "buildings": [],
+            "offices": []
+        }]
+    })"};
+    const auto token = server.Join("dog");
+    const auto ref = server.app.FindPlayer(Token{token});
+    REQUIRE(ref);
+    CHECK(ref->map == server.game.GetMaps().front().GetInstanceId());
+
+    // Токен проверяется сразу, а игрок уходит на покой тиком, стоящим в очереди раньше запроса
+    const auto retire = MakeRequest(http::verb::post, "/api/v1/game/tick", R"({"timeDelta": 2000})");
+    Enqueue(server, retire);
+    const auto players = server.Exchange(MakeRequest(http::verb::get, "/api/v1/game/players", "", token));
+    REQUIRE(players);
+    CHECK(players->result() == http::status::ok);
+    CHECK(json::parse(players->body()).as_object().empty());
+
+    CHECK_FALSE(server.app.FindPlayer(Token{token}));
+    const auto state = server.Exchange(MakeRequest(http::verb::get, "/api/v1/game/state", "", token));
+    REQUIRE(state);
+    CHECK(state->result() == http::status::unauthorized);
+}
+
+TEST_CASE("State radius should be a whole finite positive number", "[ApiHandler]") {
+    TestServer server;
+    const auto token = server.Join("dog");
+    server.Join("cat");
+
+    for (const auto radius : {"inf"sv, "nan"sv, "5abc"sv, "0"sv, "-1"sv, ""sv}) {
+        const auto response = server.Exchange(MakeRequest(http::verb::get,
+            "/api/v1/game/state?radius="s + std::string{radius}, "", token));
+        REQUIRE(response);
+        CHECK(response->result() == http::status::bad_request);
+    }
+
+    // Пространственный индекс строится в конце тика
+    REQUIRE(server.Exchange(MakeRequest(http::verb::post, "/api/v1/game/tick", R"({"timeDelta": 10})")));
+    // Радиус больше любой карты - это всё состояние
+    const auto huge = server.Exchange(MakeRequest(http::verb::get, "/api/v1/game/state?radius=1e300", "", token));
+    REQUIRE(huge);
+    REQUIRE(huge->result() == http::status::ok);
+    CHECK(json::parse(huge->body()).at("players").as_object().size() == 2);
+}
+
+TEST_CASE("Waiting for state supports only the whole JSON state", "[ApiHandler]") {
+    TestServer server;
+    const auto token = server.Join("dog");
+
+    const auto with_radius = server.Exchange(MakeRequest(http::verb::get, "/api/v1/game/state?wait=1&radius=5", "", token));
+    REQUIRE(with_radius);
+    CHECK(with_radius->result() == http::status::bad_request);
+    CHECK(json::parse(with_radius->body()).at("code").as_string() == "invalidArgument");
+
+    auto binary_request = MakeRequest(http::verb::get, "/api/v1/game/state?wait=1", "", token);
+    binary_request.set(http::field::accept, binary::ContentType);
+    const auto binary = server.Exchange(std::move(binary_request));
+    REQUIRE(binary);
+    CHECK(binary->result() == http::status::bad_request);
+}
+
+TEST_CASE("Batch states are kept apart for instances of one map", "[ApiHandler]") {
+    // В экземпляр помещается один игрок, второй попадает в новый экземпляр той же карты
+    TestServer server{OneSeatConfig};
+    const auto first = server.Join("first");
+    const auto second = server.Join("second");
+    REQUIRE(server.game.GetInstances(model::Map::Id{"map1"}).size() == 2);
+
+    const auto response = server.Exchange(MakeRequest(http::verb::post, "/api/v1/game/batch", R"({"actions": [
+        {"token": ")" + first + R"(", "move": "R"},
+        {"token": ")" + second + R"(", "move": "L"}
+    ], "state": true})"));
+    REQUIRE(response);
+    REQUIRE(response->result() == http::status::ok);
+    const auto result = json::parse(response->body()).as_object();
+
+    const auto& results = result.at("results").as_array();
+    REQUIRE(results.size() == 2);
+    const std::string first_instance{results.at(0).at("instance").as_string()};
+    const std::string second_instance{results.at(1).at("instance").as_string()};
+    CHECK(first_instance != second_instance);
+
+    // В состоянии каждого экземпляра только его игрок
+    const auto& states = result.at("states").as_object();
+    CHECK(states.size() == 2);
+    CHECK(states.at(first_instance).at("players").as_object().size() == 1);
+    CHECK(states.at(second_instance).at("players").as_object().size() == 1);
+    CHECK(json::serialize(states.at(first_instance)) != json::serialize(states.at(second_instance)));
+}
+
+TEST_CASE("Saved state keeps players and loot in their map instances", "[ApiHandler]") {
+    const TempDirectory state_folder{"game_server_tests_state"};
+    const auto state_file = (state_folder.GetPath() / "state").string();
+    const model::Map::Id map_id{"map1"};
+
+    TestServer saved{OneSeatConfig};
+    saved.Join("first");
+    saved.Join("second");
+    const auto saved_instances = saved.game.GetInstances(map_id);
+    REQUIRE(saved_instances.size() == 2);
+    const auto second_id = saved.app.GetPlayersOnMap(saved_instances[1]).front()->GetId();
+    const_cast<model::Map*>(saved_instances[1])->AddLostObjects({model::Loot{7, 0u, {5.0, 0.0}, 10}});
+    StateStorage{state_file, 0, saved.game, saved.app}.Write();
+
+    TestServer restored{OneSeatConfig};
+    StateStorage{state_file, 0, restored.game, restored.app}.Read();
+    const auto instances = restored.game.GetInstances(map_id);
+    REQUIRE(instances.size() == 2);
+    CHECK(restored.app.GetPlayersOnMap(instances[0]).size() == 1);
+    REQUIRE(restored.app.GetPlayersOnMap(instances[1]).size() == 1);
+    CHECK(restored.app.GetPlayersOnMap(instances[1]).front()->GetId() == second_id);
+    CHECK(instances[0]->GetLostObjects().empty());
+    REQUIRE(instances[1]->GetLostObjects().size() == 1);
+    CHECK(instances[1]->GetLostObjects().front().id == 7);
+
+    // Восстановленные экземпляры заполнены, новый игрок получает свой
+    restored.Join("third");
+    CHECK(restored.game.GetInstances(map_id).size() == 3);
+}
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "binary_encoding.h"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+using namespace std::literals;
+
+namespace {
+
+std::string Bytes(std::initializer_list<int> bytes) {
+    std::string result;
+    for (int byte : bytes) {
+        result.push_back(static_cast<char>(byte));
+    }
+    return result;
+}
+
+// Читает то, что записал binary::Writer, как это делает клиент
+class Reader {
+public:
+    explicit Reader(std::string_view data)
+        : data_(data) {
+    }
+
+    uint8_t GetByte() {
+        REQUIRE(pos_ < data_.size());
+        return static_cast<uint8_t>(data_[pos_++]);
+    }
+
+    uint64_t GetVarint() {
+        uint64_t result = 0;
+        for (int shift = 0;; shift += 7) {
+            const auto byte = GetByte();
+            result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return result;
+            }
+        }
+    }
+
+    int32_t GetInt32() {
+        uint32_t bits = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            bits |= static_cast<uint32_t>(GetByte()) << shift;
+        }
+        return static_cast<int32_t>(bits);
+    }
+
+    double GetScaled() {
+        return GetInt32() / binary::PositionScale;
+    }
+
+    std::string GetString() {
+        const auto size = GetVarint();
+        REQUIRE(pos_ + size <= data_.size());
+        std::string result{data_.substr(pos_, size)};
+        pos_ += size;
+        return result;
+    }
+
+    bool AtEnd() const {
+        return pos_ == data_.size();
+    }
+
+private:
+    std::string_view data_;
+    size_t pos_ = 0;
+};
+
+}  // namespace
+
+TEST_CASE("Varints are written as LEB128", "[BinaryEncoding]") {
+    std::string out;
+    binary::Writer writer{out};
+
+    SECTION("one byte up to 127") {
+        writer.PutVarint(0);
+        writer.PutVarint(127);
+        CHECK(out == Bytes({0x00, 0x7f}));
+    }
+    SECTION("seven bits per byte, low bits first") {
+        writer.PutVarint(128);
+        writer.PutVarint(300);
+        CHECK(out == Bytes({0x80, 0x01, 0xac, 0x02}));
+    }
+    SECTION("the largest value takes ten bytes") {
+        writer.PutVarint(std::numeric_limits<uint64_t>::max());
+        CHECK(out.size() == 10);
+        CHECK(Reader{out}.GetVarint() == std::numeric_limits<uint64_t>::max());
+    }
+}
+
+TEST_CASE("Fixed-size numbers are little-endian", "[BinaryEncoding]") {
+    std::string out;
+    binary::Writer writer{out};
+
+    writer.PutInt32(0x01020304);
+    writer.PutInt32(-2);
+    CHECK(out == Bytes({0x04, 0x03, 0x02, 0x01, 0xfe, 0xff, 0xff, 0xff}));
+}
+
+TEST_CASE("Coordinates are quantized to 1/1024", "[BinaryEncoding]") {
+    std::string out;
+    binary::Writer writer{out};
+
+    writer.PutScaled(1.5);
+    writer.PutScaled(-0.25);
+    // Шаг квантования меньше половины 1/1024 округляется
+    writer.PutScaled(10.0 + 0.4 / binary::PositionScale);
+
+    Reader reader{out};
+    CHECK(reader.GetInt32() == 1536);
+    CHECK(reader.GetInt32() == -256);
+    CHECK(reader.GetInt32() == 10240);
+}
+
+TEST_CASE("Coordinates outside of int32 are clamped", "[BinaryEncoding]") {
+    std::string out;
+    binary::Writer writer{out};
+
+    writer.PutScaled(1e7);
+    writer.PutScaled(-1e7);
+    writer.PutScaled(std::numeric_limits<double>::infinity());
+    writer.PutScaled(std::nan(""));
+
+    Reader reader{out};
+    CHECK(reader.GetInt32() == std::numeric_limits<int32_t>::max());
+    CHECK(reader.GetInt32() == std::numeric_limits<int32_t>::min());
+    CHECK(reader.GetInt32() == std::numeric_limits<int32_t>::max());
+    CHECK(reader.GetInt32() == 0);
+}
+
+TEST_CASE("Game state survives a round trip", "[BinaryEncoding]") {
+    Player player{300, "dog"};
+    auto* dog = player.GetDog();
+    dog->SetStartPosition({12.5, -3.75});
+    dog->SetNextMove(2.0, 'R');
+    dog->Loot({7, 2, {0.0, 0.0}, 10});
+
+    const model::Loots loots{{8, 1, {4.0, 0.5}, 5}};
+    const auto encoded = binary::EncodeGameState({&player}, loots);
+
+    Reader reader{encoded};
+    CHECK(reader.GetByte() == binary::FormatVersion);
+    REQUIRE(reader.GetVarint() == 1);
+    CHECK(reader.GetVarint() == 300);
+    CHECK(reader.GetScaled() == 12.5);
+    CHECK(reader.GetScaled() == -3.75);
+    CHECK(reader.GetScaled() == dog->GetSpeed().x);
+    CHECK(reader.GetScaled() == dog->GetSpeed().y);
+    CHECK(reader.GetByte() == 'R');
+    REQUIRE(reader.GetVarint() == 1);
+    CHECK(reader.GetVarint() == 7);
+    CHECK(reader.GetVarint() == 2);
+    CHECK(reader.GetVarint() == static_cast<uint64_t>(dog->GetScore()));
+
+    REQUIRE(reader.GetVarint() == 1);
+    CHECK(reader.GetVarint() == 8);
+    CHECK(reader.GetVarint() == 1);
+    CHECK(reader.GetScaled() == 4.0);
+    CHECK(reader.GetScaled() == 0.5);
+    CHECK(reader.AtEnd());
+}
+
+TEST_CASE("Player list survives a round trip", "[BinaryEncoding]") {
+    Player first{1, "first"};
+    Player second{200, "второй"};
+    const auto encoded = binary::EncodePlayers({&first, &second});
+
+    Reader reader{encoded};
+    CHECK(reader.GetByte() == binary::FormatVersion);
+    REQUIRE(reader.GetVarint() == 2);
+    CHECK(reader.GetVarint() == 1);
+    CHECK(reader.GetString() == "first");
+    CHECK(reader.GetVarint() == 200);
+    CHECK(reader.GetString() == "второй");
+    CHECK(reader.AtEnd());
+}
+
+TEST_CASE("Binary action is one direction byte", "[BinaryEncoding]") {
+    CHECK(binary::DecodeAction("L"sv) == 'L');
+    CHECK(binary::DecodeAction(std::string_view{"\0", 1}) == '\0');
+    CHECK_FALSE(binary::DecodeAction(""sv));
+    CHECK_FALSE(binary::DecodeAction("LR"sv));
+    CHECK_FALSE(binary::DecodeAction("X"sv));
+}
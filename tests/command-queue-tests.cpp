@@ -0,0 +1,70 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "app/command_queue.h"
+
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST_CASE("Command queue keeps FIFO order and reports overflow", "[MpscQueue]") {
+    app::MpscQueue<int> queue{4};
+    int value = 0;
+
+    CHECK_FALSE(queue.TryPop(value));
+
+    for (int i = 0; i < 4; ++i) {
+        CHECK(queue.TryPush(i));
+    }
+    CHECK_FALSE(queue.TryPush(4));
+
+    for (int i = 0; i < 4; ++i) {
+        REQUIRE(queue.TryPop(value));
+        CHECK(value == i);
+    }
+    CHECK_FALSE(queue.TryPop(value));
+
+    // После опустошения ячейки переиспользуются
+    CHECK(queue.TryPush(10));
+    REQUIRE(queue.TryPop(value));
+    CHECK(value == 10);
+
+    CHECK_THROWS_AS(app::MpscQueue<int>{3}, std::invalid_argument);
+}
+
+TEST_CASE("Command queue accepts values from several producers", "[MpscQueue]") {
+    constexpr int producers_count = 4;
+    constexpr int values_per_producer = 10000;
+    app::MpscQueue<int> queue{1 << 10};
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producers_count; ++p) {
+        producers.emplace_back([&queue, p] {
+            for (int i = 0; i < values_per_producer; ++i) {
+                while (!queue.TryPush(p * values_per_producer + i)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    // Значения одного писателя должны приходить в порядке записи
+    std::vector<int> last_seen(producers_count, -1);
+    int received = 0;
+    int value = 0;
+    while (received < producers_count * values_per_producer) {
+        if (!queue.TryPop(value)) {
+            std::this_thread::yield();
+            continue;
+        }
+        const int producer = value / values_per_producer;
+        const int index = value % values_per_producer;
+        CHECK(index > last_seen[producer]);
+        last_seen[producer] = index;
+        ++received;
+    }
+
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    CHECK_FALSE(queue.TryPop(value));
+}
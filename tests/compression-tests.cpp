@@ -0,0 +1,132 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "test-server.h"
+#include "compression.h"
+
+#include <chrono>
+#include <fstream>
+#include <string>
+
+using namespace std::literals;
+using namespace test_server;
+using compression::ContentCoding;
+using compression::NegotiateCoding;
+
+TEST_CASE("Coding is chosen by q-values", "[Compression]") {
+    CHECK(NegotiateCoding(""sv) == ContentCoding::Identity);
+    CHECK(NegotiateCoding("gzip"sv) == ContentCoding::Gzip);
+    CHECK(NegotiateCoding("GZip"sv) == ContentCoding::Gzip);
+    CHECK(NegotiateCoding("x-gzip"sv) == ContentCoding::Gzip);
+    CHECK(NegotiateCoding("deflate"sv) == ContentCoding::Deflate);
+    CHECK(NegotiateCoding("br"sv) == ContentCoding::Identity);
+
+    CHECK(NegotiateCoding("gzip, deflate"sv) == ContentCoding::Gzip);
+    CHECK(NegotiateCoding("gzip;q=0.5, deflate;q=0.5"sv) == ContentCoding::Gzip);
+    CHECK(NegotiateCoding("gzip;q=0.5, deflate;q=0.8"sv) == ContentCoding::Deflate);
+    CHECK(NegotiateCoding("gzip ; q=0.9 , deflate ; q=1"sv) == ContentCoding::Deflate);
+    CHECK(NegotiateCoding("gzip;q=0"sv) == ContentCoding::Identity);
+    CHECK(NegotiateCoding("gzip;q=0, deflate;q=0.1"sv) == ContentCoding::Deflate);
+    // Неразборчивое q-значение запрещает кодировку
+    CHECK(NegotiateCoding("gzip;q=abc"sv) == ContentCoding::Identity);
+}
+
+TEST_CASE("Identity and wildcard in Accept-Encoding", "[Compression]") {
+    // Отказ от identity не выбирает сжатие, которого клиент не называл
+    CHECK(NegotiateCoding("identity;q=0"sv) == ContentCoding::Identity);
+    CHECK(NegotiateCoding("identity;q=0, deflate"sv) == ContentCoding::Deflate);
+    CHECK(NegotiateCoding("identity"sv) == ContentCoding::Identity);
+
+    // "*" относится только к кодировкам, не названным явно
+    CHECK(NegotiateCoding("*"sv) == ContentCoding::Gzip);
+    CHECK(NegotiateCoding("*;q=0"sv) == ContentCoding::Identity);
+    CHECK(NegotiateCoding("gzip;q=0, *"sv) == ContentCoding::Deflate);
+    CHECK(NegotiateCoding("*;q=0, deflate"sv) == ContentCoding::Deflate);
+    CHECK(NegotiateCoding("deflate;q=0.2, *;q=0.5"sv) == ContentCoding::Gzip);
+}
+
+TEST_CASE("Compressed representations get their own ETag", "[Compression]") {
+    CHECK(compression::AddCodingToETag("\"abc\""sv, ContentCoding::Gzip) == "\"abc-gzip\"");
+    CHECK(compression::AddCodingToETag("\"abc\""sv, ContentCoding::Deflate) == "\"abc-deflate\"");
+    CHECK(compression::AddCodingToETag("\"abc\""sv, ContentCoding::Identity) == "\"abc\"");
+
+    CHECK(compression::MatchesETag("\"abc\""sv, "\"abc\""sv));
+    CHECK(compression::MatchesETag("\"abc-gzip\""sv, "\"abc\""sv));
+    CHECK(compression::MatchesETag("\"abc-deflate\""sv, "\"abc\""sv));
+    CHECK_FALSE(compression::MatchesETag("\"abc-br\""sv, "\"abc\""sv));
+    CHECK_FALSE(compression::MatchesETag("\"abcd\""sv, "\"abc\""sv));
+    CHECK_FALSE(compression::MatchesETag("\"ab-gzip\""sv, "\"abc\""sv));
+
+    StringResponse response{http::status::ok, 11};
+    response.set(http::field::content_type, "application/json");
+    response.set(http::field::etag, "\"abc\"");
+    response.body() = std::string(4096, 'a');
+    response.prepare_payload();
+    REQUIRE(compression::ShouldCompress(response));
+    compression::CompressResponse(response, ContentCoding::Gzip);
+    CHECK(response[http::field::content_encoding] == "gzip");
+    CHECK(response[http::field::etag] == "\"abc-gzip\"");
+    CHECK(response[http::field::vary] == "Accept-Encoding");
+}
+
+TEST_CASE("Partial responses are not compressed", "[Compression]") {
+    StringResponse response{http::status::partial_content, 11};
+    response.set(http::field::content_type, "text/plain");
+    response.set(http::field::content_range, "bytes 0-4095/8192");
+    response.body() = std::string(4096, 'a');
+    response.prepare_payload();
+    CHECK_FALSE(compression::ShouldCompress(response));
+
+    response.result(http::status::ok);
+    CHECK_FALSE(compression::ShouldCompress(response));
+    response.erase(http::field::content_range);
+    CHECK(compression::ShouldCompress(response));
+}
+
+TEST_CASE("Not modified answers vary on Accept-Encoding", "[Compression]") {
+    TestServer server;
+    const auto token = server.Join("dog");
+
+    auto request = MakeRequest(http::verb::get, "/api/v1/game/players", "", token);
+    request.set(http::field::accept_encoding, "gzip");
+    const auto response = server.Exchange(request);
+    REQUIRE(response);
+    REQUIRE(response->result() == http::status::ok);
+    const std::string etag{(*response)[http::field::etag]};
+    REQUIRE_FALSE(etag.empty());
+
+    // ETag сжатого ответа тоже узнаётся
+    request.set(http::field::if_none_match, compression::AddCodingToETag(etag, ContentCoding::Gzip));
+    const auto not_modified = server.Exchange(request);
+    REQUIRE(not_modified);
+    CHECK(not_modified->result() == http::status::not_modified);
+    CHECK((*not_modified)[http::field::vary].find("Accept-Encoding") != std::string_view::npos);
+}
+
+TEST_CASE("Stale precompressed siblings are ignored", "[Compression]") {
+    TempDirectory root{"game_server_tests_compression"};
+    const auto source = root.GetPath() / "app.js";
+    const std::string body(4096, 'x');
+    {
+        std::ofstream file{source, std::ios::binary};
+        file << body;
+    }
+    {
+        // Не настоящий gzip: важно только, чьё содержимое попадёт в ответ
+        std::ofstream file{root.GetPath() / "app.js.gz", std::ios::binary};
+        file << "stale";
+    }
+    const auto now = std::filesystem::last_write_time(source);
+    std::filesystem::last_write_time(root.GetPath() / "app.js.gz", now - std::chrono::hours{1});
+
+    StaticCache stale_cache{root.GetPath()};
+    const auto stale = stale_cache.Find("app.js");
+    REQUIRE(stale);
+    CHECK(stale->gzip_body != "stale");
+    CHECK_FALSE(stale->gzip_body.empty());
+
+    std::filesystem::last_write_time(root.GetPath() / "app.js.gz", now + std::chrono::hours{1});
+    StaticCache fresh_cache{root.GetPath()};
+    const auto fresh = fresh_cache.Find("app.js");
+    REQUIRE(fresh);
+    CHECK(fresh->gzip_body == "stale");
+}
@@ -75,3 +75,39 @@ TEST_CASE("Dog moves correctly on the map", "[Dog]") {
         REQUIRE(dog.GetPosition().y == 0.0);
     }
 }
+
+TEST_CASE("Map instances share layout but not loot", "[Model]") {
+    model::Game game;
+    model::Map map{model::Map::Id{"map1"}, "Test Map"};
+    map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 10});
+    map.AddOffice({model::Office::Id{"office"}, {5, 0}, {0, 0}});
+    map.SetPlayerCap(2);
+    game.AddMap(std::move(map));
+
+    auto* primary = &game.GetMaps().front();
+    primary->AddLostObject({1});
+
+    auto* instance = game.AddInstance(*primary);
+    CHECK(&instance->GetRoads() == &primary->GetRoads());
+    CHECK(instance->GetOffices().size() == 1);
+    CHECK(instance->GetPlayerCap() == 2);
+    CHECK(instance->GetLostObjects().empty());
+    CHECK(primary->GetLostObjects().size() == 1);
+
+    CHECK(game.IsPrimary(primary));
+    CHECK_FALSE(game.IsPrimary(instance));
+    CHECK(game.GetInstances(model::Map::Id{"map1"}) == std::vector<const model::Map*>{primary, instance});
+    CHECK(instance->GetInstanceId() != primary->GetInstanceId());
+    CHECK(game.FindInstance(instance->GetInstanceId()) == instance);
+
+    const auto removed = instance->GetInstanceId();
+    game.RemoveInstance(instance);
+    CHECK(game.GetInstances(model::Map::Id{"map1"}) == std::vector<const model::Map*>{primary});
+    CHECK(game.FindInstance(removed) == nullptr);
+    CHECK(game.FindInstance(primary->GetInstanceId()) == primary);
+
+    // Номер удалённого экземпляра не достаётся новому, даже если тот займёт тот же адрес
+    const auto* next = game.AddInstance(*primary);
+    CHECK(next->GetInstanceId() != removed);
+    CHECK(game.FindInstance(removed) == nullptr);
+}
@@ -0,0 +1,125 @@
+#include <catch2/catch_test_macros.hpp>
+
+// Первым, чтобы Beast везде использовал std::string_view (см. http_server.h)
+#include "request_handler.h"
+#include "json_loader.h"
+#include "rate_limiter.h"
+
+#include <boost/json.hpp>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std::literals;
+
+TEST_CASE("Rate limiter allows a burst and then refills at the rate", "[RateLimiter]") {
+    RateLimiter limiter{{2.0, 3.0}};
+    const auto start = RateLimiter::Clock::now();
+
+    for (int i = 0; i < 3; ++i) {
+        CHECK_FALSE(limiter.Acquire("token"sv, start));
+    }
+    const auto retry_after = limiter.Acquire("token"sv, start);
+    REQUIRE(retry_after);
+    CHECK(*retry_after == 1s);
+
+    // За полсекунды при rate = 2 набирается ровно один токен
+    CHECK_FALSE(limiter.Acquire("token"sv, start + 500ms));
+    CHECK(limiter.Acquire("token"sv, start + 500ms));
+
+    // Корзина не наполняется больше burst
+    const auto later = start + 1h;
+    for (int i = 0; i < 3; ++i) {
+        CHECK_FALSE(limiter.Acquire("token"sv, later));
+    }
+    CHECK(limiter.Acquire("token"sv, later));
+}
+
+TEST_CASE("Rate limiter keeps separate buckets for keys", "[RateLimiter]") {
+    RateLimiter limiter{{1.0, 1.0}};
+    const auto now = RateLimiter::Clock::now();
+
+    CHECK_FALSE(limiter.Acquire("first"sv, now));
+    CHECK(limiter.Acquire("first"sv, now));
+    CHECK_FALSE(limiter.Acquire("second"sv, now));
+
+    const auto v4 = boost::asio::ip::make_address("10.0.0.1");
+    const auto v6 = boost::asio::ip::make_address("::1");
+    CHECK_FALSE(limiter.Acquire(v4, now));
+    CHECK(limiter.Acquire(v4, now));
+    CHECK_FALSE(limiter.Acquire(v6, now));
+}
+
+TEST_CASE("Rate limiter reports how long to wait", "[RateLimiter]") {
+    RateLimiter limiter{{0.25, 1.0}};
+    const auto now = RateLimiter::Clock::now();
+
+    CHECK_FALSE(limiter.Acquire("slow"sv, now));
+    const auto retry_after = limiter.Acquire("slow"sv, now);
+    REQUIRE(retry_after);
+    CHECK(*retry_after == 4s);
+}
+
+TEST_CASE("Disabled rate limiter allows everything", "[RateLimiter]") {
+    RateLimiter limiter;
+    CHECK_FALSE(limiter.IsEnabled());
+    for (int i = 0; i < 1000; ++i) {
+        CHECK_FALSE(limiter.Acquire("any"sv));
+    }
+}
+
+TEST_CASE("Rate limiter forgets idle buckets", "[RateLimiter]") {
+    RateLimiter limiter{{1.0, 1.0}};
+    const auto start = RateLimiter::Clock::now();
+
+    // Больше ключей, чем помещается в таблицу без чистки. Все корзины только что опустели,
+    // и забыть из них нечего
+    constexpr int Keys = 1 << 19;
+    for (int i = 0; i < Keys; ++i) {
+        limiter.Acquire(std::to_string(i), start);
+    }
+    CHECK(limiter.GetBucketCount() == Keys);
+
+    // Через 10 секунд старые корзины полны, и новые ключи их вытесняют.
+    // Ключ, который только что исчерпал лимит, не должен потерять свою корзину
+    const auto now = start + 10s;
+    CHECK_FALSE(limiter.Acquire("busy"sv, now));
+    for (int i = 0; i < Keys; ++i) {
+        limiter.Acquire("new" + std::to_string(i), now);
+    }
+    CHECK(limiter.Acquire("busy"sv, now));
+    CHECK(limiter.GetBucketCount() < Keys + Keys / 2);
+}
+
+TEST_CASE("Client address is taken from X-Forwarded-For of trusted proxies only", "[RateLimiter]") {
+    using http_handler::ResolveClientAddress;
+    const auto router = boost::asio::ip::make_address("10.0.0.1");
+    const auto client = boost::asio::ip::make_address("192.0.2.7");
+    const std::vector trusted{router};
+
+    CHECK(ResolveClientAddress(router, "192.0.2.7"sv, trusted) == client);
+    // Левее - то, что прислал сам клиент, ему верить нельзя
+    CHECK(ResolveClientAddress(router, "203.0.113.1, 192.0.2.7"sv, trusted) == client);
+    CHECK(ResolveClientAddress(router, " ::1 "sv, trusted) == boost::asio::ip::make_address("::1"));
+
+    // Без заголовка или с неразборчивым заголовком лимит считается по самому прокси
+    CHECK(ResolveClientAddress(router, ""sv, trusted) == router);
+    CHECK(ResolveClientAddress(router, "unknown"sv, trusted) == router);
+    // Клиент, пришедший напрямую, не может выдать себя за другого
+    CHECK(ResolveClientAddress(client, "203.0.113.1"sv, trusted) == client);
+    CHECK(ResolveClientAddress(router, "192.0.2.7"sv, {}) == router);
+}
+
+TEST_CASE("Trusted proxies are read from the config", "[RateLimiter]") {
+    const auto limits = json_loader::LoadRateLimits(boost::json::parse(R"({
+        "rateLimits": {"perIp": {"rate": 5}, "trustedProxies": ["10.0.0.1", "::1"]}
+    })").as_object());
+    CHECK(limits.per_ip.rate == 5.0);
+    CHECK(limits.trusted_proxies == std::vector{boost::asio::ip::make_address("10.0.0.1"),
+                                                boost::asio::ip::make_address("::1")});
+
+    CHECK_THROWS_AS(json_loader::LoadRateLimits(boost::json::parse(R"({
+        "rateLimits": {"trustedProxies": ["router"]}
+    })").as_object()), std::invalid_argument);
+}
@@ -0,0 +1,78 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "test-server.h"
+
+#include <cstdlib>
+#include <new>
+#include <optional>
+
+using namespace test_server;
+
+namespace {
+
+// Считаются только выделения в потоке теста и только между StartCounting и StopCounting
+thread_local bool counting = false;
+thread_local size_t allocations = 0;
+
+void StartCounting() {
+    allocations = 0;
+    counting = true;
+}
+
+size_t StopCounting() {
+    counting = false;
+    return allocations;
+}
+
+// Замерено 8 выделений вместе с отложенной рассылкой состояния: строка токена, обёртки обработчиков ответа,
+// разбор команды, заголовки ответа. Запас - на другую версию Boost и стандартной библиотеки
+constexpr size_t ActionAllocationBudget = 12;
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+    if (counting) {
+        ++allocations;
+    }
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+TEST_CASE("Player action stays within the allocation budget", "[RequestHandler]") {
+    TestServer server;
+    const auto token = server.Join("dog");
+
+    // Первая команда прогревает то, что создаётся один раз
+    REQUIRE(server.Exchange(MakeRequest(http::verb::post, "/api/v1/game/player/action", R"({"move": "R"})", token)));
+
+    auto request = MakeRequest(http::verb::post, "/api/v1/game/player/action", R"({"move": "L"})", token);
+    std::optional<StringResponse> response;
+    server.ioc.restart();
+    StartCounting();
+    server.handler(std::move(request), [&response](auto&& result) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(result)>, StringResponse>) {
+            response = std::move(result);
+        }
+    });
+    const bool answered_at_once = response.has_value();
+    // Рассылка нового состояния откладывается, её выделения тоже считаются
+    server.ioc.poll();
+    const auto count = StopCounting();
+
+    // Команда принимается без обращения к strand, поэтому ответ приходит сразу
+    CHECK(answered_at_once);
+    REQUIRE(response);
+    CHECK(response->result() == http::status::ok);
+    INFO("allocations: " << count);
+    CHECK(count <= ActionAllocationBudget);
+}
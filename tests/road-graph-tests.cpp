@@ -0,0 +1,165 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include "model/model.h"
+#include "app/app.h"
+
+#include <vector>
+
+using Catch::Matchers::WithinAbs;
+
+namespace {
+
+/*
+ *  (0,0) ----------- (10,0)
+ *    |                  |
+ *    |                  |
+ *  (0,10)            (10,10) ---- (20,10)
+ */
+model::Map MakeMap() {
+    model::Map map{model::Map::Id{"map"}, "map"};
+    map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 10});
+    map.AddRoad({model::Road::VERTICAL, {0, 0}, 10});
+    map.AddRoad({model::Road::VERTICAL, {10, 0}, 10});
+    map.AddRoad({model::Road::HORIZONTAL, {10, 10}, 20});
+    map.SetDogSpeed(1.0);
+    map.BuildRoadGraph();
+    return map;
+}
+
+}  // namespace
+
+TEST_CASE("Road graph finds shortest routes", "[RoadGraph]") {
+    const auto map = MakeMap();
+    const auto& graph = map.GetRoadGraph();
+
+    CHECK(graph.GetNodeCount() == 5);
+
+    SECTION("Distance follows the roads") {
+        CHECK_THAT(*graph.Distance({0.0, 10.0}, {20.0, 10.0}), WithinAbs(40.0, 1e-9));
+        CHECK_THAT(*graph.Distance({2.0, 0.0}, {7.0, 0.0}), WithinAbs(5.0, 1e-9));
+        CHECK_THAT(*graph.Distance({0.0, 5.0}, {10.0, 5.0}), WithinAbs(20.0, 1e-9));
+    }
+
+    SECTION("Waypoints lead through junctions") {
+        auto path = graph.Waypoints({0.0, 0.0}, {15.0, 10.0}, 100.0);
+        REQUIRE(path);
+        CHECK(path->waypoints == std::vector<geom::Point2D>{{10.0, 0.0}, {10.0, 10.0}, {15.0, 10.0}});
+
+        path = graph.Waypoints({10.0, 10.0}, {15.0, 10.0}, 100.0);
+        REQUIRE(path);
+        CHECK(path->waypoints == std::vector<geom::Point2D>{{15.0, 10.0}});
+
+        // Даже при нулевом запасе хода путь начинается с ближайшей точки
+        path = graph.Waypoints({0.0, 10.0}, {15.0, 10.0}, 0.0);
+        REQUIRE(path);
+        CHECK_FALSE(path->complete);
+        CHECK(path->waypoints == std::vector<geom::Point2D>{{0.0, 0.0}});
+    }
+
+    SECTION("Points off the roads are rejected") {
+        CHECK_FALSE(graph.Snap({5.0, 5.0}));
+        CHECK_FALSE(graph.Waypoints({5.0, 5.0}, {0.0, 0.0}, 100.0));
+        CHECK(graph.Snap({5.0, 0.3}) == geom::Point2D{5.0, 0.0});
+    }
+}
+
+TEST_CASE("Dog follows the route to its target", "[RoadGraph]") {
+    const auto map = MakeMap();
+    model::Dog dog;
+    dog.SetStartPosition({0.0, 10.0});
+    dog.SetTarget({15.0, 10.0});
+
+    // 10 вверх, 10 вправо и 2 вниз за один тик
+    dog.Move(&map, 22'000);
+    CHECK_THAT(dog.GetPosition().x, WithinAbs(10.0, 1e-9));
+    CHECK_THAT(dog.GetPosition().y, WithinAbs(2.0, 1e-9));
+    CHECK(dog.GetDirection() == 'D');
+    CHECK(dog.GetTarget());
+
+    dog.Move(&map, 20'000);
+    CHECK_THAT(dog.GetPosition().x, WithinAbs(15.0, 1e-9));
+    CHECK_THAT(dog.GetPosition().y, WithinAbs(10.0, 1e-9));
+    CHECK_FALSE(dog.GetTarget());
+    CHECK(dog.GetSpeed() == geom::Vector2D{0.0, 0.0});
+
+    // Ручное управление отменяет движение к цели
+    dog.SetTarget({0.0, 0.0});
+    dog.SetNextMove(1.0, 'R');
+    CHECK_FALSE(dog.GetTarget());
+}
+
+TEST_CASE("Roads are found near their ends and nowhere else", "[RoadGraph]") {
+    const auto map = MakeMap();
+    const auto& graph = map.GetRoadGraph();
+
+    CHECK(graph.Snap({-0.3, 0.0}) == geom::Point2D{0.0, 0.0});
+    CHECK(graph.Snap({20.4, 10.2}) == geom::Point2D{20.0, 10.0});
+    CHECK(graph.Snap({10.2, 6.0}) == geom::Point2D{10.0, 6.0});
+    CHECK_FALSE(graph.Snap({20.5, 10.0}));
+    CHECK_FALSE(graph.Snap({-100.0, -100.0}));
+    CHECK_FALSE(graph.Snap({1000.0, 1000.0}));
+}
+
+TEST_CASE("Path is cut by distance and ends at the target", "[RoadGraph]") {
+    const auto map = MakeMap();
+    const auto& graph = map.GetRoadGraph();
+
+    auto path = graph.Waypoints({0.0, 10.0}, {15.0, 10.0}, 100.0);
+    REQUIRE(path);
+    CHECK(path->complete);
+    CHECK(path->waypoints == std::vector<geom::Point2D>{{0.0, 0.0}, {10.0, 0.0}, {10.0, 10.0}, {15.0, 10.0}});
+
+    path = graph.Waypoints({0.0, 10.0}, {15.0, 10.0}, 12.0);
+    REQUIRE(path);
+    CHECK_FALSE(path->complete);
+    CHECK(path->waypoints == std::vector<geom::Point2D>{{0.0, 0.0}, {10.0, 0.0}});
+
+    CHECK_FALSE(graph.Waypoints({5.0, 5.0}, {0.0, 0.0}, 100.0));
+}
+
+TEST_CASE("Dog collects loot on every leg of its route in order", "[RoadGraph]") {
+    auto map = MakeMap();
+    // Угол маршрута и середина следующего отрезка. Прямая от начала к концу пути проходит мимо обоих
+    map.AddLostObjects({{1, 0, {10.0, 0.0}, 10}, {2, 0, {10.0, 5.0}, 10}});
+
+    App app;
+    app.AddPlayer("dog", &map);
+    auto* dog = app.GetPlayersOnMap(&map).front()->GetDog();
+    REQUIRE(dog->GetPosition() == geom::Point2D{0.0, 0.0});
+    dog->SetTarget({15.0, 10.0});
+
+    app.Move(25'000);
+    CHECK(dog->GetPosition() == geom::Point2D{15.0, 10.0});
+    CHECK(dog->GetTurns() == std::vector<geom::Point2D>{{10.0, 0.0}, {10.0, 10.0}});
+    const auto bag = dog->GetBag();
+    REQUIRE(bag.size() == 2);
+    CHECK(bag[0].id == 1);
+    CHECK(bag[1].id == 2);
+}
+
+TEST_CASE("Route longer than one tick's waypoints continues on the next tick", "[RoadGraph]") {
+    // Лестница из единичных отрезков: больше поворотов, чем RoadGraph::MaxWaypoints
+    constexpr int Stairs = 40;
+    model::Map map{model::Map::Id{"map"}, "map"};
+    for (int i = 0; i < Stairs; ++i) {
+        map.AddRoad({model::Road::HORIZONTAL, {i, i}, i + 1});
+        map.AddRoad({model::Road::VERTICAL, {i + 1, i}, i + 1});
+    }
+    map.SetDogSpeed(1.0);
+    map.BuildRoadGraph();
+
+    model::Dog dog;
+    dog.SetStartPosition({0.0, 0.0});
+    const geom::Point2D target{static_cast<double>(Stairs), static_cast<double>(Stairs)};
+    dog.SetTarget(target);
+
+    dog.Move(&map, 2 * Stairs * 1000);
+    CHECK(dog.GetTurns().size() == model::RoadGraph::MaxWaypoints - 1);
+    CHECK(dog.GetTarget());
+    CHECK(dog.GetPosition() != target);
+
+    dog.Move(&map, 2 * Stairs * 1000);
+    CHECK(dog.GetPosition() == target);
+    CHECK_FALSE(dog.GetTarget());
+}
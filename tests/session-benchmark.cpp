@@ -0,0 +1,150 @@
+// Сравнение сессий на обратных вызовах и на сопрограммах: запросов в секунду и выделений памяти на запрос.
+// Ответ отправляется сразу или, как ответы API, из strand в другом потоке.
+// Запуск: session_benchmark [секунды] [соединения] [порт]
+
+#include "http_server.h"
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/read.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::literals;
+
+namespace {
+
+std::atomic<size_t> allocations{0};
+std::atomic<size_t> requests{0};
+
+struct Result {
+    double requests_per_second = 0.0;
+    double allocations_per_request = 0.0;
+};
+
+constexpr std::string_view Request = "GET /api/v1/maps HTTP/1.1\r\nHost: localhost\r\n\r\n"sv;
+
+// Держит соединение открытым и отправляет запрос за запросом, пока не выставлен stop
+void RunClient(tcp::endpoint endpoint, const std::atomic_bool& stop) {
+    net::io_context ioc;
+    tcp::socket socket{ioc};
+    socket.connect(endpoint);
+    socket.set_option(tcp::no_delay{true});
+
+    // Все ответы одинаковые, поэтому длину достаточно узнать по первому
+    beast::flat_buffer buffer;
+    http::response<http::string_body> first;
+    net::write(socket, net::buffer(Request));
+    const size_t response_size = http::read(socket, buffer, first);
+
+    std::vector<char> response(response_size);
+    while (!stop.load(std::memory_order_relaxed)) {
+        net::write(socket, net::buffer(Request));
+        net::read(socket, net::buffer(response));
+        requests.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+Result Measure(bool coroutines, bool deferred, std::chrono::seconds duration, int connections,
+               net::ip::port_type port) {
+    net::io_context ioc(1);
+    // Поток игры: при deferred ответ отправляется из его strand, и сессия ждёт его, как ответа API
+    net::io_context game_ioc(1);
+    auto game_work = net::make_work_guard(game_ioc);
+    auto game_strand = net::make_strand(game_ioc);
+
+    const tcp::endpoint endpoint{net::ip::make_address("127.0.0.1"), port};
+    http_server::ServeHttp(ioc, endpoint, [deferred, &game_strand](auto&& req, auto&& send) {
+        StringResponse response{http::status::ok, req.version()};
+        response.set(http::field::content_type, "application/json"sv);
+        response.body() = R"([{"id": "map1", "name": "Map 1"}])";
+        response.prepare_payload();
+        response.keep_alive(req.keep_alive());
+        if (!deferred) {
+            return send(std::move(response));
+        }
+        net::post(game_strand, [send, response = std::move(response)]() mutable {
+            send(std::move(response));
+        });
+    }, {}, {0, nullptr, false, coroutines});
+    std::thread server{[&ioc] {
+        ioc.run();
+    }};
+    std::thread game{[&game_ioc] {
+        game_ioc.run();
+    }};
+
+    std::atomic_bool stop{false};
+    std::vector<std::thread> clients;
+    clients.reserve(connections);
+    for (int i = 0; i < connections; ++i) {
+        clients.emplace_back([&] {
+            RunClient(endpoint, stop);
+        });
+    }
+
+    // Первые ответы и прогрев не учитываются
+    std::this_thread::sleep_for(200ms);
+    const auto allocations_before = allocations.load();
+    const auto requests_before = requests.load();
+    const auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(duration);
+    const auto allocated = allocations.load() - allocations_before;
+    const auto total = requests.load() - requests_before;
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    stop = true;
+    for (auto& client : clients) {
+        client.join();
+    }
+
+    ioc.stop();
+    server.join();
+    game_work.reset();
+    game_ioc.stop();
+    game.join();
+
+    // Клиенты тоже выделяют память, но одинаково в обоих режимах
+    return {total / elapsed.count(), total ? static_cast<double>(allocated) / total : 0.0};
+}
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+int main(int argc, const char* argv[]) {
+    const std::chrono::seconds duration{argc > 1 ? std::atoi(argv[1]) : 5};
+    const int connections = argc > 2 ? std::atoi(argv[2]) : 8;
+    const auto port = static_cast<net::ip::port_type>(argc > 3 ? std::atoi(argv[3]) : 18090);
+
+    std::cout << std::fixed << std::setprecision(1);
+    for (bool deferred : {false, true}) {
+        for (bool coroutines : {false, true}) {
+            const auto result = Measure(coroutines, deferred, duration, connections, port);
+            std::cout << (coroutines ? "coroutine" : "callback ") << " sessions, "
+                      << (deferred ? "deferred " : "immediate") << " responses: "
+                      << result.requests_per_second << " requests/s, "
+                      << result.allocations_per_request << " allocations/request" << std::endl;
+        }
+    }
+}
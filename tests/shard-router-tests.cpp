@@ -0,0 +1,169 @@
+#include <catch2/catch_test_macros.hpp>
+
+// Первым, чтобы Beast везде использовал std::string_view (см. http_server.h)
+#include "shard_router.h"
+#include "app/app.h"
+
+#include <atomic>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::literals;
+using namespace shard_router;
+
+namespace {
+
+/*
+ *  Шард, который отвечает на первый запрос, держит соединение открытым и закрывает его,
+ *  прочитав второй запрос, так и не ответив. Следующие соединения обслуживаются как обычно.
+ *  Так выглядит соединение из пула, закрытое шардом в момент отправки запроса
+ */
+class DroppingShard {
+public:
+    DroppingShard()
+        : acceptor_{ioc_, {net::ip::make_address("127.0.0.1"), 0}}
+        , thread_{[this] { Run(); }} {
+    }
+
+    ~DroppingShard() {
+        // Блокирующий accept будится подключением, после которого поток завершается
+        stopping_ = true;
+        tcp::socket wake{ioc_};
+        sys::error_code ec;
+        wake.connect(acceptor_.local_endpoint(), ec);
+        thread_.join();
+    }
+
+    std::string GetPort() const {
+        return std::to_string(acceptor_.local_endpoint().port());
+    }
+
+    // Сколько запросов шард прочитал целиком
+    int GetReceived() const {
+        return received_;
+    }
+
+private:
+    void Run() {
+        sys::error_code ec;
+        for (int connection = 0; !ec; ++connection) {
+            tcp::socket socket{ioc_};
+            acceptor_.accept(socket, ec);
+            if (ec || stopping_) {
+                return;
+            }
+            beast::flat_buffer buffer;
+            while (true) {
+                StringRequest request;
+                http::read(socket, buffer, request, ec);
+                if (ec) {
+                    ec = {};
+                    break;
+                }
+                ++received_;
+                if (connection == 0 && received_ == 2) {
+                    socket.close(ec);
+                    break;
+                }
+                StringResponse response{http::status::ok, request.version()};
+                response.body() = "ok";
+                response.keep_alive(true);
+                response.prepare_payload();
+                http::write(socket, response, ec);
+            }
+        }
+    }
+
+    net::io_context ioc_;
+    tcp::acceptor acceptor_;
+    std::atomic_int received_ = 0;
+    std::atomic_bool stopping_ = false;
+    std::thread thread_;
+};
+
+http::status Forward(net::io_context& ioc, ShardClient& client, http::verb method) {
+    StringRequest request{method, "/api/v1/game/player/action", 11};
+    request.set(http::field::host, "shard");
+    request.prepare_payload();
+
+    std::optional<http::status> status;
+    client.Forward(std::move(request), [&status](StringResponse response) {
+        status = response.result();
+    });
+    ioc.restart();
+    while (!status && ioc.run_one_for(5s)) {
+    }
+    REQUIRE(status);
+    return *status;
+}
+
+}  // namespace
+
+TEST_CASE("Shard spec is host, port and maps", "[ShardRouter]") {
+    const auto shard = ParseShard("127.0.0.1:9001=map1,map2");
+    CHECK(shard.host == "127.0.0.1");
+    CHECK(shard.port == "9001");
+    CHECK(shard.map_ids == std::vector<std::string>{"map1", "map2"});
+
+    // Порт отделяется последним двоеточием до '='
+    const auto ipv6 = ParseShard("::1:9002=map3");
+    CHECK(ipv6.host == "::1");
+    CHECK(ipv6.port == "9002");
+
+    CHECK_THROWS_AS(ParseShard("127.0.0.1:9001"), std::invalid_argument);
+    CHECK_THROWS_AS(ParseShard("127.0.0.1=map1"), std::invalid_argument);
+    CHECK_THROWS_AS(ParseShard(":9001=map1"), std::invalid_argument);
+    CHECK_THROWS_AS(ParseShard("127.0.0.1:=map1"), std::invalid_argument);
+    CHECK_THROWS_AS(ParseShard("127.0.0.1:9001="), std::invalid_argument);
+    CHECK_THROWS_AS(ParseShard("127.0.0.1:9001=,"), std::invalid_argument);
+}
+
+TEST_CASE("Map ids are split by commas, skipping empty ones", "[ShardRouter]") {
+    CHECK(SplitMapIds("").empty());
+    CHECK(SplitMapIds(",,").empty());
+    CHECK(SplitMapIds("map1") == std::vector<std::string>{"map1"});
+    CHECK(SplitMapIds("map1,map2") == std::vector<std::string>{"map1", "map2"});
+    CHECK(SplitMapIds(",map1,,map2,") == std::vector<std::string>{"map1", "map2"});
+}
+
+TEST_CASE("Token carries the shard in its first digit", "[ShardRouter]") {
+    CHECK(PlayerTokens::GetShard(Token{"0123456789abcdef0123456789abcdef"}) == 0);
+    CHECK(PlayerTokens::GetShard(Token{"a123456789abcdef0123456789abcdef"}) == 10);
+    CHECK(PlayerTokens::GetShard(Token{"F123456789abcdef0123456789abcdef"}) == 15);
+    CHECK_FALSE(PlayerTokens::GetShard(Token{"g123456789abcdef0123456789abcdef"}));
+    CHECK_FALSE(PlayerTokens::GetShard(Token{""}));
+
+    for (int shard : {0, 7, 15}) {
+        PlayerTokens tokens;
+        tokens.SetShard(shard);
+        CHECK(PlayerTokens::GetShard(tokens.GenerateToken()) == shard);
+    }
+    PlayerTokens tokens;
+    CHECK_THROWS_AS(tokens.SetShard(-1), std::invalid_argument);
+    CHECK_THROWS_AS(tokens.SetShard(PlayerTokens::MaxShards), std::invalid_argument);
+}
+
+TEST_CASE("Only idempotent requests are resent after the shard drops a pooled connection", "[ShardRouter]") {
+    SECTION("POST is not resent") {
+        DroppingShard shard;
+        net::io_context ioc;
+        ShardClient client{ioc, Shard{"127.0.0.1", shard.GetPort(), {"map1"}}};
+
+        CHECK(Forward(ioc, client, http::verb::get) == http::status::ok);
+        // Шард прочитал запрос и мог его выполнить, повтор выполнил бы действие дважды
+        CHECK(Forward(ioc, client, http::verb::post) == http::status::bad_gateway);
+        CHECK(shard.GetReceived() == 2);
+    }
+    SECTION("GET is resent over a new connection") {
+        DroppingShard shard;
+        net::io_context ioc;
+        ShardClient client{ioc, Shard{"127.0.0.1", shard.GetPort(), {"map1"}}};
+
+        CHECK(Forward(ioc, client, http::verb::get) == http::status::ok);
+        CHECK(Forward(ioc, client, http::verb::get) == http::status::ok);
+        CHECK(shard.GetReceived() == 3);
+    }
+}
@@ -0,0 +1,96 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "model/spatial_grid.h"
+#include "app/app.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace {
+
+std::vector<size_t> Sorted(std::vector<size_t> indices) {
+    std::sort(indices.begin(), indices.end());
+    return indices;
+}
+
+}  // namespace
+
+TEST_CASE("Spatial grid finds objects near a point", "[SpatialGrid]") {
+    spatial::Grid grid{5.0};
+
+    grid.Insert(0, {0.0, 0.0});
+    grid.Insert(1, {3.0, 4.0});
+    grid.Insert(2, {12.0, 0.0});
+    grid.Insert(3, {-7.0, -1.0});
+    grid.Insert(4, {100.0, 100.0});
+
+    SECTION("Only objects within radius are returned") {
+        CHECK(Sorted(grid.Query({0.0, 0.0}, 5.0)) == std::vector<size_t>{0, 1});
+        CHECK(Sorted(grid.Query({0.0, 0.0}, 7.5)) == std::vector<size_t>{0, 1, 3});
+        CHECK(Sorted(grid.Query({10.0, 0.0}, 2.0)) == std::vector<size_t>{2});
+    }
+
+    SECTION("Objects on neighbouring cells are found across cell borders") {
+        CHECK(Sorted(grid.Query({-4.9, 0.0}, 5.0)) == std::vector<size_t>{0, 3});
+    }
+
+    SECTION("Large radius returns everything") {
+        CHECK(Sorted(grid.Query({0.0, 0.0}, 1000.0)) == std::vector<size_t>{0, 1, 2, 3, 4});
+        // Номер ячейки на границе такой области не помещается в int64_t
+        CHECK(Sorted(grid.Query({0.0, 0.0}, 1e300)) == std::vector<size_t>{0, 1, 2, 3, 4});
+        CHECK(Sorted(grid.Query({0.0, 0.0}, std::numeric_limits<double>::infinity()))
+              == std::vector<size_t>{0, 1, 2, 3, 4});
+    }
+
+    SECTION("Empty area returns nothing") {
+        CHECK(grid.Query({50.0, 50.0}, 3.0).empty());
+    }
+
+    SECTION("Clear removes all objects") {
+        grid.Clear();
+        CHECK(grid.Size() == 0);
+        CHECK(grid.Query({0.0, 0.0}, 1000.0).empty());
+
+        grid.Insert(7, {1.0, 1.0});
+        CHECK(grid.Query({0.0, 0.0}, 2.0) == std::vector<size_t>{7});
+    }
+}
+
+TEST_CASE("Spatial grid forgets cells that stay empty", "[SpatialGrid]") {
+    spatial::Grid grid{1.0};
+    for (int i = 0; i < 100; ++i) {
+        grid.Insert(i, {static_cast<double>(i), 0.0});
+    }
+    CHECK(grid.CellCount() == 100);
+
+    // Ячейки остаются до следующей очистки, чтобы не выделять память под те же места заново
+    grid.Clear();
+    grid.Insert(0, {0.0, 0.0});
+    CHECK(grid.CellCount() == 100);
+
+    grid.Clear();
+    CHECK(grid.CellCount() == 1);
+}
+
+TEST_CASE("Players and loot near a point are found the same way with a cleared index", "[SpatialGrid]") {
+    model::Map map{model::Map::Id{"map1"}, "Map 1"};
+    map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 40});
+    map.SetDogRetirementTime(1.0);
+    map.AddLostObjects({{1, 0, {30.0, 0.0}, 10}});
+
+    App app;
+    app.AddPlayer("first", &map);
+    app.UpdateSpatialIndex();
+
+    // Игрок уходит на покой, и при следующем построении индекс карты остаётся пустым
+    app.Move(2000);
+    REQUIRE(app.RemoveRetiredPlayers().size() == 1);
+    app.UpdateSpatialIndex();
+
+    // Новый игрок пришёл до следующего тика
+    app.AddPlayer("second", &map);
+    CHECK(app.GetPlayersNear(&map, {0.0, 0.0}, 100.0).size() == 1);
+    CHECK(app.GetLootsNear(&map, {0.0, 0.0}, 100.0).size() == 1);
+    CHECK(app.GetLootsNear(&map, {0.0, 0.0}, 10.0).empty());
+}
@@ -0,0 +1,77 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "state_publisher.h"
+
+#include <memory>
+#include <string>
+
+TEST_CASE("Cancelled waiter is removed and not called", "[StatePublisher]") {
+    StatePublisher publisher;
+    const model::Map::InstanceId map = 1;
+    publisher.OpenChannel(map);
+
+    int first_calls = 0;
+    int second_calls = 0;
+    const auto first = publisher.Wait(map, [&first_calls](StateFrame) {
+        ++first_calls;
+    });
+    publisher.Wait(map, [&second_calls](StateFrame) {
+        ++second_calls;
+    });
+    REQUIRE(publisher.IsWatched(map));
+
+    publisher.CancelWait(map, *first);
+    publisher.Publish(map, std::make_shared<const std::string>("frame"));
+    CHECK(first_calls == 0);
+    CHECK(second_calls == 1);
+
+    // Ожидающие получают только один кадр
+    CHECK_FALSE(publisher.IsWatched(map));
+    publisher.Publish(map, std::make_shared<const std::string>("frame"));
+    CHECK(second_calls == 1);
+}
+
+TEST_CASE("Cancelling every waiter leaves the map unwatched", "[StatePublisher]") {
+    StatePublisher publisher;
+    const model::Map::InstanceId map = 1;
+    publisher.OpenChannel(map);
+
+    for (int i = 0; i < 100; ++i) {
+        publisher.CancelWait(map, *publisher.Wait(map, [](StateFrame) {}));
+    }
+    CHECK_FALSE(publisher.IsWatched(map));
+}
+
+namespace {
+
+struct CountingSubscriber : StateSubscriber {
+    void OnFrame(StateFrame) override {
+        ++frames;
+    }
+
+    int frames = 0;
+};
+
+}  // namespace
+
+TEST_CASE("Removed channel is not recreated by late calls", "[StatePublisher]") {
+    StatePublisher publisher;
+    const model::Map::InstanceId map = 1;
+    publisher.OpenChannel(map);
+    publisher.UpdateMembers(map);
+    REQUIRE(publisher.GetVersions(map).members == 1);
+
+    publisher.RemoveChannel(map);
+    // Запоздавшие запросы к удалённому экземпляру
+    publisher.UpdateState(map);
+    publisher.UpdateMembers(map);
+    const auto subscriber = std::make_shared<CountingSubscriber>();
+    CHECK_FALSE(publisher.Subscribe(map, subscriber));
+    CHECK_FALSE(publisher.Wait(map, [](StateFrame) {}));
+
+    CHECK(publisher.GetVersions(map).state == 0);
+    CHECK(publisher.GetVersions(map).members == 0);
+    CHECK_FALSE(publisher.IsWatched(map));
+    publisher.Publish(map, std::make_shared<const std::string>("frame"));
+    CHECK(subscriber->frames == 0);
+}
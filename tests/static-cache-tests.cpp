@@ -0,0 +1,135 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "test-server.h"
+
+#include <fstream>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std::literals;
+using namespace test_server;
+
+namespace {
+
+void WriteFile(const std::filesystem::path& path, const std::string& contents) {
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream file{path, std::ios::binary};
+    file << contents;
+}
+
+// Путь так, как его получает обработчик статики: декодированный и без начального '/'
+std::optional<std::string> NormalizeTarget(const std::string& target) {
+    return StaticCache::NormalizePath(http_handler::DecodeUrl(target).substr(1));
+}
+
+}  // namespace
+
+TEST_CASE("Static paths are normalized inside the root", "[StaticCache]") {
+    CHECK(StaticCache::NormalizePath(""sv) == ""s);
+    CHECK(StaticCache::NormalizePath("."sv) == ""s);
+    CHECK(StaticCache::NormalizePath("index.html"sv) == "index.html"s);
+    CHECK(StaticCache::NormalizePath("images/"sv) == "images"s);
+    CHECK(StaticCache::NormalizePath("images/./logo.png"sv) == "images/logo.png"s);
+    CHECK(StaticCache::NormalizePath("images/../index.html"sv) == "index.html"s);
+    CHECK(StaticCache::NormalizePath("a/b/../../index.html"sv) == "index.html"s);
+}
+
+TEST_CASE("Static paths cannot leave the root", "[StaticCache]") {
+    CHECK_FALSE(StaticCache::NormalizePath(".."sv));
+    CHECK_FALSE(StaticCache::NormalizePath("../"sv));
+    CHECK_FALSE(StaticCache::NormalizePath("../etc/passwd"sv));
+    CHECK_FALSE(StaticCache::NormalizePath("images/../../etc/passwd"sv));
+    CHECK_FALSE(StaticCache::NormalizePath("/etc/passwd"sv));
+
+    // Закодированные точки и слэши раскрываются до нормализации
+    CHECK_FALSE(NormalizeTarget("/%2e%2e/etc/passwd"));
+    CHECK_FALSE(NormalizeTarget("/%2E%2E/etc/passwd"));
+    CHECK_FALSE(NormalizeTarget("/images/%2e%2e/%2e%2e/etc/passwd"));
+    CHECK_FALSE(NormalizeTarget("/..%2fetc/passwd"));
+    CHECK(NormalizeTarget("/images/%2e%2e/index.html") == "index.html"s);
+}
+
+TEST_CASE("HTTP dates are parsed in IMF-fixdate format only", "[StaticCache]") {
+    const auto date = StaticCache::ParseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT");
+    REQUIRE(date);
+    CHECK(*date == 784111777);
+    CHECK(StaticCache::FormatHttpDate(*date) == "Sun, 06 Nov 1994 08:49:37 GMT");
+
+    CHECK_FALSE(StaticCache::ParseHttpDate(""));
+    CHECK_FALSE(StaticCache::ParseHttpDate("yesterday"));
+    CHECK_FALSE(StaticCache::ParseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT garbage"));
+    CHECK_FALSE(StaticCache::ParseHttpDate("Sun, 06 Nov 1994"));
+}
+
+TEST_CASE("Unreadable static files are skipped", "[StaticCache]") {
+    TempDirectory root{"game_server_tests_static"};
+    WriteFile(root.GetPath() / "index.html", "<html></html>");
+    WriteFile(root.GetPath() / "secret.txt", "secret");
+    ::chmod((root.GetPath() / "secret.txt").c_str(), 0);
+
+    StaticCache cache{root.GetPath()};
+    CHECK(cache.Find("index.html"));
+    CHECK(cache.Find(""));
+    // Права не мешают суперпользователю, тогда файл просто прочитан
+    if (::geteuid() != 0) {
+        CHECK_FALSE(cache.Find("secret.txt"));
+    }
+}
+
+TEST_CASE("Single byte ranges are parsed", "[StaticCache]") {
+    using http_handler::ParseRange;
+    auto check = [](std::optional<http_handler::RangeRequest> range, uint64_t offset, uint64_t length) {
+        REQUIRE(range);
+        CHECK(range->satisfiable);
+        CHECK(range->offset == offset);
+        CHECK(range->length == length);
+    };
+
+    check(ParseRange("bytes=0-9"sv, 100), 0, 10);
+    check(ParseRange("bytes=90-200"sv, 100), 90, 10);
+    // Открытый конец - до конца файла
+    check(ParseRange("bytes=10-"sv, 100), 10, 90);
+    // Суффикс - последние n байт, но не больше файла
+    check(ParseRange("bytes=-10"sv, 100), 90, 10);
+    check(ParseRange("bytes=-500"sv, 100), 0, 100);
+}
+
+TEST_CASE("Unsatisfiable and unsupported ranges", "[StaticCache]") {
+    using http_handler::ParseRange;
+    // За концом файла - 416
+    for (const auto value : {"bytes=100-"sv, "bytes=100-200"sv, "bytes=-0"sv}) {
+        const auto range = ParseRange(value, 100);
+        REQUIRE(range);
+        CHECK_FALSE(range->satisfiable);
+    }
+    const auto empty_file = ParseRange("bytes=0-"sv, 0);
+    REQUIRE(empty_file);
+    CHECK_FALSE(empty_file->satisfiable);
+
+    // Несколько диапазонов и неверные формы игнорируются: клиент получит файл целиком
+    CHECK_FALSE(ParseRange("bytes=0-1,5-6"sv, 100));
+    CHECK_FALSE(ParseRange("bytes=9-0"sv, 100));
+    CHECK_FALSE(ParseRange("bytes=a-b"sv, 100));
+    CHECK_FALSE(ParseRange("bytes=5"sv, 100));
+    CHECK_FALSE(ParseRange("items=0-9"sv, 100));
+}
+
+TEST_CASE("Only small files stay in memory", "[StaticCache]") {
+    TempDirectory root{"game_server_tests_static"};
+    WriteFile(root.GetPath() / "small.txt", "small");
+    WriteFile(root.GetPath() / "large.bin", std::string(StaticCache::FileBodyThreshold, 'x'));
+
+    StaticCache cache{root.GetPath()};
+    const auto small = cache.Find("small.txt");
+    REQUIRE(small);
+    CHECK(small->body == "small");
+    CHECK_FALSE(small->file);
+
+    const auto large = cache.Find("large.bin");
+    REQUIRE(large);
+    CHECK(large->size == StaticCache::FileBodyThreshold);
+    CHECK(large->body.empty());
+    CHECK(large->file);
+}
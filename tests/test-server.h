@@ -0,0 +1,151 @@
+#pragma once
+
+// Первым, чтобы Beast везде использовал std::string_view (см. http_server.h)
+#include "request_handler.h"
+#include "api_handler.h"
+#include "json_loader.h"
+#include "state_storage.h"
+#include "static_cache.h"
+#include "db/database.h"
+
+#include <boost/json.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace test_server {
+
+// Одна карта с одной дорогой длиной 40
+inline constexpr std::string_view DefaultConfig = R"({
+    "maps": [{
+        "id": "map1",
+        "name": "Map 1",
+        "lootTypes": [{"name": "key", "file": "key.obj", "type": "obj", "value": 10}],
+        "roads": [{"x0": 0, "y0": 0, "x1": 40}],
+        "buildings": [],
+        "offices": []
+    }]
+})";
+
+// Рекорды в памяти: тестам не нужна настоящая база данных
+class MemoryDatabase : public Database {
+public:
+    void AddRecords(const std::vector<Record>& records) override {
+        records_.insert(records_.end(), records.begin(), records.end());
+        ++writes_;
+    }
+
+    void GetRecords(const std::optional<int>& start, const std::optional<int>& max_items,
+                    std::function<void(std::vector<Record>)> callback) override {
+        const auto first = std::min<size_t>(start.value_or(0), records_.size());
+        const auto last = std::min<size_t>(first + max_items.value_or(100), records_.size());
+        callback({records_.begin() + first, records_.begin() + last});
+    }
+
+    const std::vector<Record>& GetAll() const {
+        return records_;
+    }
+
+    // Сколько раз вызывался AddRecords
+    size_t GetWriteCount() const {
+        return writes_;
+    }
+
+private:
+    std::vector<Record> records_;
+    size_t writes_ = 0;
+};
+
+// Временный каталог, который удаляется вместе с содержимым. Случайный суффикс разводит тесты,
+// запущенные параллельно
+class TempDirectory {
+public:
+    explicit TempDirectory(const std::string& name)
+        : path_{std::filesystem::temp_directory_path() / (name + '-' + std::to_string(std::random_device{}()))} {
+        std::filesystem::create_directories(path_);
+    }
+
+    TempDirectory(const TempDirectory&) = delete;
+    TempDirectory& operator=(const TempDirectory&) = delete;
+
+    ~TempDirectory() {
+        std::error_code ec;
+        std::filesystem::remove_all(path_, ec);
+    }
+
+    const std::filesystem::path& GetPath() const {
+        return path_;
+    }
+
+private:
+    std::filesystem::path path_;
+};
+
+inline StringRequest MakeRequest(http::verb method, std::string_view target, std::string body,
+                                 std::string_view token = {}) {
+    StringRequest request{method, target, 11};
+    request.set(http::field::content_type, "application/json");
+    if (!token.empty()) {
+        request.set(http::field::authorization, "Bearer " + std::string{token});
+    }
+    request.body() = std::move(body);
+    request.prepare_payload();
+    return request;
+}
+
+// Игра из конфигурации config с обработчиками API и HTTP поверх неё. Всё выполняется в потоке теста
+struct TestServer {
+    explicit TestServer(std::string_view config = DefaultConfig, int tick_period = 0, int tick_catch_up = 0)
+        : jroot{boost::json::parse(config).as_object()}
+        , game{json_loader::LoadGame(jroot)}
+        , loot_generator{json_loader::LoadLootGenerator(jroot)}
+        , loot_data{json_loader::LoadLootData(jroot)}
+        , api_handler{ioc, game, app, storage, loot_generator, loot_data, db, tick_period, tick_catch_up} {
+    }
+
+    // Отправляет запрос и выполняет всё, что он поставил в очередь io_context
+    std::optional<StringResponse> Exchange(StringRequest request) {
+        std::optional<StringResponse> result;
+        handler(std::move(request), [&result](auto&& response) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(response)>, StringResponse>) {
+                result = std::move(response);
+            }
+        });
+        ioc.restart();
+        ioc.poll();
+        return result;
+    }
+
+    // Токен нового игрока на карте map1
+    std::string Join(std::string_view name) {
+        const auto joined = Exchange(MakeRequest(http::verb::post, "/api/v1/game/join",
+            R"({"userName": ")" + std::string{name} + R"(", "mapId": "map1"})"));
+        if (!joined || joined->result() != http::status::ok) {
+            throw std::runtime_error("Failed to join the game");
+        }
+        return std::string{boost::json::parse(joined->body()).at("authToken").as_string()};
+    }
+
+    net::io_context ioc;
+    boost::json::object jroot;
+    model::Game game;
+    loot::Generator loot_generator;
+    loot::Data loot_data;
+    App app{false};
+    StateStorage storage{"", 0, game, app};
+    MemoryDatabase db;
+    ApiHandler api_handler;
+    TempDirectory static_folder{"game_server_tests_static"};
+    StaticCache static_cache{static_folder.GetPath()};
+    http_handler::RequestHandler handler{ioc, static_cache, api_handler};
+};
+
+}  // namespace test_server
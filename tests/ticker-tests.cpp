@@ -0,0 +1,65 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "ticker.h"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace std::literals;
+
+namespace {
+
+constexpr auto Period = 10ms;
+// Первый тик занимает столько, что следующие три дедлайна наступают, пока он работает
+constexpr auto SlowTick = 45ms;
+
+// Запускает тикер на время duration. Первый вызов обработчика длится SlowTick.
+// Возвращает delta всех вызовов и счётчики тикера
+std::vector<std::chrono::milliseconds> Run(int max_catch_up, Ticker::Stats& stats,
+                                           std::chrono::milliseconds duration = 150ms) {
+    net::io_context ioc;
+    auto strand = net::make_strand(ioc);
+    std::vector<std::chrono::milliseconds> deltas;
+    auto ticker = std::make_shared<Ticker>(strand, Period, [&deltas](std::chrono::milliseconds delta) {
+        if (deltas.empty()) {
+            std::this_thread::sleep_for(SlowTick);
+        }
+        deltas.push_back(delta);
+    }, max_catch_up);
+    ticker->Start();
+    ioc.run_for(duration);
+    // io_context остановлен, поэтому счётчики можно читать без strand
+    stats = ticker->GetStats();
+    return deltas;
+}
+
+}  // namespace
+
+TEST_CASE("Ticks missed without catch-up are merged into one delta", "[Ticker]") {
+    Ticker::Stats stats;
+    const auto deltas = Run(0, stats);
+
+    REQUIRE(deltas.size() >= 2);
+    CHECK(stats.ticks == deltas.size());
+    CHECK(stats.merged >= 3);
+    CHECK(stats.dropped == 0);
+    CHECK(stats.overruns >= 1);
+    // Время схлопнутых тиков приходит во втором вызове, поэтому оно не теряется
+    CHECK(deltas[1] >= SlowTick - Period);
+}
+
+TEST_CASE("Ticks beyond the catch-up limit are dropped", "[Ticker]") {
+    Ticker::Stats stats;
+    const auto deltas = Run(1, stats);
+
+    REQUIRE(deltas.size() >= 3);
+    CHECK(stats.ticks == deltas.size());
+    CHECK(stats.merged == 0);
+    // Из четырёх наступивших дедлайнов выполняются два
+    CHECK(stats.dropped >= 2);
+    for (const auto delta : deltas) {
+        CHECK(delta == Period);
+    }
+}